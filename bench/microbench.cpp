@@ -0,0 +1,325 @@
+#include "object.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Microbenchmarks for the data structure layer: SkipList, RedisString parsing and the
+// RedisObject list/set/hash methods. Every benchmark reports allocs/op next to its time, counted
+// by the global operator new below, so that a change adding allocations to a hot path shows up
+// even when the machine is too noisy for the timings to.
+//
+//   microbench --benchmark_filter=SkipList --benchmark_min_time=0.2
+
+namespace {
+
+std::atomic<uint64_t> allocations {0};
+
+// allocations made by the current benchmark since the call, reported per iteration
+class AllocationCounter {
+public:
+    explicit AllocationCounter(benchmark::State& state) : state(state), start(allocations.load()) {}
+
+    ~AllocationCounter() {
+        state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(allocations.load() - start),
+                                                         benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    benchmark::State& state;
+    uint64_t start;
+};
+
+std::string member_name(const int64_t i) {
+    return "member:" + std::to_string(i);
+}
+
+// skip lists are expensive to build at 10M elements, so each size is built once and shared by
+// every benchmark, which leave it as they found it
+SkipList& skip_list_of_size(const int64_t size) {
+    static std::map<int64_t, std::unique_ptr<SkipList>> cache;
+    auto& list = cache[size];
+    if (!list) {
+        list = std::make_unique<SkipList>();
+        for (int64_t i = 0; i < size; ++i) {
+            list->insert(member_name(i), static_cast<double>(i));
+        }
+    }
+    return *list;
+}
+
+// members are inserted or erased in batches with the timer paused, so the pause cost is
+// amortised over the batch
+constexpr int64_t BATCH = 10000;
+
+void BM_SkipListInsert(benchmark::State& state) {
+    auto& list = skip_list_of_size(state.range(0));
+    std::vector<std::string> members;
+    for (int64_t i = 0; i < BATCH; ++i) {
+        members.push_back(member_name(state.range(0) + i));
+    }
+    size_t next = 0;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        if (next == members.size()) {
+            state.PauseTiming();
+            for (size_t i = 0; i < members.size(); ++i) {
+                list.erase(members[i], static_cast<double>(state.range(0)) + i);
+            }
+            next = 0;
+            state.ResumeTiming();
+        }
+        list.insert(members[next], static_cast<double>(state.range(0)) + next);
+        ++next;
+    }
+    for (size_t i = 0; i < next; ++i) {
+        list.erase(members[i], static_cast<double>(state.range(0)) + i);
+    }
+}
+
+void BM_SkipListErase(benchmark::State& state) {
+    auto& list = skip_list_of_size(state.range(0));
+    std::vector<std::string> members;
+    for (int64_t i = 0; i < BATCH; ++i) {
+        members.push_back(member_name(state.range(0) + i));
+    }
+    const auto refill = [&] {
+        for (size_t i = 0; i < members.size(); ++i) {
+            list.insert(members[i], static_cast<double>(state.range(0)) + i);
+        }
+    };
+    refill();
+    size_t next = 0;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        if (next == members.size()) {
+            state.PauseTiming();
+            refill();
+            next = 0;
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(list.erase(members[next], static_cast<double>(state.range(0)) + next));
+        ++next;
+    }
+    for (size_t i = next; i < members.size(); ++i) {
+        list.erase(members[i], static_cast<double>(state.range(0)) + i);
+    }
+}
+
+void BM_SkipListRank(benchmark::State& state) {
+    const auto& list = skip_list_of_size(state.range(0));
+    std::vector<std::string> members;
+    for (int64_t i = 0; i < 1024; ++i) {
+        members.push_back(member_name(i * state.range(0) / 1024));
+    }
+    size_t next = 0;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        const int64_t i = next * state.range(0) / 1024;
+        benchmark::DoNotOptimize(list.rank(members[next], static_cast<double>(i)));
+        next = (next + 1) % members.size();
+    }
+}
+
+// ZRANGE of 10 elements from the middle of the list
+void BM_SkipListRange(benchmark::State& state) {
+    const auto& list = skip_list_of_size(state.range(0));
+    const int start = static_cast<int>(state.range(0) / 2);
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(list.range(start, start + 9));
+    }
+}
+
+void skip_list_sizes(benchmark::internal::Benchmark* b) {
+    b->RangeMultiplier(10)->Range(1000, 10000000);
+}
+
+BENCHMARK(BM_SkipListInsert)->Apply(skip_list_sizes);
+BENCHMARK(BM_SkipListErase)->Apply(skip_list_sizes);
+BENCHMARK(BM_SkipListRank)->Apply(skip_list_sizes);
+BENCHMARK(BM_SkipListRange)->Apply(skip_list_sizes);
+
+RedisObject list_of_size(const int64_t size) {
+    RedisObject ro(RedisObject::Type::LIST);
+    for (int64_t i = 0; i < size; ++i) {
+        ro.r_push("value");
+    }
+    return ro;
+}
+
+// a push followed by a pop on the given end, the list keeps its size
+template <bool Left>
+void BM_ListPushPop(benchmark::State& state) {
+    auto ro = list_of_size(state.range(0));
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        if (Left) {
+            ro.l_push("value");
+            benchmark::DoNotOptimize(ro.l_pop());
+        } else {
+            ro.r_push("value");
+            benchmark::DoNotOptimize(ro.r_pop());
+        }
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_ListPushPop, true)->RangeMultiplier(10)->Range(10, 100000);
+BENCHMARK_TEMPLATE(BM_ListPushPop, false)->RangeMultiplier(10)->Range(10, 100000);
+
+// SINTER of two sets of range(0) members sharing range(1) percent of them
+void BM_SetInter(benchmark::State& state) {
+    const int64_t size = state.range(0);
+    const int64_t shared = size * state.range(1) / 100;
+    RedisObject a(RedisObject::Type::SET), b(RedisObject::Type::SET);
+    for (int64_t i = 0; i < size; ++i) {
+        a.s_add(member_name(i));
+        b.s_add(member_name(i < shared ? i : size + i));
+    }
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(a.s_inter(b));
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_SetInter)->ArgsProduct({{1000, 100000}, {0, 10, 50, 100}});
+
+// HSET (through h_set_n_x, as the HSET command does) then HGET and HINCRBY on a hash of range(0) fields
+void BM_HashFieldOps(benchmark::State& state) {
+    RedisObject ro(RedisObject::Type::HASH);
+    std::vector<std::string> fields;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        fields.push_back("field:" + std::to_string(i));
+        ro.h_set_n_x(fields.back(), "1");
+    }
+    size_t next = 0;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        const auto& field = fields[next];
+        benchmark::DoNotOptimize(ro.h_set_n_x(field, "1"));
+        benchmark::DoNotOptimize(ro.h_get(field));
+        benchmark::DoNotOptimize(ro.h_incr_by(field, 1));
+        next = (next + 1) % fields.size();
+    }
+}
+
+BENCHMARK(BM_HashFieldOps)->RangeMultiplier(100)->Range(10, 100000);
+
+// RedisString construction, which parses the text to pick the encoding
+void BM_StringParse(benchmark::State& state, const char* text) {
+    const std::string value = text;
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(RedisString(value));
+    }
+}
+
+BENCHMARK_CAPTURE(BM_StringParse, int, "1234567");
+BENCHMARK_CAPTURE(BM_StringParse, double, "3.14159");
+BENCHMARK_CAPTURE(BM_StringParse, text, "hello world");
+
+void BM_Incr(benchmark::State& state) {
+    RedisObject ro(RedisObject::Type::STRING);
+    ro.set("0");
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ro.incr());
+    }
+}
+
+BENCHMARK(BM_Incr);
+
+// SET then INCR, the value is parsed every time as for a client setting a counter
+void BM_SetIncr(benchmark::State& state) {
+    RedisObject ro(RedisObject::Type::STRING);
+    AllocationCounter counter(state);
+    for (auto _ : state) {
+        ro.set("41");
+        benchmark::DoNotOptimize(ro.incr());
+    }
+}
+
+BENCHMARK(BM_SetIncr);
+
+} // namespace
+
+namespace {
+
+// every replaced operator new allocates here and every operator delete frees here, so that the
+// allocations are counted whatever form of new made them and each pointer goes back to the
+// allocator it came from
+void* allocate(const std::size_t size, const std::size_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size ? size : 1);
+    } else if (posix_memalign(&p, alignment, size ? size : 1) != 0) {
+        p = nullptr;
+    }
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void deallocate(void* p) noexcept {
+    std::free(p);
+}
+
+} // namespace
+
+void* operator new(const std::size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new[](const std::size_t size) {
+    return allocate(size, alignof(std::max_align_t));
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment) {
+    return allocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void* p) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    deallocate(p);
+}
+
+BENCHMARK_MAIN();
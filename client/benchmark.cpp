@@ -0,0 +1,346 @@
+#include "hdr_histogram.h"
+
+#include <algorithm>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+
+// Load generator: N non-blocking connections driven by one epoll loop, each keeping up to
+// P commands in flight, drawn from a weighted mix. Every command's latency, from the moment it
+// is queued to the moment its last reply line arrives, goes into an HDR histogram.
+//
+//   benchmark -clients 50 -requests 100000 -pipeline 16 -keyspace 10000 -datasize 3 [-socket path]
+//             -mix get=3,set=1,incr=1,lpush=1,sadd=1,zadd=1,hgetall=1 -hash-fields 10
+//
+// Replies are not framed, so a command is complete after the number of lines it is known to
+// produce: one for all of them except HGETALL, whose hashes are filled with exactly
+// hash-fields fields before the run.
+
+std::string host = "127.0.0.1";
+int port = 6379;
+std::string socket_path; // connects to this Unix socket instead of host:port when set
+int clients = 50;
+long requests = 100000;
+int pipeline = 1;
+int keyspace = 10000;
+int datasize = 3;
+int hash_fields = 10;
+std::string mix = "get=1,set=1";
+
+enum Op { GET, SET, INCR, LPUSH, SADD, ZADD, HGETALL, OP_COUNT };
+const char* const op_names[OP_COUNT] = {"get", "set", "incr", "lpush", "sadd", "zadd", "hgetall"};
+
+struct Pending {
+    Op op;
+    int lines; // reply lines still expected
+    uint64_t start_ns;
+};
+
+struct Connection {
+    int fd = -1;
+    std::string out;
+    size_t out_offset = 0;
+    std::deque<Pending> pending;
+    bool want_write = false;
+};
+
+uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void parse_args(const int argc, char* argv[]) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (std::string arg = argv[i]; arg == "-host") {
+            host = argv[++i];
+        } else if (arg == "-port") {
+            port = std::stoi(argv[++i]);
+        } else if (arg == "-socket") {
+            socket_path = argv[++i];
+        } else if (arg == "-clients") {
+            clients = std::stoi(argv[++i]);
+        } else if (arg == "-requests") {
+            requests = std::stol(argv[++i]);
+        } else if (arg == "-pipeline") {
+            pipeline = std::stoi(argv[++i]);
+        } else if (arg == "-keyspace") {
+            keyspace = std::stoi(argv[++i]);
+        } else if (arg == "-datasize") {
+            datasize = std::stoi(argv[++i]);
+        } else if (arg == "-hash-fields") {
+            hash_fields = std::stoi(argv[++i]);
+        } else if (arg == "-mix") {
+            mix = argv[++i];
+        }
+    }
+}
+
+// "get=3,set=1" -> cumulative weights indexed by Op
+bool parse_mix(const std::string& spec, std::vector<int>& cumulative) {
+    std::vector<int> weights(OP_COUNT, 0);
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        const std::string item = spec.substr(start, end - start);
+        const size_t eq = item.find('=');
+        const std::string name = item.substr(0, eq);
+        int weight = 1;
+        if (eq != std::string::npos) {
+            try {
+                weight = std::stoi(item.substr(eq + 1));
+            } catch (...) {
+                return false;
+            }
+        }
+        int op = 0;
+        while (op < OP_COUNT && name != op_names[op]) ++op;
+        if (op == OP_COUNT || weight < 0) return false;
+        weights[op] += weight;
+        start = end + 1;
+    }
+    cumulative.assign(OP_COUNT, 0);
+    int sum = 0;
+    for (int op = 0; op < OP_COUNT; ++op) {
+        sum += weights[op];
+        cumulative[op] = sum;
+    }
+    return sum > 0;
+}
+
+int connect_to_server() {
+    if (!socket_path.empty()) {
+        const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (sock < 0) return -1;
+        sockaddr_un addr {};
+        addr.sun_family = AF_UNIX;
+        socket_path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+        if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(sock);
+            return -1;
+        }
+        return sock;
+    }
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) <= 0 ||
+        connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    constexpr int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return sock;
+}
+
+// sends commands on a blocking socket, a few thousand at a time, and waits for one line each
+bool run_setup(const int sock, const std::vector<std::string>& commands) {
+    constexpr size_t CHUNK = 4096;
+    char buffer[65536];
+    for (size_t i = 0; i < commands.size(); i += CHUNK) {
+        std::string out;
+        const size_t n = std::min(CHUNK, commands.size() - i);
+        for (size_t j = 0; j < n; ++j) {
+            out += commands[i + j];
+        }
+        for (size_t sent = 0; sent < out.size();) {
+            const ssize_t k = send(sock, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (k <= 0) return false;
+            sent += k;
+        }
+        for (size_t lines = 0; lines < n;) {
+            const ssize_t k = read(sock, buffer, sizeof(buffer));
+            if (k <= 0) return false;
+            lines += std::count(buffer, buffer + k, '\n');
+        }
+    }
+    return true;
+}
+
+int main(const int argc, char* argv[]) {
+    parse_args(argc, argv);
+    std::vector<int> cumulative;
+    if (!parse_mix(mix, cumulative)) {
+        std::cerr << "Invalid mix: " << mix << "\n";
+        return 1;
+    }
+    if (clients < 1 || requests < 1 || pipeline < 1 || keyspace < 1 || datasize < 1 || hash_fields < 0) {
+        std::cerr << "clients, requests, pipeline, keyspace and datasize should be positive\n";
+        return 1;
+    }
+    const auto weight = [&](const Op op) { return cumulative[op] - (op == 0 ? 0 : cumulative[op - 1]); };
+    const std::string value(datasize, 'x');
+
+    std::vector<Connection> connections(clients);
+    for (auto& connection : connections) {
+        connection.fd = connect_to_server();
+        if (connection.fd < 0) {
+            std::cerr << "Connection failed to " << (socket_path.empty() ? host + ":" + std::to_string(port) : socket_path) << "\n";
+            return 1;
+        }
+    }
+
+    // counters must hold integers and hashes a known number of fields
+    std::vector<std::string> setup;
+    for (int i = 0; i < keyspace; ++i) {
+        const std::string n = std::to_string(i);
+        if (weight(INCR)) setup.push_back("SET counter:" + n + " 0\n");
+        if (weight(HGETALL)) {
+            setup.push_back("DEL hash:" + n + "\n");
+            for (int f = 0; f < hash_fields; ++f) {
+                setup.push_back("HSET hash:" + n + " field" + std::to_string(f) + " " + value + "\n");
+            }
+        }
+    }
+    if (!run_setup(connections[0].fd, setup)) {
+        std::cerr << "Setup failed\n";
+        return 1;
+    }
+
+    const int epoll_fd = epoll_create1(0);
+    for (auto& connection : connections) {
+        fcntl(connection.fd, F_SETFL, O_NONBLOCK);
+        epoll_event ev { EPOLLIN, { .u64 = static_cast<uint64_t>(&connection - connections.data()) } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.fd, &ev);
+    }
+
+    std::mt19937_64 rng(std::random_device {}());
+    std::uniform_int_distribution<int> pick_op(1, cumulative.back());
+    std::uniform_int_distribution<int> pick_key(0, keyspace - 1);
+    HdrHistogram all;
+    std::vector<HdrHistogram> per_op(OP_COUNT);
+    long issued = 0, completed = 0;
+
+    const auto flush = [&](Connection& connection) {
+        while (connection.out_offset < connection.out.size()) {
+            const ssize_t n = send(connection.fd, connection.out.data() + connection.out_offset,
+                                   connection.out.size() - connection.out_offset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+                break;
+            }
+            connection.out_offset += n;
+        }
+        if (connection.out_offset == connection.out.size()) {
+            connection.out.clear();
+            connection.out_offset = 0;
+        }
+        // wait for EPOLLOUT only while something is left to send
+        if (const bool want = !connection.out.empty(); want != connection.want_write) {
+            connection.want_write = want;
+            epoll_event ev { want ? EPOLLIN | EPOLLOUT : EPOLLIN,
+                             { .u64 = static_cast<uint64_t>(&connection - connections.data()) } };
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.fd, &ev);
+        }
+        return true;
+    };
+
+    // tops the connection up to pipeline commands in flight
+    const auto refill = [&](Connection& connection) {
+        const uint64_t start = now_ns();
+        while (issued < requests && connection.pending.size() < static_cast<size_t>(pipeline)) {
+            const int r = pick_op(rng);
+            Op op = GET;
+            while (cumulative[op] < r) op = static_cast<Op>(op + 1);
+            const std::string key = std::to_string(pick_key(rng));
+            int lines = 1;
+            switch (op) {
+                case GET: connection.out += "GET key:" + key + "\n"; break;
+                case SET: connection.out += "SET key:" + key + " " + value + "\n"; break;
+                case INCR: connection.out += "INCR counter:" + key + "\n"; break;
+                case LPUSH: connection.out += "LPUSH list:" + key + " " + value + "\n"; break;
+                case SADD: connection.out += "SADD set:" + key + " member:" + std::to_string(pick_key(rng)) + "\n"; break;
+                case ZADD:
+                    connection.out += "ZADD zset:" + key + " " + std::to_string(pick_key(rng)) +
+                                      " member:" + std::to_string(pick_key(rng)) + "\n";
+                    break;
+                case HGETALL:
+                    connection.out += "HGETALL hash:" + key + "\n";
+                    lines = std::max(hash_fields, 1); // an empty hash is (nil)
+                    break;
+                default: break;
+            }
+            connection.pending.push_back({op, lines, start});
+            ++issued;
+        }
+        return flush(connection);
+    };
+
+    const uint64_t begin = now_ns();
+    for (auto& connection : connections) {
+        if (!refill(connection)) {
+            std::cerr << "Write error\n";
+            return 1;
+        }
+    }
+    epoll_event events[1024];
+    char buffer[65536];
+    while (completed < requests) {
+        const int nfds = epoll_wait(epoll_fd, events, 1024, 1000);
+        for (int i = 0; i < nfds; ++i) {
+            auto& connection = connections[events[i].data.u64];
+            if (events[i].events & EPOLLOUT && !flush(connection)) {
+                std::cerr << "Write error\n";
+                return 1;
+            }
+            if (!(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) continue;
+            const ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                std::cerr << "Connection closed by server\n";
+                return 1;
+            }
+            if (n < 0) continue;
+            const uint64_t now = now_ns();
+            for (ssize_t j = 0; j < n; ++j) {
+                if (buffer[j] != '\n' || connection.pending.empty()) continue;
+                auto& front = connection.pending.front();
+                if (--front.lines > 0) continue;
+                all.record(now - front.start_ns);
+                per_op[front.op].record(now - front.start_ns);
+                connection.pending.pop_front();
+                ++completed;
+            }
+            if (!refill(connection)) {
+                std::cerr << "Write error\n";
+                return 1;
+            }
+        }
+    }
+    const double seconds = static_cast<double>(now_ns() - begin) / 1e9;
+
+    const auto ms = [](const uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    const auto print_latency = [&](const HdrHistogram& h) {
+        std::printf("p50 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n", ms(h.percentile(50)), ms(h.percentile(99)),
+                    ms(h.percentile(99.9)), ms(h.max()));
+    };
+    std::printf("%ld requests, %d connections, pipeline %d, keyspace %d, %d byte values\n",
+                requests, clients, pipeline, keyspace, datasize);
+    std::printf("%.3f seconds, %.2f requests per second\n", seconds, static_cast<double>(requests) / seconds);
+    std::printf("latency (ms)  ");
+    print_latency(all);
+    for (int op = 0; op < OP_COUNT; ++op) {
+        if (per_op[op].total() == 0) continue;
+        std::printf("  %-8s %9llu  ", op_names[op], static_cast<unsigned long long>(per_op[op].total()));
+        print_latency(per_op[op]);
+    }
+    for (const auto& connection : connections) {
+        close(connection.fd);
+    }
+    close(epoll_fd);
+    return 0;
+}
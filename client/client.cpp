@@ -3,23 +3,242 @@
 #include <unistd.h>
 #include <cstring>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <chrono>
+#include <map>
+#include <thread>
+#include <vector>
 
 std::string host = "127.0.0.1";
 int port = 6379;
+std::string socket_path; // connects to this Unix socket instead of host:port when set
+enum class Mode { SESSION, BIGKEYS, MEMKEYS } mode = Mode::SESSION;
+double interval = 0; // seconds to sleep between SCAN calls in the bigkeys and memkeys modes
 
 void parse_args(const int argc, char* argv[]) {
-    for (int i = 1; i < argc - 1; ++i) {
-        if (std::string arg = argv[i]; arg == "-host") {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "-bigkeys" || arg == "--bigkeys") {
+            mode = Mode::BIGKEYS;
+        } else if (arg == "-memkeys" || arg == "--memkeys") {
+            mode = Mode::MEMKEYS;
+        } else if (i + 1 == argc) {
+            break;
+        } else if (arg == "-host") {
             host = argv[++i];
         } else if (arg == "-port") {
             port = std::stoi(argv[++i]);
+        } else if (arg == "-socket") {
+            socket_path = argv[++i];
+        } else if (arg == "-i") {
+            interval = std::stod(argv[++i]);
+        }
+    }
+}
+
+// forwards stdin line by line and prints what comes back
+int session(const int sock) {
+    std::string line;
+    char buffer[1024];
+    while (std::getline(std::cin, line)) {
+        line += '\n';
+        send(sock, line.c_str(), line.size(), 0);
+        if (const int n = read(sock, buffer, sizeof(buffer) - 1); n > 0) {
+            buffer[n] = '\0';
+            std::cout << buffer;
+        } else if (n == 0) {
+            std::cout << "Connection closed by server\n";
+            break;
+        } else {
+            std::cerr << "Read error\n";
+            break;
+        }
+    }
+    close(sock);
+    return 0;
+}
+
+// Replies end with a newline but are not framed otherwise: a multi-line reply is followed by a
+// command whose reply can not be taken for one of its lines
+class Connection {
+public:
+    explicit Connection(const int sock) : sock(sock) {}
+
+    bool send_all(const std::string& data) const {
+        for (size_t sent = 0; sent < data.size();) {
+            const ssize_t n = send(sock, data.data() + sent, data.size() - sent, 0);
+            if (n <= 0) return false;
+            sent += n;
+        }
+        return true;
+    }
+
+    bool read_line(std::string& line) {
+        while (true) {
+            if (const size_t end = buffer.find('\n', start); end != std::string::npos) {
+                line = buffer.substr(start, end - start);
+                start = end + 1;
+                return true;
+            }
+            buffer.erase(0, start);
+            start = 0;
+            char chunk[16 * 1024];
+            const ssize_t n = read(sock, chunk, sizeof(chunk));
+            if (n <= 0) return false;
+            buffer.append(chunk, n);
+        }
+    }
+
+private:
+    int sock;
+    std::string buffer;
+    size_t start = 0;
+};
+
+std::string quote(const std::string& token) {
+    std::string quoted = "\"";
+    for (const char c : token) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// "3) item" -> "item", false for a line that is not an array item
+bool array_item(const std::string& line, std::string& item) {
+    size_t i = 0;
+    while (i < line.size() && isdigit(static_cast<unsigned char>(line[i]))) ++i;
+    if (i == 0 || line.compare(i, 2, ") ") != 0) return false;
+    item = line.substr(i + 2);
+    return true;
+}
+
+// Walks the keyspace with SCAN, a batch of keys at a time with TYPE then their length (bigkeys)
+// or MEMORY USAGE (memkeys) pipelined, and reports the largest key of every type. The server only
+// ever runs short commands, so other clients are served in between; -i adds a pause per batch.
+int scan_keys(const int sock) {
+    static const std::map<std::string, std::pair<const char*, const char*>> length_commands = {
+        {"string", {"STRLEN", "bytes"}}, {"list", {"LLEN", "items"}}, {"set", {"SCARD", "members"}},
+        {"hash", {"HLEN", "fields"}}, {"zset", {"ZCARD", "members"}}, {"stream", {"XLEN", "entries"}},
+        {"hyperloglog", {"PFCOUNT", "estimated elements"}},
+    };
+    struct TypeStats {
+        size_t keys = 0;
+        unsigned long long total = 0;
+        std::string biggest;
+        unsigned long long biggest_size = 0;
+    };
+    std::map<std::string, TypeStats> stats;
+    Connection conn(sock);
+    size_t scanned = 0;
+    std::string cursor = "0";
+    do {
+        // EXISTS replies 0 or 1, ending the SCAN reply
+        if (!conn.send_all("SCAN " + cursor + " COUNT 100\nEXISTS .\n")) break;
+        std::vector<std::string> keys;
+        std::string line, item;
+        bool first = true;
+        while (conn.read_line(line) && array_item(line, item)) {
+            if (first) {
+                cursor = item;
+                first = false;
+            } else {
+                keys.push_back(item);
+            }
+        }
+        if (first) {
+            std::cerr << "SCAN failed: " << line << "\n";
+            close(sock);
+            return 1;
+        }
+
+        std::string pipeline;
+        for (const auto& key : keys) pipeline += "TYPE " + quote(key) + "\n";
+        conn.send_all(pipeline);
+        std::vector<std::string> types(keys.size());
+        for (auto& type : types) conn.read_line(type);
+        pipeline.clear();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            const auto it = length_commands.find(types[i]);
+            if (mode == Mode::MEMKEYS) {
+                pipeline += "MEMORY USAGE " + quote(keys[i]) + "\n";
+            } else if (it != length_commands.end()) {
+                pipeline += std::string(it->second.first) + " " + quote(keys[i]) + "\n";
+            } else {
+                pipeline += "EXISTS .\n"; // deleted meanwhile, a placeholder keeps the replies in step
+            }
+        }
+        conn.send_all(pipeline);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            conn.read_line(line);
+            unsigned long long size;
+            try {
+                size_t pos;
+                size = std::stoull(line, &pos);
+                if (pos != line.size() || !length_commands.count(types[i])) continue;
+            } catch (...) {
+                continue;
+            }
+            auto& type = stats[types[i]];
+            ++type.keys;
+            type.total += size;
+            if (type.biggest.empty() || size > type.biggest_size) {
+                type.biggest = keys[i];
+                type.biggest_size = size;
+            }
+            ++scanned;
         }
+        if (interval > 0) std::this_thread::sleep_for(std::chrono::duration<double>(interval));
+    } while (cursor != "0");
+    close(sock);
+
+    std::cout << "Scanned " << scanned << " keys\n\n";
+    for (const auto& [name, type] : stats) {
+        const char* unit = mode == Mode::MEMKEYS ? "bytes" : length_commands.at(name).second;
+        std::cout << "Biggest " << name << " found " << quote(type.biggest) << " has " << type.biggest_size << " "
+                  << unit << "\n";
+    }
+    std::cout << "\n";
+    for (const auto& [name, type] : stats) {
+        const char* unit = mode == Mode::MEMKEYS ? "bytes" : length_commands.at(name).second;
+        std::cout << type.keys << " " << name << "s with " << type.total << " " << unit << " (avg "
+                  << (type.keys ? type.total / type.keys : 0) << ")\n";
     }
+    return 0;
+}
+
+// forwards stdin, or scans the keys in the bigkeys and memkeys modes
+int run(const int sock) {
+    return mode == Mode::SESSION ? session(sock) : scan_keys(sock);
+}
+
+// connects to the Unix socket at path, -1 on failure
+int connect_unix(const std::string& path) {
+    const int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    if (connect(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
 }
 
 int main(const int argc, char* argv[]) {
     parse_args(argc, argv);
 
+    if (!socket_path.empty()) {
+        const int sock = connect_unix(socket_path);
+        if (sock < 0) {
+            std::cerr << "Connection failed to " << socket_path << "\n";
+            return 1;
+        }
+        std::cout << "Connected to " << socket_path << "\n";
+        return run(sock);
+    }
+
     // Create a socket using IPv4 (AF_INET) and TCP (SOCK_STREAM)
     const int sock = socket(AF_INET, SOCK_STREAM, 0);
     if (sock < 0) {
@@ -43,23 +262,5 @@ int main(const int argc, char* argv[]) {
     }
 
     std::cout << "Connected to " << host << ":" << port << "\n";
-
-    std::string line;
-    char buffer[1024];
-    while (std::getline(std::cin, line)) {
-        line += '\n';
-        send(sock, line.c_str(), line.size(), 0);
-        if (const int n = read(sock, buffer, sizeof(buffer) - 1); n > 0) {
-            buffer[n] = '\0';
-            std::cout << buffer;
-        } else if (n == 0) {
-            std::cout << "Connection closed by server\n";
-            break;
-        } else {
-            std::cerr << "Read error\n";
-            break;
-        }
-    }
-    close(sock);
-    return 0;
+    return run(sock);
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include <random>
@@ -15,6 +16,24 @@ struct SkipListNode {
          : member(std::move(m)), score(s), forward(level, nullptr), span(level, 0) {}
 };
 
+// One end of a lexicographic range: "-" and "+" are below and above every member, otherwise a
+// member, inclusive or exclusive. Lex ranges assume all members have the same score, as ties are
+// ordered by member
+struct LexBound {
+    enum Kind { MIN, MAX, MEMBER } kind = MEMBER;
+    std::string member;
+    bool exclusive = false;
+
+    bool below(const std::string& m) const { // m is after this bound as a minimum
+        if (kind != MEMBER) return kind == MIN;
+        return exclusive ? m > member : m >= member;
+    }
+    bool above(const std::string& m) const { // m is before this bound as a maximum
+        if (kind != MEMBER) return kind == MAX;
+        return exclusive ? m < member : m <= member;
+    }
+};
+
 class SkipList {
     static constexpr int MAX_LEVEL = 16;
     static constexpr double P = 0.5;
@@ -32,6 +51,26 @@ public:
         }
     }
 
+    SkipList(const SkipList&) = delete;
+    SkipList& operator=(const SkipList&) = delete;
+
+    // the moved-from list is left without nodes and may only be destroyed or assigned to
+    SkipList(SkipList&& other) noexcept
+        : head(other.head), level(other.level), rng(std::move(other.rng)), dist(other.dist) {
+        other.head = nullptr;
+        other.level = 1;
+    }
+
+    SkipList& operator=(SkipList&& other) noexcept {
+        if (this != &other) {
+            std::swap(head, other.head);
+            std::swap(level, other.level);
+            std::swap(rng, other.rng);
+            std::swap(dist, other.dist);
+        }
+        return *this;
+    }
+
     ~SkipList() {
         const SkipListNode* node = head;
         while (node) {
@@ -91,6 +130,29 @@ public:
         }
     }
 
+    // Build an empty list from (member, score) pairs already sorted by score then member, in O(n):
+    // every node is appended after the last node of each of its levels
+    void bulkLoad(const std::vector<std::pair<std::string, double>>& sorted) {
+        std::vector<SkipListNode*> last(MAX_LEVEL, head);
+        std::vector rank(MAX_LEVEL, 0); // rank of last[i], head is 0
+        int n = 0;
+        for (const auto& [member, score] : sorted) {
+            const int lvl = randomLevel();
+            auto* x = new SkipListNode(lvl, member, score);
+            ++n;
+            for (int i = 0; i < lvl; ++i) {
+                last[i]->forward[i] = x;
+                last[i]->span[i] = n - rank[i];
+                last[i] = x;
+                rank[i] = n;
+            }
+            if (lvl > level) level = lvl;
+        }
+        for (int i = 0; i < MAX_LEVEL; ++i) {
+            last[i]->span[i] = n - rank[i];
+        }
+    }
+
     bool erase(const std::string& member, const double score) {
         std::vector<SkipListNode*> update(MAX_LEVEL, nullptr);
         SkipListNode* x = head;
@@ -140,6 +202,15 @@ public:
         return -1;
     }
 
+    // the head, then the first limit nodes (every node when limit is 0), for memory accounting
+    template <typename Fn>
+    void forEachNode(size_t limit, Fn fn) const {
+        fn(*head);
+        for (const SkipListNode* x = head->forward[0]; x && (limit == 0 || limit-- > 0); x = x->forward[0]) {
+            fn(*x);
+        }
+    }
+
     // Return list of members in range [start, end] (inclusive, 0-based)
     std::vector<std::string> range(const int start, const int end) const {
         std::vector<std::string> result;
@@ -166,6 +237,88 @@ public:
         return result;
     }
 
+    // number of nodes before the first member within min
+    int lexRankBegin(const LexBound& min) const {
+        int rank = 0;
+        const SkipListNode* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->forward[i] && !min.below(x->forward[i]->member)) {
+                rank += x->span[i];
+                x = x->forward[i];
+            }
+        }
+        return rank;
+    }
+
+    // number of nodes up to the last member within max
+    int lexRankEnd(const LexBound& max) const {
+        int rank = 0;
+        const SkipListNode* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->forward[i] && max.above(x->forward[i]->member)) {
+                rank += x->span[i];
+                x = x->forward[i];
+            }
+        }
+        return rank;
+    }
+
+    int lexCount(const LexBound& min, const LexBound& max) const {
+        return std::max(0, lexRankEnd(max) - lexRankBegin(min));
+    }
+
+    // Members between min and max, skipping offset of them and returning at most count (negative:
+    // no limit), from the largest if reverse. The window is located by rank so that only the
+    // returned members are visited
+    std::vector<std::string> rangeByLex(const LexBound& min, const LexBound& max, const int offset, const int count,
+                                        const bool reverse) const {
+        const int begin = lexRankBegin(min);
+        const int end = lexRankEnd(max);
+        if (offset < 0 || begin >= end - offset || count == 0) return {};
+        if (!reverse) {
+            const int last = count < 0 || end - begin - offset <= count ? end - 1 : begin + offset + count - 1;
+            return range(begin + offset, last);
+        }
+        const int first = count < 0 || end - begin - offset <= count ? begin : end - offset - count;
+        auto result = range(first, end - offset - 1);
+        std::reverse(result.begin(), result.end());
+        return result;
+    }
+
+    // Unlinks every member between min and max in one pass, returns them
+    std::vector<std::string> eraseRangeByLex(const LexBound& min, const LexBound& max) {
+        std::vector<std::string> removed;
+        std::vector<SkipListNode*> update(MAX_LEVEL, nullptr);
+        SkipListNode* x = head;
+        for (int i = level - 1; i >= 0; --i) {
+            while (x->forward[i] && !min.below(x->forward[i]->member)) {
+                x = x->forward[i];
+            }
+            update[i] = x;
+        }
+
+        x = x->forward[0];
+        while (x && max.above(x->member)) {
+            SkipListNode* next = x->forward[0];
+            for (int i = 0; i < level; ++i) {
+                if (update[i]->forward[i] == x) {
+                    update[i]->span[i] += x->span[i] - 1;
+                    update[i]->forward[i] = x->forward[i];
+                } else {
+                    update[i]->span[i]--;
+                }
+            }
+            removed.push_back(std::move(x->member));
+            delete x;
+            x = next;
+        }
+
+        while (level > 1 && head->forward[level - 1] == nullptr) {
+            --level;
+        }
+        return removed;
+    }
+
     std::vector<std::string> rangeByScore(const double min, const bool minExclusive, const double max, const bool maxExclusive) const {
         std::vector<std::string> result;
         const SkipListNode* x = head;
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bit operations on the bytes of a string, bit 0 being the most significant bit of the first
+// byte as in Redis. Counting picks its implementation once from the CPU: an AVX2 nibble lookup
+// summed with vpsadbw, 64-bit POPCNT, or the portable popcount; the other operations go through
+// 64-bit words, so multi-megabyte bitmaps are processed at close to memory bandwidth.
+
+enum class BitOp { AND, OR, XOR, NOT };
+
+uint64_t bitmap_count(const unsigned char* p, size_t n);
+
+// index of the first bit equal to bit in the n bytes at p, -1 if there is none
+int64_t bitmap_position(const unsigned char* p, size_t n, int bit);
+
+// op of the sources, the shorter ones padded with zero bytes; NOT takes a single source
+std::string bitmap_op(BitOp op, const std::vector<const std::string*>& sources);
+
+// BITFIELD subcommand on an integer of 1 to 64 bits (63 when unsigned) at any bit offset
+struct BitfieldOp {
+    enum class Kind { GET, SET, INCRBY };
+    enum class Overflow { WRAP, SAT, FAIL };
+
+    Kind kind;
+    Overflow overflow;
+    bool is_signed;
+    unsigned bits;
+    uint64_t offset;
+    int64_t value; // SET value, INCRBY increment
+};
+
+int64_t bitfield_get(const std::string& s, const BitfieldOp& op); // bits past the end read as 0
+
+// SET or INCRBY, growing s as needed; result is the old value for SET and the new one for
+// INCRBY, false when the value overflows under Overflow::FAIL, which leaves s unchanged
+bool bitfield_set(std::string& s, const BitfieldOp& op, int64_t& result);
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+// Per-connection state, owned by RedisServer and keyed by the client socket fd
+struct Client {
+    uint64_t id = 0;      // unique for the life of the server, CLIENT ID and CLIENT KILL ID
+    std::string addr;     // ip:port of the peer
+    std::string name;     // CLIENT SETNAME
+    uint64_t created_ms = 0;
+    uint64_t last_interaction_ms = 0; // last read or write, for the idle timeout
+    std::string last_command;
+    std::string buffer; // bytes received but not yet split into commands
+
+    // replies not yet accepted by the socket, buffers may be shared with other clients
+    std::deque<std::shared_ptr<const std::string>> reply_queue;
+    size_t reply_offset = 0;       // bytes of reply_queue.front() already sent
+    size_t reply_bytes = 0;        // bytes in reply_queue not sent yet
+    bool want_write = false;       // registered for EPOLLOUT
+    uint64_t soft_limit_since = 0; // when reply_bytes went over the soft limit, 0 if it is not
+    bool close_asap = false;       // scheduled to be closed at the end of the event loop iteration
+    bool close_after_reply = false; // closed once reply_queue is sent
+    bool http = false;             // connected to the metrics port
+    bool uring = false;            // reads and writes go through the io_uring backend
+    bool send_in_flight = false;   // io_uring: a send of reply_queue has not completed yet
+
+    // MULTI/EXEC
+    bool in_multi = false;
+    bool dirty_cas = false;  // a watched key has been modified, EXEC must fail
+    bool dirty_exec = false; // a command was rejected while queuing, EXEC must fail
+    std::vector<std::vector<std::string>> queued;
+    std::unordered_set<std::string> watched_keys;
+
+    // BLPOP/BRPOP/BLMOVE
+    bool blocked = false;
+    bool deny_blocking = false; // set while running EXEC or a script, blocking commands do not wait then
+    uint64_t block_id = 0;      // tells the current block apart from timers of earlier ones
+    std::vector<std::string> blocking_keys;
+    bool block_pop_left = true;
+    std::string block_target;   // BLMOVE destination, empty for BLPOP/BRPOP
+    bool block_push_left = true;
+
+    // Pub/Sub
+    std::unordered_set<std::string> channels;
+    std::unordered_set<std::string> patterns;
+
+    // CLIENT TRACKING
+    bool tracking = false;
+    bool tracking_bcast = false;
+    std::vector<std::string> tracking_prefixes;
+
+    // Replication
+    bool is_master = false;  // this server's connection to its primary
+    bool is_replica = false; // a replica of this server, only receives the replication stream
+
+    // Cluster
+    bool asking = false; // ASKING was sent, the next command may use a slot being imported
+};
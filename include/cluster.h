@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+constexpr int CLUSTER_SLOTS = 16384;
+
+// CRC16-CCITT (XMODEM), as used by Redis Cluster
+uint16_t crc16(const char* buf, size_t len);
+
+// only the part between the first { and the following } is hashed, if it is not empty,
+// so that related keys can be forced into the same slot
+int key_hash_slot(const std::string& key);
@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Static description of a command, used wherever a command must be reasoned about
+// without executing it (transactions, scripts, keyspace bookkeeping)
+struct CommandSpec {
+    enum Flag : unsigned {
+        WRITE = 1u << 0,     // may modify the keys it touches
+        NO_SCRIPT = 1u << 1, // can not be called from a script
+        NO_PROPAGATE = 1u << 2, // replicated by its handler as different commands
+        ASKING = 1u << 3,       // allowed on a slot being imported, as if ASKING was sent before
+        NO_TOUCH = 1u << 4,     // leaves the access statistics of its keys unchanged
+    };
+
+    const char* name;
+    int arity;     // exact number of tokens when positive, minimum number when negative
+    unsigned flags;
+    int first_key; // index of the first key token, 0 if the command takes no key
+    int last_key;  // index of the last key token, negative values count from the end
+    int step;
+    int keynum_index = 0; // when set, tokens[keynum_index] is the number of key tokens following it
+    int streams_index = 0; // when set, the keys are the first half of the tokens after the first
+                           // STREAMS found from tokens[streams_index] on
+
+    bool arity_ok(size_t token_count) const;
+};
+
+// returns nullptr for unknown commands, name must be upper case
+const CommandSpec* lookup_command(const std::string& name);
+
+// quotes a token so that it survives the command line tokenizer unchanged
+std::string quote_token(const std::string& token);
+
+// The protocol has no error type: handlers return their error replies through command_error, which
+// marks the command being executed as failed. take_command_error returns the mark and clears it.
+std::string command_error(std::string message);
+bool take_command_error();
+
+std::vector<std::string> command_keys(const CommandSpec& spec, const std::vector<std::string>& tokens);
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keyspace notification classes, selected by the letters of notify-keyspace-events
+enum NotifyFlag : unsigned {
+    NOTIFY_KEYSPACE = 1u << 0, // K: __keyspace@0__:<key> channels
+    NOTIFY_KEYEVENT = 1u << 1, // E: __keyevent@0__:<event> channels
+    NOTIFY_GENERIC = 1u << 2,  // g: del
+    NOTIFY_EXPIRED = 1u << 3,  // x: expired
+    NOTIFY_EVICTED = 1u << 4,  // e: evicted
+    NOTIFY_ALL = NOTIFY_GENERIC | NOTIFY_EXPIRED | NOTIFY_EVICTED, // A
+};
+
+// Clients are put in one of these classes for client-output-buffer-limit
+enum class ClientClass { NORMAL, REPLICA, PUBSUB };
+
+// A client whose unsent output passes hard bytes, or stays above soft bytes for soft_seconds, is
+// disconnected; 0 disables a limit
+struct OutputBufferLimit {
+    size_t hard = 0;
+    size_t soft = 0;
+    uint64_t soft_seconds = 0;
+};
+
+// Runtime parameters, readable and writable with CONFIG GET / CONFIG SET
+struct ServerConfig {
+    std::string notify_keyspace_events;
+    unsigned notify_flags = 0; // parsed from notify_keyspace_events
+    size_t tracking_table_max_keys = 1000000;
+    size_t repl_backlog_size = 1024 * 1024; // takes effect when the backlog is created
+    bool cluster_enabled = false;               // startup only
+    std::string cluster_announce_ip = "127.0.0.1"; // with the port, the name of this node in the cluster
+    size_t cluster_migration_batch = 100;       // keys in flight at once while migrating a slot
+    long long slowlog_log_slower_than = 10000;  // microseconds, negative disables the slow log
+    size_t slowlog_max_len = 128;
+    size_t latency_monitor_threshold = 0;       // milliseconds, 0 disables the latency monitor
+    int metrics_port = 0;                       // startup only, HTTP /metrics, 0 disables it
+    std::string io_backend = "epoll";           // startup only, epoll or io_uring
+    std::string bind = "0.0.0.0";               // startup only, IPv4 address of the TCP listener
+    int tcp_backlog = 511;                      // startup only, listen() backlog
+    std::string unixsocket;                     // startup only, path of a Unix socket listener, empty for none
+    unsigned unixsocketperm = 0;                // startup only, permissions of the Unix socket, 0 keeps the umask's
+    bool tcp_nodelay = true;                    // disable Nagle's algorithm on client connections
+    size_t tcp_keepalive = 300;                 // seconds of silence before keepalive probes, 0 disables them
+    size_t socket_rcvbuf = 0;                   // startup only, SO_RCVBUF of accepted sockets, 0 keeps the system default
+    size_t socket_sndbuf = 0;                   // startup only, SO_SNDBUF of accepted sockets, 0 keeps the system default
+    size_t maxclients = 10000;                  // further connections are refused
+    size_t timeout = 0;                         // seconds a client may stay idle, 0 disables it
+    bool key_index = false;                     // startup only, keep key names in a radix tree for prefix queries
+    size_t worker_threads = 0;                  // startup only, threads running large set operations, 0 runs them inline
+    size_t worker_min_elements = 100000;        // input members for a set operation to run on the workers
+    size_t lfu_log_factor = 10;                 // how slowly the access counter of OBJECT FREQ grows
+    size_t lfu_decay_time = 1;                  // minutes for the access counter to drop by one, 0 never
+    size_t hotkeys_decay_time = 60;             // seconds between two halvings of the HOTKEYS counts, 0 never
+    size_t client_query_buffer_limit = 1024 * 1024 * 1024; // bytes of a command line not received entirely
+    OutputBufferLimit client_output_buffer_limit[3] = {  // by ClientClass
+        {0, 0, 0},
+        {256 * 1024 * 1024, 64 * 1024 * 1024, 60},
+        {32 * 1024 * 1024, 8 * 1024 * 1024, 60},
+    };
+
+    // returns an error message, or an empty string on success; startup parameters can only be set
+    // from the command line
+    std::string set(const std::string& name, const std::string& value, bool startup = false);
+
+    // returns false for unknown parameters
+    bool get(const std::string& name, std::string& value) const;
+
+    std::vector<std::string> names() const;
+};
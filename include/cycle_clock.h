@@ -0,0 +1,47 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Timestamps cheap enough to take around every command: the TSC on x86, which ticks at a
+// constant rate on any recent CPU, steady_clock elsewhere. calibrate() measures the tick rate
+// once so that tick differences can be turned into nanoseconds.
+class CycleClock {
+public:
+    static uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return steady_ns();
+#endif
+    }
+
+    // spins for about 10ms, call once at startup
+    static void calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+        const uint64_t ns = steady_ns(), ticks = now();
+        while (steady_ns() - ns < 10'000'000) {}
+        ns_per_tick = static_cast<double>(steady_ns() - ns) / static_cast<double>(now() - ticks);
+#endif
+    }
+
+    static uint64_t to_ns(const uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * ns_per_tick);
+    }
+
+private:
+    static uint64_t steady_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static inline double ns_per_tick = 1.0;
+};
+
+// steady_clock in milliseconds, for timeouts, idle times and the other coarse timestamps
+inline uint64_t now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Geohashes as Redis computes them: the longitude and the latitude (within the limits of Web
+// Mercator) each cut into 2^26 steps, their bits interleaved into a 52-bit integer that a double
+// holds exactly, so that points stored in a ZSet with it as score are ordered cell by cell. Any
+// cell of a coarser step is then one contiguous score range, and a search only scans the ranges
+// of the nine cells around its center at the step where they cover the searched area.
+
+constexpr int GEO_STEP_MAX = 26;
+constexpr double GEO_LONGITUDE_MIN = -180;
+constexpr double GEO_LONGITUDE_MAX = 180;
+constexpr double GEO_LATITUDE_MIN = -85.05112878;
+constexpr double GEO_LATITUDE_MAX = 85.05112878;
+
+uint64_t geohash_encode(double longitude, double latitude); // at GEO_STEP_MAX
+void geohash_decode(uint64_t hash, double& longitude, double& latitude); // center of the cell
+
+// great circle distance in meters
+double geo_distance(double longitude1, double latitude1, double longitude2, double latitude2);
+
+// [min, max) score ranges covering every point within a box of width by height meters (a radius
+// is the box around its circle) centered on longitude, latitude
+std::vector<std::pair<uint64_t, uint64_t>> geohash_ranges(double longitude, double latitude, double width, double height);
@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A set of glob patterns (*, ?, [abc], [^a-z], \x) compiled into a trie, so that matching a
+// subject against all patterns shares the work for common prefixes instead of running every
+// pattern separately.
+class GlobTrie {
+public:
+    GlobTrie();
+    ~GlobTrie();
+
+    void insert(const std::string& pattern);
+    void erase(const std::string& pattern);
+    bool empty() const;
+
+    // every pattern matching subject, each reported once
+    std::vector<const std::string*> match(const std::string& subject) const;
+
+private:
+    struct Node;
+
+    struct CharClass {
+        bool negated = false;
+        std::vector<std::pair<char, char>> ranges;
+        std::string source; // text between the brackets, identifies the class
+
+        bool contains(char c) const;
+    };
+
+    struct Node {
+        std::unordered_map<char, std::unique_ptr<Node>> literals;
+        std::unique_ptr<Node> any;  // ?
+        std::unique_ptr<Node> star; // *
+        std::vector<std::pair<CharClass, std::unique_ptr<Node>>> classes;
+        std::unique_ptr<std::string> pattern; // set when a pattern ends here
+
+        bool leaf() const;
+    };
+
+    // one compiled element of a pattern
+    struct Element {
+        enum class Kind { LITERAL, ANY, STAR, CLASS } kind;
+        char literal = 0;
+        CharClass cls;
+    };
+
+    static std::vector<Element> compile(const std::string& pattern);
+    static std::unique_ptr<Node>* child(Node& node, const Element& element);
+    static bool erase(Node& node, const std::vector<Element>& elements, size_t i);
+
+    std::unique_ptr<Node> root;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// High dynamic range histogram: values are counted in log-linear buckets, each power of two
+// split into 2^(SubBits - 1) linear steps, so any recorded value is reported within
+// 2^(1 - SubBits) of its true value whatever its magnitude. Recording is O(1) and the memory is
+// fixed, (64 + 2) * 2^(SubBits - 1) counters.
+template <int SubBits>
+class LogLinearHistogram {
+public:
+    LogLinearHistogram() : counts(SUB_BUCKETS + 64 * HALF) {}
+
+    void record(const uint64_t value) {
+        ++counts[index_of(value)];
+        ++total_;
+        max_ = std::max(max_, value);
+        min_ = std::min(min_, value);
+    }
+
+    void merge(const LogLinearHistogram& other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total_ += other.total_;
+        max_ = std::max(max_, other.max_);
+        min_ = std::min(min_, other.min_);
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        total_ = 0;
+        max_ = 0;
+        min_ = UINT64_MAX;
+    }
+
+    uint64_t total() const { return total_; }
+    uint64_t max() const { return max_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+
+    // the smallest value that percentile percent of the recorded values do not exceed
+    uint64_t percentile(const double percent) const {
+        if (total_ == 0) return 0;
+        const auto target = std::max<uint64_t>(1, static_cast<uint64_t>(percent / 100.0 * total_ + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= target) return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+    // calls f(bucket upper bound, count) for every non-empty bucket, in increasing order
+    template <typename F>
+    void for_each_bucket(F f) const {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (counts[i]) f(highest_equivalent(i), counts[i]);
+        }
+    }
+
+private:
+    static constexpr int SUB_BITS = SubBits;
+    static constexpr uint64_t SUB_BUCKETS = uint64_t(1) << SUB_BITS;
+    static constexpr uint64_t HALF = SUB_BUCKETS / 2;
+
+    static size_t index_of(const uint64_t value) {
+        if (value < SUB_BUCKETS) return value;
+        const int shift = 64 - __builtin_clzll(value) - SUB_BITS; // >= 1
+        return SUB_BUCKETS + (shift - 1) * HALF + ((value >> shift) - HALF);
+    }
+
+    static uint64_t highest_equivalent(const size_t index) {
+        if (index < SUB_BUCKETS) return index;
+        const int shift = static_cast<int>((index - SUB_BUCKETS) / HALF) + 1;
+        const uint64_t sub = (index - SUB_BUCKETS) % HALF + HALF;
+        return (sub << shift) + (uint64_t(1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total_ = 0;
+    uint64_t max_ = 0;
+    uint64_t min_ = UINT64_MAX;
+};
+
+using HdrHistogram = LogLinearHistogram<11>; // 3 significant decimal digits
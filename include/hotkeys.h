@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// The most accessed keys, in fixed memory: a Count-Min sketch estimates the reads and the writes
+// of any key, and a min-heap keeps the CAPACITY keys with the highest estimated total. The sketch
+// is updated conservatively (only the counters at the minimum grow), which keeps its
+// overestimate small; a key is compared with the root of the heap only, so an access costs DEPTH
+// counter updates and at most O(log CAPACITY) swaps. decay() halves every count, so that the
+// ranking follows the recent traffic.
+class HotKeys {
+public:
+    static constexpr size_t DEPTH = 4;
+    static constexpr size_t WIDTH = 4096;   // counters per row, a power of two
+    static constexpr size_t CAPACITY = 128; // keys ranked
+
+    struct Entry {
+        std::string key;
+        uint64_t reads;
+        uint64_t writes;
+        uint64_t total() const { return reads + writes; }
+    };
+
+    HotKeys();
+
+    void record(const std::string& key, bool write);
+    void decay();
+    void clear();
+
+    std::vector<Entry> top(size_t count) const; // hottest first
+    uint64_t accesses() const { return accesses_; } // since the start or the last clear
+
+private:
+    void sift_up(size_t i);
+    void sift_down(size_t i);
+    void swap_entries(size_t i, size_t j);
+
+    // adds one to the counters of a key in sketch, returns its new estimate
+    static uint32_t increment(std::vector<uint32_t>& sketch, const size_t (&columns)[DEPTH]);
+    static uint32_t estimate(const std::vector<uint32_t>& sketch, const size_t (&columns)[DEPTH]);
+
+    std::vector<uint32_t> reads;  // DEPTH rows of WIDTH counters each
+    std::vector<uint32_t> writes;
+    std::vector<Entry> heap; // coldest at the root
+    std::unordered_map<std::string, size_t> position; // key -> index in heap
+    uint64_t accesses_ = 0;
+};
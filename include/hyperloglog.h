@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HyperLogLog with 2^14 six-bit registers, standard error 0.81%. A new counter is sparse: runs
+// of equal registers, as Redis encodes them,
+//   00xxxxxx           xxxxxx + 1 zero registers (1..64)
+//   01xxxxxx yyyyyyyy  14 bit length + 1 zero registers (1..16384)
+//   1vvvvvxx           xx + 1 registers (1..4) of value vvvvv + 1 (1..32)
+// which takes a few bytes for small cardinalities; past SPARSE_MAX_BYTES, or when a register
+// needs more than 32, it is promoted for good to the dense 12 KB packed register array.
+// The estimate is cached until a register changes.
+class HyperLogLog {
+public:
+    static constexpr int P = 14;
+    static constexpr size_t REGISTERS = size_t(1) << P;
+    static constexpr size_t DENSE_BYTES = REGISTERS * 6 / 8;
+    static constexpr size_t SPARSE_MAX_BYTES = 3000;
+
+    // one byte per register, what PFMERGE and multi-key PFCOUNT combine counters in
+    using Registers = std::vector<uint8_t>;
+
+    HyperLogLog();
+
+    bool sparse() const { return sparse_; }
+    const std::string& bytes() const { return data; } // the encoded registers, for snapshots
+    static bool from_bytes(bool sparse, const std::string& bytes, HyperLogLog& out); // false if malformed
+
+    bool add(const std::string& element); // true if a register changed
+    uint64_t count() const;
+
+    // register-wise maximum of this counter into registers
+    void merge_into(Registers& registers) const;
+    // replaces the content with registers, dense
+    void assign(const Registers& registers);
+    static uint64_t estimate(const Registers& registers);
+
+private:
+    bool set_register(size_t index, uint8_t value); // raises the register to value, true if it changed
+    bool sparse_set(size_t index, uint8_t value);
+    void promote();
+
+    std::string data; // sparse opcodes, or DENSE_BYTES of packed registers
+    bool sparse_ = true;
+    mutable uint64_t cached_count = 0;
+    mutable bool cache_valid = true; // an empty counter counts 0
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper over the raw system calls: the submission and completion rings, and
+// one provided buffer ring that multishot receives pick their buffers from. Entries prepared
+// with get_sqe() are only handed to the kernel by the next wait(), so every request of an event
+// loop iteration is submitted with the same system call that waits for the next completions.
+class IoUring {
+public:
+    IoUring() = default;
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+    ~IoUring();
+
+    // false if the kernel refuses, errno tells why
+    bool init(unsigned entries);
+    // whether the kernel implements every opcode, from IORING_REGISTER_PROBE
+    bool supports(std::initializer_list<uint8_t> opcodes) const;
+
+    // a zeroed submission entry, never null: a full queue is submitted first, and when the kernel
+    // still leaves no room the entry waits in a local queue for the next wait()
+    io_uring_sqe* get_sqe();
+
+    // submits the prepared entries and waits up to timeout_ms (-1: forever) for a completion
+    int wait(int timeout_ms);
+
+    // calls f(const io_uring_cqe&) for each available completion, the entries are released as
+    // they are handled so f may prepare new submissions
+    template <typename F>
+    void for_each_cqe(F f) {
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe cqe = cqes[head & *cq_mask];
+            __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+            f(cqe);
+        }
+    }
+
+    // registers count buffers of size bytes as buffer group group
+    bool setup_buffers(uint16_t group, unsigned count, unsigned size);
+    const char* buffer(const uint16_t id) const { return buffer_base + static_cast<size_t>(id) * buffer_size; }
+    void recycle_buffer(uint16_t id); // gives a buffer picked by a receive back to the kernel
+
+private:
+    int submit(unsigned wait_nr, int timeout_ms);
+    bool sq_full() const;
+    void flush_overflow(); // moves entries of overflow to the free slots of the ring, in order
+
+    int fd = -1;
+    void* sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void* cq_ring = nullptr; // same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqes_size = 0;
+    unsigned* sq_head = nullptr;
+    unsigned* sq_tail = nullptr;
+    unsigned* sq_mask = nullptr;
+    unsigned* sq_array = nullptr;
+    unsigned sq_entries = 0;
+    unsigned sqe_tail = 0; // local tail, published to sq_tail on submission
+    std::deque<io_uring_sqe> overflow; // prepared while the ring had no free slot
+    unsigned* cq_head = nullptr;
+    unsigned* cq_tail = nullptr;
+    unsigned* cq_mask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    bool ext_arg = false; // wait timeouts can be passed to io_uring_enter directly
+
+    // io_uring_buf_ring declares its entries with a flexible array member that C++ compilers place
+    // after an empty struct, 8 bytes too far, so the ring is addressed as plain entries
+    io_uring_buf* buf_ring = nullptr;
+    size_t buf_ring_size = 0;
+    char* buffer_base = nullptr;
+    size_t buffers_size = 0;
+    unsigned buffer_size = 0;
+    unsigned buf_mask = 0;
+    uint16_t buf_tail = 0;
+};
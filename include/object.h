@@ -1,18 +1,30 @@
 #pragma once
 
 #include "SkipList.cpp"
+#include "bitmap.h"
+#include "hyperloglog.h"
+#include "stream.h"
 
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
 #include <unordered_set>
 #include <unordered_map>
 
+// bytes the allocator takes for a request of n bytes: glibc adds an 8-byte header and rounds up to
+// 16 bytes, with 32 bytes at least
+size_t allocation_size(size_t n);
+
+// a score as the ZSet replies show it: integral values without decimals
+std::string double2string(double d);
+
 class RedisString {
 public:
 
     enum class Encoding {
-        ONLY_STRING, STRING_INT, STRING_DOUBLE, NONE
+        ONLY_STRING, STRING_INT, STRING_DOUBLE, NONE,
+        BYTES // written by the bit commands, parsed again only when used as a number
     };
 
     explicit RedisString(const std::string& str);
@@ -23,6 +35,10 @@ public:
 
     std::string std_string() const;
 
+    const std::string& raw_string() const; // the stored text, without quotes
+
+    std::string& bytes(); // for in-place bit operations, the encoding becomes BYTES
+
     void update_num(int delta); // used only when encoding_ is STRING_INT
 
     void update_num(double delta);
@@ -43,15 +59,18 @@ struct ZSet {
     std::unordered_map<std::string, double> map;
 };
 
+enum class ZStoreOp { UNION, INTER, DIFF };
+enum class ZAggregate { SUM, MIN, MAX };
+
 class RedisObject {
 public:
 
     enum class Type {
-        STRING, LIST, SET, HASH, ZSET
+        STRING, LIST, SET, HASH, ZSET, HYPERLOGLOG, STREAM
     };
 
     enum class Encoding {
-        REDIS_STRING, STD_VECTOR, STD_UNORDERED_SET, STD_UNORDERED_MAP, SKIPLIST_STD_UNORDERED_MAP
+        REDIS_STRING, STD_VECTOR, STD_UNORDERED_SET, STD_UNORDERED_MAP, SKIPLIST_STD_UNORDERED_MAP, HLL_SPARSE, HLL_DENSE, STREAM_BLOCKS
     };
 
     explicit RedisObject(Type type);
@@ -60,12 +79,40 @@ public:
 
     Encoding encoding() const;
 
+    // bytes taken by the value: the object, the nodes and arrays of its containers and the strings
+    // they hold, as allocated; a container with more than samples elements is estimated from its
+    // first samples elements (0: every element)
+    size_t memory_usage(size_t samples = 0) const;
+    std::string encoding_name() const; // OBJECT ENCODING
+    std::string type_name() const;     // TYPE
+
+    // Access statistics, for OBJECT IDLETIME and OBJECT FREQ: the time of the last access and a
+    // logarithmic access counter, as in Redis's LFU, that decays with the minutes since then
+    static constexpr unsigned LFU_INIT_VAL = 5;
+    void touch(uint64_t now_ms, unsigned lfu_log_factor, unsigned lfu_decay_time);
+    uint64_t idle_ms(uint64_t now_ms) const;
+    unsigned freq(uint64_t now_ms, unsigned lfu_decay_time) const;
+
+    // Snapshot, see snapshot.h for the layout
+    void serialize(std::string& out) const;
+    static std::optional<RedisObject> deserialize(const std::string& in, size_t& pos); // advances pos
+
     // String
     std::string get() const;
     std::string set(const std::string& value);
     std::string incr();
     std::string incr_by(int increment);
     std::string incr_by_float(double increment);
+    std::string str_len() const;
+
+    // Bitmap, on the bytes of a string
+    std::string set_bit(uint64_t offset, int bit);
+    std::string get_bit(uint64_t offset) const;
+    std::string bit_count(int64_t start, int64_t end) const; // byte range, negative from the end
+    std::string bit_pos(int bit, int64_t start, int64_t end, bool end_given) const;
+    std::string bit_field(const std::vector<BitfieldOp>& ops);
+    const std::string* bytes() const; // null for other types
+    void set_bytes(std::string bytes);
 
     // List
     std::string l_push(const std::string& value);
@@ -84,6 +131,7 @@ public:
     std::string h_set_n_x(const std::string& field, const std::string& value);
     std::string h_incr_by(const std::string& field, int increment);
     std::string h_incr_by_float(const std::string& field, double increment);
+    std::string h_len() const;
 
     // Set
     std::string s_add(const std::string& member);
@@ -94,6 +142,7 @@ public:
     std::string s_inter(const RedisObject& other) const;
     std::string s_diff(const RedisObject& other) const;
     std::string s_union(const RedisObject& other) const;
+    const std::unordered_set<std::string>* members() const; // null for other types
 
     // ZSet
     std::string z_add(double score, const std::string& member);
@@ -101,17 +150,37 @@ public:
     std::string z_score(const std::string& member) const;
     std::string z_rank(const std::string& member, bool with_score) const; // 0-based index
     std::string z_card() const;
-    std::string z_count(double min, double max) const;
+    std::string z_count(double min, bool minExclusive, double max, bool maxExclusive) const;
     std::string z_incr_by(double increment, const std::string& member);
     std::string z_range(int idx1, int idx2, bool with_scores) const;
     std::string z_range_by_score(double min, bool minExclusive, double max, bool maxExclusive, bool with_scores) const;
+    std::string z_range_by_lex(const LexBound& min, const LexBound& max, int offset, int count, bool reverse) const;
+    std::string z_lex_count(const LexBound& min, const LexBound& max) const;
+    std::string z_rem_range_by_lex(const LexBound& min, const LexBound& max);
     std::string z_inter(const RedisObject& other) const; // add the score of common members
     std::string z_union(const RedisObject& other) const; // add the score of common members
+    const ZSet* zset() const; // null for other types, for the GEO commands
+    // fills this empty ZSet with the result of ZUNIONSTORE, ZINTERSTORE or ZDIFFSTORE over sets
+    // (null for a missing key) scaled by weights, returns the new cardinality
+    std::string z_store(ZStoreOp op, const std::vector<const ZSet*>& sets, const std::vector<double>& weights,
+                        ZAggregate aggregate);
+
+    // HyperLogLog
+    std::string pf_add(const std::vector<std::string>& elements); // "1" if the estimate may have changed
+    std::string pf_count() const;
+    const HyperLogLog* hyperloglog() const; // null for other types
+    void pf_assign(const HyperLogLog::Registers& registers);
+
+    // Stream, the commands work on it directly
+    Stream* stream(); // null for other types
+    const Stream* stream() const;
 
 private:
     std::variant<RedisString, std::vector<std::string>,
         std::unordered_map<std::string, RedisString>,
-        std::unordered_set<std::string>, ZSet> value;
+        std::unordered_set<std::string>, ZSet, HyperLogLog, Stream> value;
     Type type_;
     Encoding encoding_;
+    uint64_t access_ms; // steady clock
+    uint8_t lfu_counter = LFU_INIT_VAL;
 };
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Key names in a compressed radix tree: every edge holds the longest run of characters shared by
+// the keys below it, and every node counts the keys of its subtree. The keys starting with a
+// prefix are then one subtree, found in O(prefix length) and visited in lexicographic order,
+// without looking at any other key.
+class RadixTree {
+public:
+    RadixTree();
+    ~RadixTree();
+
+    bool insert(const std::string& key); // false if already there
+    bool erase(const std::string& key);  // false if not there
+    void clear();
+    size_t size() const;
+
+    size_t count_prefix(const std::string& prefix) const;
+
+    // calls fn(key) on the keys starting with prefix and not less than from, in order, until fn
+    // returns false
+    void visit(const std::string& prefix, const std::string& from,
+               const std::function<bool(const std::string&)>& fn) const;
+
+private:
+    struct Node {
+        std::string label; // characters of the edge from the parent
+        bool is_key = false;
+        size_t count = 0;  // keys in this subtree
+        std::vector<std::unique_ptr<Node>> children; // sorted by the first character of their label
+    };
+
+    // the child whose label starts with c, or where it would go
+    static std::vector<std::unique_ptr<Node>>::iterator child(Node& node, unsigned char c);
+    static const Node* find_child(const Node& node, unsigned char c);
+    bool contains(const std::string& key) const;
+    static bool erase(Node& node, const std::string& key, size_t pos);
+    static bool visit(const Node& node, std::string& path, const std::string& from,
+                      const std::function<bool(const std::string&)>& fn);
+
+    std::unique_ptr<Node> root;
+};
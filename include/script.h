@@ -0,0 +1,63 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class ScriptError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// A tiny stack-based script language compiled to bytecode, run in-process by EVAL/EVALSHA.
+//
+// Words are separated by whitespace and evaluated left to right:
+//   123  -1.5  'some text'  nil    push a literal ('...' may contain spaces, \' escapes a quote)
+//   KEYS[n]  ARGV[n]               push the n-th (1-based) key or argument
+//   NAME/n                         pop n values, run command NAME with them, push its reply
+//   dup drop swap over             stack manipulation
+//   + - * / %                      arithmetic on numbers
+//   = != < > <= >=                 comparison (= and != compare strings, the rest numbers), push 1 or 0
+//   not and or                     logic, "", "0", "false" and "(nil)" are false
+//   ..                             concatenate two strings
+//   nil?                           push 1 if the popped value is (nil)
+//   if ... [else ...] then         conditional, pops the condition
+//   return                         stop, the top of the stack is the result
+// Command replies are the strings a client would receive, so text values come back "quoted".
+// The result of a script is the top of the stack when it ends, or (nil) if the stack is empty.
+// There are only forward jumps, so every script terminates.
+class Script {
+public:
+    using Caller = std::function<std::string(std::vector<std::string>&)>;
+
+    // throws ScriptError on syntax errors
+    static std::shared_ptr<const Script> compile(const std::string& source);
+
+    const std::string& source() const;
+
+    // throws ScriptError on runtime errors
+    std::string run(const std::vector<std::string>& keys, const std::vector<std::string>& args,
+                    const Caller& call) const;
+
+private:
+    enum class Op {
+        PUSH, KEY, ARG, CALL,
+        DUP, DROP, SWAP, OVER,
+        ADD, SUB, MUL, DIV, MOD,
+        EQ, NE, LT, GT, LE, GE,
+        NOT, AND, OR, CONCAT, IS_NIL,
+        JUMP_IF_FALSE, JUMP, RETURN
+    };
+
+    struct Instr {
+        Op op;
+        int arg;         // index for KEY/ARG, argument count for CALL, target for jumps
+        std::string str; // literal for PUSH, command name for CALL
+
+        Instr(const Op op, const int arg = 0, std::string str = {}) : op(op), arg(arg), str(std::move(str)) {}
+    };
+
+    std::vector<Instr> code;
+    std::string source_;
+};
@@ -1,22 +1,267 @@
 #pragma once
 #include <object.h>
+#include <client.h>
+#include <command.h>
+#include <script.h>
+#include <timer_wheel.h>
+#include <glob_trie.h>
+#include <config.h>
+#include <stats.h>
+#include <io_uring.h>
+#include <worker_pool.h>
+#include <radix_tree.h>
+#include <hotkeys.h>
+#include <deque>
+#include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <string>
+#include <utility>
+#include <vector>
 #include <sys/epoll.h>
+#include <sys/socket.h>
 
 class RedisServer {
 public:
-    explicit RedisServer(int port);
+    RedisServer(int port, const ServerConfig& config);
     void run();
 
 private:
+    ServerConfig config;
+    int port;
     int listen_fd;
+    int unix_fd = -1;    // Unix socket listener, -1 without unixsocket
+    int metrics_fd = -1; // HTTP /metrics listener, -1 if metrics-port is 0
     int epoll_fd;
-    std::unordered_map<int, std::string> client_buffers;
+    std::unordered_map<int, Client> clients;
+    size_t http_clients = 0; // connections of the metrics port, in clients but not limited by maxclients
     std::unordered_map<std::string, RedisObject> kv_store;
+    std::unordered_map<std::string, std::unordered_set<int>> watched_keys; // key -> fds of watching clients
+    std::unordered_map<std::string, std::shared_ptr<const Script>> scripts; // sha1 of source -> compiled script
+    std::unordered_map<std::string, std::deque<int>> blocking_keys; // key -> fds of blocked clients, FIFO
+    std::vector<std::string> ready_keys; // keys with blocked clients that received data
+    std::vector<int> unblocked_clients;  // clients whose pending input must be processed again
+    TimerWheel block_timers;
+    uint64_t next_block_id = 0;
+    std::unordered_map<std::string, std::unordered_set<int>> pubsub_channels; // channel -> subscriber fds
+    std::unordered_map<std::string, std::unordered_set<int>> pubsub_patterns; // pattern -> subscriber fds
+    GlobTrie pattern_trie; // every pattern in pubsub_patterns
+    std::vector<int> clients_to_close;
+    // key hash -> fd and client id of the tracking readers
+    std::unordered_map<uint64_t, std::vector<std::pair<int, uint64_t>>> tracking_table;
+    std::unordered_map<std::string, std::unordered_set<int>> tracking_prefixes; // BCAST prefix -> fds
+    uint64_t last_cron_ms = 0;
+    uint64_t next_client_id = 1;
+    int call_depth = 0; // nesting of call(), 1 while a client command runs, more inside scripts
+    bool exec_running = false; // EXEC is running the queued commands, they still propagate one by one
 
-    void accept_connection() const;
+    // Replication, primary side
+    std::string replid;              // identifies the history of the replication stream
+    uint64_t master_repl_offset = 0; // bytes ever appended to the replication stream
+    std::string repl_backlog;        // circular buffer holding the tail of the stream, empty until a replica syncs
+    size_t repl_backlog_idx = 0;     // where the next byte goes
+    size_t repl_backlog_histlen = 0; // valid bytes in repl_backlog
+    std::unordered_set<int> replicas;
+
+    // Replication, replica side
+    enum class ReplState { NONE, CONNECTING, WAIT_PSYNC_REPLY, TRANSFER, CONNECTED };
+    std::string master_host; // empty when this server is a primary
+    int master_port = 0;
+    int master_fd = -1;
+    ReplState repl_state = ReplState::NONE;
+    std::string master_replid;  // history the local data belongs to, empty before the first sync
+    uint64_t master_offset = 0; // stream bytes processed
+    uint64_t last_master_attempt_ms = 0;
+
+    // Cluster
+    std::vector<std::string> slot_owner;                    // slot -> "ip:port" of its node, empty if unassigned
+    std::vector<std::unordered_set<std::string>> slot_keys; // slot -> keys stored here
+    std::unordered_map<int, std::string> importing_slots;   // slot -> node migrating it here
+    struct SlotMigration {
+        enum class Reply { CONTROL, KEY, DELETE };
+        int slot = -1; // -1 when no slot is migrating
+        std::string target;
+        int fd = -1;
+        bool connected = false;
+        bool handing_over = false; // every key moved, waiting for the target to take the slot
+        std::deque<std::pair<Reply, std::string>> pending; // replies expected from the target, in order
+        std::unordered_set<std::string> in_flight; // keys sent and not acknowledged yet
+        std::unordered_set<std::string> dirty;     // in flight keys modified since they were sent
+        uint64_t last_attempt_ms = 0;
+    } migration;
+
+    // io_uring backend, when io-backend is io_uring: the ring accepts and serves the connections
+    // of the main port, everything else stays on epoll, whose fd is polled through the ring
+    std::unique_ptr<IoUring> ring; // null with the epoll backend
+    struct UringSend {
+        std::vector<std::shared_ptr<const std::string>> buffers; // kept alive until the kernel is done
+        std::vector<iovec> iov;
+        msghdr msg {};
+    };
+    std::unordered_map<uint64_t, UringSend> uring_sends; // user_data -> send in flight
+    bool uring_recv_works = false; // a receive has completed, the kernel takes multishot receives
+    bool uring_failed = false;     // the kernel refused a receive, switch to epoll after the batch
+
+    RadixTree key_index; // every key of kv_store when key-index is enabled, empty otherwise
+
+    // Worker pool, when worker-threads is not 0: large SINTER/SUNION/SDIFF/ZINTER/ZUNION run on it
+    // while the keys they read are locked against writes, see workers.cpp
+    std::unique_ptr<WorkerPool> workers;
+    std::unordered_map<std::string, size_t> job_keys;  // key -> running jobs reading it
+    std::vector<std::pair<int, uint64_t>> job_waiters; // fd, id of clients whose write waits for a job
+
+    // Statistics
+    ServerStats stats;
+    std::unordered_map<const CommandSpec*, CommandStats> command_stats;
+    size_t keys_by_type[static_cast<size_t>(RedisObject::Type::STREAM) + 1] = {}; // for /metrics
+    std::deque<SlowlogEntry> slowlog; // newest first
+    uint64_t slowlog_next_id = 0;
+    std::unordered_map<std::string, LatencyEvent> latency_events; // event name -> samples
+    HotKeys hot_keys; // keys of the commands received, halved every hotkeys-decay-time seconds
+
+    static constexpr int CRON_INTERVAL_MS = 100;
+
+    void set_tcp_options(int fd) const; // TCP_NODELAY and keepalive, as configured
+    int connect_nonblocking(const std::string& host, int port); // -1 on failure, watches EPOLLOUT until connected
+    uint64_t epoll_process_events(int timeout); // returns when the handling of the events started
+    void epoll_dispatch(const epoll_event* events, int nfds);
+    void accept_connection(int listener);
+    void add_client(int client_fd, int listener);
+    void close_client(int client_fd);
     void handle_client(int client_fd);
-    static void send_response(int client_fd, const std::string& response);
+    void client_input(int client_fd, const char* data, size_t n);
+    void process_input_buffer(int client_fd);
+    void send_response(int client_fd, const std::string& response);
+    void add_reply(int client_fd, std::shared_ptr<const std::string> reply);
+    void write_to_client(int client_fd);
+    void check_output_limits(int client_fd);
+    void free_client_async(int client_fd);
+    void clients_cron();
+    std::string client_command(int client_fd, const std::vector<std::string>& tokens);
+    std::string client_info(int client_fd) const;
     void parse_and_execute(int client_fd, const std::string& command);
+    std::string call(int client_fd, std::vector<std::string>& tokens); // execute + keyspace bookkeeping
+    std::string execute_command(int client_fd, std::vector<std::string>& tokens);
+    std::string config_command(const std::vector<std::string>& tokens);
+
+    // io_uring backend
+    void uring_init(); // leaves ring null if the kernel refuses
+    void uring_fallback(); // moves the listeners and connections of the ring to epoll
+    uint64_t uring_process_events(int timeout);
+    void uring_complete(const io_uring_cqe& cqe);
+    void uring_arm_accept(int listener);
+    void uring_arm_epoll();
+    void uring_arm_recv(int client_fd);
+    void uring_write(int client_fd);
+
+    // Keyspace: KEYS, SCAN, DELPREFIX, MEMORY, TYPE, OBJECT
+    void key_index_update(const std::string& key);
+    void key_index_rebuild();
+    // fn on every key starting with prefix, in lexicographic order with key-index
+    void for_each_key(const std::string& prefix, const std::function<void(const std::string&)>& fn) const;
+    std::string keys_command(const std::vector<std::string>& tokens) const;
+    std::string scan_command(const std::vector<std::string>& tokens) const;
+    std::string del_prefix_command(const std::vector<std::string>& tokens);
+    std::string memory_command(const std::vector<std::string>& tokens);
+    std::string type_command(const std::vector<std::string>& tokens) const;
+    std::string object_command(const std::vector<std::string>& tokens) const;
+    size_t key_memory_usage(const std::string& key, const RedisObject& ro, size_t samples) const;
+    void record_access(const CommandSpec& spec, const std::vector<std::string>& tokens); // for OBJECT IDLETIME/FREQ
+
+    // Worker pool
+    bool start_job(int client_fd, const std::vector<std::string>& tokens); // false to run the command inline
+    void finish_job(int client_fd, uint64_t client_id, const std::vector<std::string>& keys, const std::string& reply);
+    bool touches_job_keys(const CommandSpec& spec, const std::vector<std::string>& tokens) const; // a write to a locked key
+    void wait_for_jobs(); // blocks the main thread until every job completed
+
+    // Transaction
+    std::string transaction_command(int client_fd, const std::vector<std::string>& tokens);
+    void touch_key(const std::string& key); // invalidate WATCH and client caches on key
+    void unwatch_all(int client_fd);
+
+    // Scripting
+    std::string script_command(int client_fd, const std::vector<std::string>& tokens);
+
+    // Bitmaps: SETBIT, GETBIT, BITCOUNT, BITPOS, BITOP, BITFIELD
+    std::string bitmap_command(const std::vector<std::string>& tokens);
+
+    // Geospatial index on a ZSet: GEOADD, GEOPOS, GEODIST, GEOSEARCH
+    std::string geo_command(const std::vector<std::string>& tokens);
+
+    // ZUNIONSTORE, ZINTERSTORE, ZDIFFSTORE over any number of keys
+    std::string zset_store_command(const std::vector<std::string>& tokens);
+
+    // Streams: XADD, XRANGE, XREVRANGE, XLEN, XTRIM, XGROUP, XREADGROUP, XACK, XPENDING; XADD
+    // writes the ID it generated back into tokens, for replication
+    std::string stream_command(std::vector<std::string>& tokens);
+
+    // Blocking list operations
+    std::string blocking_command(int client_fd, const std::vector<std::string>& tokens);
+    std::string list_move(const std::string& src, bool pop_left, const std::string& dst, bool push_left);
+    bool list_ready(const std::string& key) const;
+    void signal_key_as_ready(const std::string& key);
+    void serve_ready_keys();
+    void unblock_client(int client_fd);
+    void expire_blocked_clients();
+
+    // Pub/Sub
+    std::string pubsub_command(int client_fd, const std::vector<std::string>& tokens);
+    size_t publish(const std::string& channel, const std::string& message); // returns number of receivers
+    void pubsub_unsubscribe_channel(int client_fd, const std::string& channel);
+    void pubsub_unsubscribe_pattern(int client_fd, const std::string& pattern);
+    void pubsub_unsubscribe_all(int client_fd);
+
+    // Client side caching and keyspace notifications
+    std::string tracking_command(int client_fd, const std::vector<std::string>& tokens);
+    void disable_tracking(int client_fd);
+    void track_key(int client_fd, const std::string& key);
+    void invalidate_key(const std::string& key);
+    void notify_keyspace_event(unsigned type, const std::string& event, const std::string& key);
+
+    // Replication
+    static std::string generate_replid();
+    void propagate(const std::vector<std::string>& tokens);
+    std::string psync_command(int client_fd, const std::vector<std::string>& tokens);
+    std::string replicaof_command(const std::vector<std::string>& tokens);
+    std::string role_command() const;
+    void connect_to_master();
+    void master_connected();
+    void replica_read_master();
+    void signal_flushed_db();
+    void replication_cron();
+
+    // Cluster
+    std::string cluster_myself() const;
+    void cluster_update_slot_index(const std::string& key);
+    void cluster_rebuild_slot_index();
+    std::string cluster_redirect(bool asking, const CommandSpec& spec, const std::vector<std::string>& tokens) const;
+    std::string cluster_command(const std::vector<std::string>& tokens);
+    std::string restore_command(const std::vector<std::string>& tokens);
+    void cluster_connect_migration();
+    void cluster_migration_connected();
+    void cluster_migration_send_batch();
+    void cluster_migration_read();
+    void cluster_abort_migration();
+    void cluster_cron();
+
+    // Statistics
+    void record_command(int client_fd, const CommandSpec& spec, const std::vector<std::string>& tokens,
+                        uint64_t ticks, bool failed);
+    void reject_command(const CommandSpec* spec);
+    void reset_stats();
+    void stats_cron();
+    uint64_t instantaneous_ops_per_sec() const;
+    std::string info_command(const std::vector<std::string>& tokens);
+    std::string latency_command(const std::vector<std::string>& tokens);
+    std::string hotkeys_command(const std::vector<std::string>& tokens) const;
+    void slowlog_push(int client_fd, const std::vector<std::string>& tokens, uint64_t usec);
+    std::string slowlog_command(const std::vector<std::string>& tokens);
+    void latency_add_sample(const std::string& event, uint64_t ms);
+
+    // Metrics
+    void http_read(int client_fd);
+    std::string metrics_text();
+    int key_type(const std::string& key) const; // index of keys_by_type, -1 if the key is missing
+    void recount_key(const std::string& key, int before); // before: key_type(key) before the change
+    void rebuild_key_counts();
 };
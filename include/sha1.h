@@ -0,0 +1,5 @@
+#pragma once
+#include <string>
+
+// 40 character lower case hex digest
+std::string sha1_hex(const std::string& data);
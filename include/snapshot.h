@@ -0,0 +1,12 @@
+#pragma once
+#include <object.h>
+
+#include <string>
+#include <unordered_map>
+
+// Point-in-time image of the keyspace:
+//   "SRDB" version(1 byte) { 0x00 key(u32 length + bytes) object(RedisObject::serialize) }... 0xFF
+std::string dump_snapshot(const std::unordered_map<std::string, RedisObject>& kv_store);
+
+// replaces the content of kv_store, returns false (leaving kv_store empty) on malformed input
+bool load_snapshot(const std::string& data, std::unordered_map<std::string, RedisObject>& kv_store);
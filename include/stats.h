@@ -0,0 +1,77 @@
+#pragma once
+#include <hdr_histogram.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Latency histogram of a command, in nanoseconds, within 25%: 264 counters per command
+using LatencyHistogram = LogLinearHistogram<3>;
+
+// Per command counters, reported by INFO commandstats / latencystats and LATENCY HISTOGRAM
+struct CommandStats {
+    uint64_t calls = 0;
+    uint64_t ticks = 0;          // CycleClock ticks spent executing
+    uint64_t rejected_calls = 0; // refused before execution: arity, READONLY, redirections...
+    uint64_t failed_calls = 0;   // executed, but replied with an error
+    LatencyHistogram latency;
+};
+
+// Server wide counters, reported by INFO
+struct ServerStats {
+    uint64_t start_ms = 0;
+    uint64_t connections_received = 0;
+    uint64_t rejected_connections = 0; // refused because of maxclients
+    uint64_t commands_processed = 0;
+    uint64_t rejected_calls = 0; // including unknown commands
+    uint64_t error_replies = 0;
+    uint64_t net_input_bytes = 0;
+    uint64_t net_output_bytes = 0;
+    uint64_t peak_memory = 0;
+    uint64_t snapshots = 0; // full resyncs served
+    uint64_t last_snapshot_bytes = 0;
+    uint64_t last_snapshot_usec = 0;
+
+    // event loop iterations, without the wait for events
+    LatencyHistogram event_loop_latency;
+    uint64_t event_loop_ticks = 0;
+    uint64_t event_loop_max_ticks = 0; // since the last scrape of the metrics
+
+    // commands_processed sampled by the cron, for the instantaneous ops/sec
+    static constexpr size_t OPS_SAMPLES = 16;
+    uint64_t ops_samples[OPS_SAMPLES] = {}; // ops/sec between consecutive samples
+    size_t ops_sample_idx = 0;
+    uint64_t last_ops_sample_ms = 0;
+    uint64_t last_ops_commands = 0;
+
+    uint64_t last_hotkeys_decay_ms = 0;
+};
+
+// A command that ran longer than slowlog-log-slower-than
+struct SlowlogEntry {
+    uint64_t id;
+    uint64_t time; // unix seconds
+    uint64_t usec;
+    std::vector<std::string> args; // at most SLOWLOG_MAX_ARGS, each cut at SLOWLOG_MAX_ARG_LEN
+    std::string client_addr;
+};
+
+constexpr size_t SLOWLOG_MAX_ARGS = 32;
+constexpr size_t SLOWLOG_MAX_ARG_LEN = 128;
+
+// Samples of a latency monitor event over latency-monitor-threshold, at most one per second
+struct LatencyEvent {
+    struct Sample {
+        uint64_t time; // unix seconds
+        uint64_t ms;
+    };
+    static constexpr size_t HISTORY = 160;
+
+    uint64_t max_ms = 0;
+    std::vector<Sample> history; // ring buffer of HISTORY samples
+    size_t next = 0;             // where the next sample goes once history is full
+
+    void add(uint64_t time, uint64_t ms);
+    const Sample& latest() const;
+    std::vector<Sample> samples() const; // oldest first
+};
+
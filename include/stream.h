@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+struct StreamID {
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+
+    bool operator<(const StreamID& o) const { return ms != o.ms ? ms < o.ms : seq < o.seq; }
+    bool operator==(const StreamID& o) const { return ms == o.ms && seq == o.seq; }
+    bool operator<=(const StreamID& o) const { return !(o < *this); }
+    std::string str() const { return std::to_string(ms) + "-" + std::to_string(seq); }
+
+    // "ms-seq", or "ms" with missing_seq as the sequence
+    static bool parse(const std::string& s, uint64_t missing_seq, StreamID& out);
+    static StreamID max() { return {UINT64_MAX, UINT64_MAX}; }
+};
+
+struct StreamEntry {
+    StreamID id;
+    std::vector<std::string> fields; // field, value, field, value...
+};
+
+struct StreamPendingEntry {
+    std::string consumer;
+    uint64_t delivery_ms;
+    uint64_t deliveries;
+};
+
+struct StreamConsumerGroup {
+    StreamID last_delivered;
+    std::map<StreamID, StreamPendingEntry> pending;
+    std::map<std::string, uint64_t> consumers; // name, last seen ms
+};
+
+// Append-only log of entries with increasing IDs. Entries are packed into blocks of at most
+// BLOCK_MAX_ENTRIES entries or BLOCK_MAX_BYTES bytes: each entry stores its ID as a varint delta
+// from the previous one, and only its values when its fields are those of the first entry of the
+// block, the common case of a stream written by one producer. Appending touches the last block
+// only, a range read finds its first block by binary search over the block index and then scans
+// memory sequentially, and trimming drops whole blocks from the front.
+class Stream {
+public:
+    static constexpr size_t BLOCK_MAX_ENTRIES = 100;
+    static constexpr size_t BLOCK_MAX_BYTES = 4096;
+
+    size_t length() const { return length_; }
+    StreamID last_id() const { return last_id_; }
+
+    // id must be greater than last_id()
+    void append(const StreamID& id, const std::vector<std::string>& fields);
+
+    // entries with start <= id <= end, at most count of them (0: no limit), from the end if reverse
+    std::vector<StreamEntry> range(const StreamID& start, const StreamID& end, size_t count, bool reverse) const;
+
+    // removes the oldest entries down to maxlen, keeping whole blocks when approximate; returns
+    // the number of entries removed
+    size_t trim(size_t maxlen, bool approximate);
+
+    size_t memory_usage() const; // heap bytes of the blocks and the groups
+
+    std::map<std::string, StreamConsumerGroup> groups;
+
+    // the blocks and the groups, see object.h for where this goes in a snapshot
+    void serialize(std::string& out) const;
+    static bool deserialize(const std::string& in, Stream& out); // false if malformed
+
+private:
+    struct Block {
+        StreamID first;
+        StreamID last;
+        size_t count = 0;
+        std::string data;
+        std::vector<std::string> master_fields; // fields of the first entry
+    };
+
+    static void pack(Block& block, const StreamID& id, const std::vector<std::string>& fields);
+    static bool decode(const Block& block, std::vector<StreamEntry>& out); // false if malformed
+
+    std::deque<Block> blocks;
+    size_t length_ = 0;
+    StreamID last_id_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Hashed timing wheel: O(1) insertion, and expiring costs one slot scan per elapsed tick
+// instead of a scan over every pending timer. Timers are not cancelled, owners recognise
+// stale ones by their id when they fire.
+class TimerWheel {
+public:
+    struct Timer {
+        int fd;
+        uint64_t id;
+        uint64_t deadline_ms;
+    };
+
+    explicit TimerWheel(const uint64_t tick_ms = 10, const size_t slots = 512)
+        : tick_ms(tick_ms), wheel(slots) {}
+
+    void add(const int fd, const uint64_t id, const uint64_t deadline_ms) {
+        uint64_t tick = (deadline_ms + tick_ms - 1) / tick_ms;
+        if (tick <= current_tick) tick = current_tick + 1;
+        wheel[tick % wheel.size()].push_back({fd, id, deadline_ms});
+        ++count;
+    }
+
+    // returns the timers whose deadline is not after now_ms
+    std::vector<Timer> advance(const uint64_t now_ms) {
+        std::vector<Timer> expired;
+        const uint64_t target_tick = now_ms / tick_ms;
+        if (count == 0) {
+            current_tick = target_tick;
+            return expired;
+        }
+        // a full revolution visits every slot, there is no point in going around again
+        const uint64_t steps = std::min<uint64_t>(target_tick - std::min(target_tick, current_tick), wheel.size());
+        for (uint64_t i = 0; i < steps; ++i) {
+            auto& slot = wheel[(current_tick + 1 + i) % wheel.size()];
+            for (size_t j = 0; j < slot.size();) {
+                if (slot[j].deadline_ms <= now_ms) {
+                    expired.push_back(slot[j]);
+                    slot[j] = slot.back();
+                    slot.pop_back();
+                    --count;
+                } else {
+                    ++j; // due in a later revolution
+                }
+            }
+        }
+        current_tick = std::max(current_tick, target_tick);
+        return expired;
+    }
+
+    // epoll_wait timeout: wake up every tick while timers are pending, otherwise sleep forever
+    int next_timeout_ms() const {
+        return count == 0 ? -1 : static_cast<int>(tick_ms);
+    }
+
+private:
+    uint64_t tick_ms;
+    std::vector<std::vector<Timer>> wheel;
+    uint64_t current_tick = 0;
+    size_t count = 0;
+};
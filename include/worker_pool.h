@@ -0,0 +1,54 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads running tasks off the event loop. A task hands its outcome back with
+// complete(): the closure is queued for the main thread, woken through an eventfd that the event
+// loop polls along with the client sockets, and run there by run_completions(). Nothing else is
+// shared, a task must only read data that the main thread leaves untouched until it completes.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return threads.size(); }
+    int event_fd() const { return efd; }
+
+    void submit(std::function<void()> task);
+
+    // From a task: runs fn(first, last) over chunks of [0, n) on the calling thread and on idle
+    // workers, returns once every chunk is done. The caller takes chunks too, so a pool whose
+    // workers are all busy still makes progress.
+    void parallel_for(size_t n, const std::function<void(size_t, size_t)>& fn);
+
+    // From a task: queues done for the main thread
+    void complete(std::function<void()> done);
+
+    // From the main thread: runs the queued completions, returns how many
+    size_t run_completions();
+
+    // From the main thread: waits until no task is queued or running, then runs the completions
+    void drain();
+
+private:
+    void worker_loop();
+
+    std::vector<std::thread> threads;
+    int efd = -1;
+    std::mutex mutex;
+    std::condition_variable work_cv; // a task was queued, or stopping
+    std::condition_variable idle_cv; // the last running task finished
+    std::deque<std::function<void()>> tasks;
+    size_t running = 0; // tasks taken by a worker and not finished
+    bool stopping = false;
+    std::mutex completions_mutex;
+    std::vector<std::function<void()>> completions;
+};
@@ -0,0 +1,177 @@
+#include "bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+uint64_t load_word(const unsigned char* p) {
+    uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+void store_word(unsigned char* p, const uint64_t w) {
+    std::memcpy(p, &w, sizeof(w));
+}
+
+uint64_t count_portable(const unsigned char* p, const size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) count += __builtin_popcountll(load_word(p + i));
+    for (; i < n; ++i) count += __builtin_popcount(p[i]);
+    return count;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("popcnt"))) uint64_t count_popcnt(const unsigned char* p, const size_t n) {
+    uint64_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) count += __builtin_popcountll(load_word(p + i));
+    for (; i < n; ++i) count += __builtin_popcount(p[i]);
+    return count;
+}
+
+// the bit count of each nibble looked up with vpshufb, the byte counts summed into 64-bit lanes
+// with vpsadbw every 31 blocks, before they can overflow
+__attribute__((target("avx2,popcnt"))) uint64_t count_avx2(const unsigned char* p, const size_t n) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    size_t i = 0;
+    while (i + 32 <= n) {
+        __m256i bytes = zero;
+        for (int block = 0; block < 31 && i + 32 <= n; ++block, i += 32) {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+            const __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_nibble));
+            const __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibble));
+            bytes = _mm256_add_epi8(bytes, _mm256_add_epi8(lo, hi));
+        }
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + count_popcnt(p + i, n - i);
+}
+#endif
+
+using CountFunction = uint64_t (*)(const unsigned char*, size_t);
+
+CountFunction select_count() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return count_avx2;
+    if (__builtin_cpu_supports("popcnt")) return count_popcnt;
+#endif
+    return count_portable;
+}
+
+// r[i] = f(r[i], s[i]) for n bytes, a word at a time
+template <typename F>
+void combine(unsigned char* r, const unsigned char* s, const size_t n, F f) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) store_word(r + i, f(load_word(r + i), load_word(s + i)));
+    for (; i < n; ++i) r[i] = static_cast<unsigned char>(f(r[i], s[i]));
+}
+
+bool get_bit(const std::string& s, const uint64_t offset) {
+    const uint64_t byte = offset >> 3;
+    return byte < s.size() && (static_cast<unsigned char>(s[byte]) >> (7 - (offset & 7)) & 1);
+}
+
+uint64_t field_mask(const unsigned bits) {
+    return bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+}
+
+// the field bits as a value, sign extended for signed fields
+int64_t field_value(const BitfieldOp& op, const uint64_t bits) {
+    if (op.is_signed && op.bits < 64 && (bits >> (op.bits - 1) & 1)) {
+        return static_cast<int64_t>(bits | ~field_mask(op.bits));
+    }
+    return static_cast<int64_t>(bits);
+}
+
+} // namespace
+
+uint64_t bitmap_count(const unsigned char* p, const size_t n) {
+    static const CountFunction count = select_count();
+    return count(p, n);
+}
+
+int64_t bitmap_position(const unsigned char* p, const size_t n, const int bit) {
+    // bytes with nothing to find are skipped a word at a time
+    const uint64_t skip_word = bit ? 0 : ~uint64_t(0);
+    const unsigned char skip_byte = bit ? 0 : 0xff;
+    size_t i = 0;
+    while (i + 8 <= n && load_word(p + i) == skip_word) i += 8;
+    while (i < n && p[i] == skip_byte) ++i;
+    if (i == n) return -1;
+    const unsigned byte = bit ? p[i] : static_cast<unsigned char>(~p[i]);
+    return static_cast<int64_t>(i * 8) + __builtin_clz(byte) - 24;
+}
+
+std::string bitmap_op(const BitOp op, const std::vector<const std::string*>& sources) {
+    size_t len = 0;
+    for (const auto* s : sources) len = std::max(len, s->size());
+    std::string result(len, '\0');
+    auto* r = reinterpret_cast<unsigned char*>(result.data());
+    const auto bytes = [](const std::string* s) { return reinterpret_cast<const unsigned char*>(s->data()); };
+    if (op == BitOp::NOT) {
+        combine(r, bytes(sources[0]), len, [](const uint64_t, const uint64_t b) { return ~b; });
+        return result;
+    }
+    std::memcpy(r, sources[0]->data(), sources[0]->size());
+    for (size_t i = 1; i < sources.size(); ++i) {
+        const std::string* s = sources[i];
+        switch (op) {
+            case BitOp::AND:
+                combine(r, bytes(s), s->size(), [](const uint64_t a, const uint64_t b) { return a & b; });
+                std::memset(r + s->size(), 0, len - s->size());
+                break;
+            case BitOp::OR:
+                combine(r, bytes(s), s->size(), [](const uint64_t a, const uint64_t b) { return a | b; });
+                break;
+            default:
+                combine(r, bytes(s), s->size(), [](const uint64_t a, const uint64_t b) { return a ^ b; });
+        }
+    }
+    return result;
+}
+
+int64_t bitfield_get(const std::string& s, const BitfieldOp& op) {
+    uint64_t bits = 0;
+    for (unsigned i = 0; i < op.bits; ++i) {
+        bits = bits << 1 | get_bit(s, op.offset + i);
+    }
+    return field_value(op, bits);
+}
+
+bool bitfield_set(std::string& s, const BitfieldOp& op, int64_t& result) {
+    const int64_t old = bitfield_get(s, op);
+    __int128 wanted = op.kind == BitfieldOp::Kind::SET ? static_cast<__int128>(op.value)
+                                                       : static_cast<__int128>(old) + op.value;
+    const __int128 min = op.is_signed ? -(static_cast<__int128>(1) << (op.bits - 1)) : 0;
+    const __int128 max = op.is_signed ? (static_cast<__int128>(1) << (op.bits - 1)) - 1
+                                      : (static_cast<__int128>(1) << op.bits) - 1;
+    if (wanted < min || wanted > max) {
+        if (op.overflow == BitfieldOp::Overflow::FAIL) return false;
+        if (op.overflow == BitfieldOp::Overflow::SAT) wanted = wanted < min ? min : max;
+    }
+    const uint64_t bits = static_cast<uint64_t>(wanted) & field_mask(op.bits); // WRAP keeps the low bits
+
+    const uint64_t end_byte = (op.offset + op.bits + 7) / 8;
+    if (s.size() < end_byte) s.resize(end_byte, '\0');
+    for (unsigned i = 0; i < op.bits; ++i) {
+        const uint64_t offset = op.offset + i;
+        const auto bit = static_cast<unsigned char>(0x80 >> (offset & 7));
+        auto& byte = reinterpret_cast<unsigned char&>(s[offset >> 3]);
+        byte = bits >> (op.bits - 1 - i) & 1 ? byte | bit : byte & ~bit;
+    }
+    result = op.kind == BitfieldOp::Kind::SET ? old : field_value(op, bits);
+    return true;
+}
@@ -0,0 +1,370 @@
+#include "cluster.h"
+#include "server.h"
+#include "cycle_clock.h"
+
+#include <sys/socket.h>
+
+// Cluster mode: every key belongs to one of 16384 hash slots and every slot to one node,
+// identified by its "ip:port" address. There is no gossip, each node is told the owner of
+// every slot with CLUSTER ADDSLOTSRANGE / SETSLOT / SETSLOTSRANGE.
+//
+// CLUSTER MIGRATESLOT moves a slot to another node in the background: the node connects to the
+// target, sends the keys of the slot in batches of RESTORE-ASKING commands and deletes each key
+// once the target has acknowledged it. A key modified while it is in flight is sent again. Until
+// the slot is handed over, clients asking for keys that already left get an ASK redirection.
+
+namespace {
+
+std::string to_hex(const std::string& data) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(data.size() * 2);
+    for (const char c : data) {
+        out += hex[(static_cast<unsigned char>(c) >> 4) & 0xF];
+        out += hex[static_cast<unsigned char>(c) & 0xF];
+    }
+    return out;
+}
+
+bool from_hex(const std::string& hex, std::string& out) {
+    if (hex.size() % 2 != 0) return false;
+    const auto nibble = [](const char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    out.clear();
+    out.reserve(hex.size() / 2);
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        const int hi = nibble(hex[i]), lo = nibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out += static_cast<char>(hi << 4 | lo);
+    }
+    return true;
+}
+
+bool parse_slot(const std::string& s, int& slot) {
+    try {
+        size_t pos;
+        slot = std::stoi(s, &pos);
+        return pos == s.size() && slot >= 0 && slot < CLUSTER_SLOTS;
+    } catch (...) {
+        return false;
+    }
+}
+
+} // namespace
+
+uint16_t crc16(const char* buf, const size_t len) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < len; ++i) {
+        crc ^= static_cast<uint16_t>(static_cast<unsigned char>(buf[i])) << 8;
+        for (int j = 0; j < 8; ++j) {
+            crc = crc & 0x8000 ? static_cast<uint16_t>(crc << 1 ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+        }
+    }
+    return crc;
+}
+
+int key_hash_slot(const std::string& key) {
+    if (const size_t open = key.find('{'); open != std::string::npos) {
+        if (const size_t close = key.find('}', open + 1); close != std::string::npos && close > open + 1) {
+            return crc16(key.data() + open + 1, close - open - 1) & (CLUSTER_SLOTS - 1);
+        }
+    }
+    return crc16(key.data(), key.size()) & (CLUSTER_SLOTS - 1);
+}
+
+std::string RedisServer::cluster_myself() const {
+    return config.cluster_announce_ip + ":" + std::to_string(port);
+}
+
+// keeps slot_keys in sync with kv_store, called for every modified key
+void RedisServer::cluster_update_slot_index(const std::string& key) {
+    if (!config.cluster_enabled) return;
+    auto& keys = slot_keys[key_hash_slot(key)];
+    if (kv_store.count(key)) {
+        keys.insert(key);
+    } else {
+        keys.erase(key);
+    }
+}
+
+void RedisServer::cluster_rebuild_slot_index() {
+    if (!config.cluster_enabled) return;
+    slot_keys.assign(CLUSTER_SLOTS, {});
+    for (const auto& [key, ro] : kv_store) {
+        slot_keys[key_hash_slot(key)].insert(key);
+    }
+}
+
+// returns an empty string if this node serves the command, otherwise the redirection or error
+std::string RedisServer::cluster_redirect(const bool asking, const CommandSpec& spec,
+                                          const std::vector<std::string>& tokens) const {
+    const auto keys = command_keys(spec, tokens);
+    if (keys.empty()) return "";
+    const int slot = key_hash_slot(keys[0]);
+    size_t missing = 0;
+    for (const auto& key : keys) {
+        if (key_hash_slot(key) != slot) return "CROSSSLOT Keys in request don't hash to the same slot";
+        if (!kv_store.count(key)) ++missing;
+    }
+
+    const auto& owner = slot_owner[slot];
+    if (owner.empty()) return "CLUSTERDOWN Hash slot not served";
+    if (owner == cluster_myself()) {
+        if (migration.slot == slot && missing > 0) {
+            // keys that already moved have to be asked for on the target
+            if (missing < keys.size()) return "TRYAGAIN Multiple keys request during rehashing of slot";
+            return "ASK " + std::to_string(slot) + " " + migration.target;
+        }
+        return "";
+    }
+    if (importing_slots.count(slot) && (asking || (spec.flags & CommandSpec::ASKING))) return "";
+    return "MOVED " + std::to_string(slot) + " " + owner;
+}
+
+std::string RedisServer::cluster_command(const std::vector<std::string>& tokens) {
+    if (!config.cluster_enabled) return command_error("This instance has cluster support disabled");
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    const std::string myself = cluster_myself();
+
+    if (sub == "MYID" && tokens.size() == 2) return myself;
+    if (sub == "KEYSLOT" && tokens.size() == 3) return std::to_string(key_hash_slot(tokens[2]));
+    if (sub == "SLOTS" && tokens.size() == 2) {
+        // contiguous ranges with the same owner
+        std::string result;
+        int count = 0;
+        for (int start = 0; start < CLUSTER_SLOTS;) {
+            int end = start;
+            while (end + 1 < CLUSTER_SLOTS && slot_owner[end + 1] == slot_owner[start]) ++end;
+            if (!slot_owner[start].empty()) {
+                if (count > 0) result += "\n";
+                result += std::to_string(++count) + ") " + std::to_string(start) + "-" + std::to_string(end) +
+                          " " + slot_owner[start];
+            }
+            start = end + 1;
+        }
+        return count == 0 ? "(empty array)" : result;
+    }
+    if (sub == "COUNTKEYSINSLOT" && tokens.size() == 3) {
+        int slot;
+        if (!parse_slot(tokens[2], slot)) return command_error("Invalid slot");
+        return std::to_string(slot_keys[slot].size());
+    }
+    if (sub == "GETKEYSINSLOT" && tokens.size() == 4) {
+        int slot, count;
+        if (!parse_slot(tokens[2], slot)) return command_error("Invalid slot");
+        try {
+            count = std::stoi(tokens[3]);
+        } catch (...) {
+            return command_error("Count should be an integer");
+        }
+        std::string result;
+        int n = 0;
+        for (const auto& key : slot_keys[slot]) {
+            if (n == count) break;
+            if (n > 0) result += "\n";
+            result += std::to_string(++n) + ") " + key;
+        }
+        return n == 0 ? "(empty array)" : result;
+    }
+    if ((sub == "ADDSLOTSRANGE" && tokens.size() == 4) || (sub == "SETSLOTSRANGE" && tokens.size() == 5)) {
+        // ADDSLOTSRANGE start end: this node, SETSLOTSRANGE start end host:port: any node
+        int start, end;
+        if (!parse_slot(tokens[2], start) || !parse_slot(tokens[3], end) || start > end) {
+            return command_error("Invalid slot range");
+        }
+        const std::string owner = sub == "ADDSLOTSRANGE" ? myself : tokens[4];
+        for (int slot = start; slot <= end; ++slot) {
+            slot_owner[slot] = owner;
+        }
+        return "OK";
+    }
+    if (sub == "SETSLOT" && tokens.size() >= 4) {
+        // SETSLOT slot NODE|MIGRATING|IMPORTING host:port, SETSLOT slot STABLE
+        int slot;
+        if (!parse_slot(tokens[2], slot)) return command_error("Invalid slot");
+        std::string action = tokens[3];
+        for (char& c : action) c = static_cast<char>(toupper(c));
+        if (action == "STABLE" && tokens.size() == 4) {
+            importing_slots.erase(slot);
+            if (migration.slot == slot) cluster_abort_migration();
+            return "OK";
+        }
+        if (tokens.size() != 5) return command_error("Incorrect argument number");
+        if (action == "NODE") {
+            slot_owner[slot] = tokens[4];
+            importing_slots.erase(slot);
+            return "OK";
+        }
+        if (action == "IMPORTING") {
+            if (slot_owner[slot] == myself) return command_error("I'm already the owner of hash slot " + tokens[2]);
+            importing_slots[slot] = tokens[4];
+            return "OK";
+        }
+        if (action == "MIGRATING") return command_error("Use CLUSTER MIGRATESLOT to move a slot");
+        return command_error("Unknown SETSLOT action " + tokens[3]);
+    }
+    if (sub == "MIGRATESLOT" && tokens.size() == 4) {
+        // MIGRATESLOT slot host:port
+        int slot;
+        if (!parse_slot(tokens[2], slot)) return command_error("Invalid slot");
+        if (slot_owner[slot] != myself) return command_error("I'm not the owner of hash slot " + tokens[2]);
+        if (tokens[3] == myself) return command_error("Target is this node");
+        if (migration.slot >= 0) {
+            return command_error("A migration of slot " + std::to_string(migration.slot) + " is in progress");
+        }
+        const size_t colon = tokens[3].rfind(':');
+        if (colon == std::string::npos) return command_error("Target should be host:port");
+        migration.slot = slot;
+        migration.target = tokens[3];
+        cluster_connect_migration();
+        return "OK";
+    }
+    return command_error("Unknown CLUSTER subcommand or incorrect argument number");
+}
+
+std::string RedisServer::restore_command(const std::vector<std::string>& tokens) {
+    // RESTORE key serialized-hex [REPLACE]
+    bool replace = false;
+    if (tokens.size() == 4) {
+        std::string option = tokens[3];
+        for (char& c : option) c = static_cast<char>(toupper(c));
+        if (option != "REPLACE") return command_error("Unknown RESTORE option " + tokens[3]);
+        replace = true;
+    } else if (tokens.size() != 3) {
+        return command_error("Incorrect argument number");
+    }
+    std::string payload;
+    if (!from_hex(tokens[2], payload)) return command_error("Bad data format");
+    size_t pos = 0;
+    auto ro = RedisObject::deserialize(payload, pos);
+    if (!ro || pos != payload.size()) return command_error("Bad data format");
+    if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
+        if (!replace) return command_error("BUSYKEY Target key name already exists");
+        kv_store.erase(it);
+    }
+    kv_store.emplace(tokens[1], std::move(*ro));
+    return "OK";
+}
+
+void RedisServer::cluster_connect_migration() {
+    migration.last_attempt_ms = now_ms();
+    const std::string& target = migration.target;
+    const size_t colon = target.rfind(':');
+    const int fd = connect_nonblocking(target.substr(0, colon), std::stoi(target.substr(colon + 1)));
+    if (fd < 0) return; // retried by the cron
+    clients.emplace(fd, Client {});
+    migration.fd = fd;
+}
+
+void RedisServer::cluster_migration_connected() {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(migration.fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        close_client(migration.fd);
+        return;
+    }
+    migration.connected = true;
+    clients[migration.fd].want_write = false;
+    epoll_event ev { EPOLLIN, { .fd = migration.fd } };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, migration.fd, &ev);
+
+    send_response(migration.fd, "CLUSTER SETSLOT " + std::to_string(migration.slot) + " IMPORTING " + cluster_myself());
+    migration.pending.emplace_back(SlotMigration::Reply::CONTROL, "");
+
+    // keys in flight when the previous connection broke: the ones still here are sent again with
+    // the next batch, the ones deleted meanwhile may have reached the target and are deleted there
+    for (const auto& key : migration.in_flight) {
+        if (kv_store.count(key)) continue;
+        send_response(migration.fd, "ASKING");
+        migration.pending.emplace_back(SlotMigration::Reply::CONTROL, "");
+        send_response(migration.fd, "DEL " + quote_token(key));
+        migration.pending.emplace_back(SlotMigration::Reply::DELETE, key);
+    }
+    migration.in_flight.clear();
+    migration.dirty.clear();
+}
+
+// sends the next batch of keys once everything sent before has been acknowledged
+void RedisServer::cluster_migration_send_batch() {
+    if (!migration.connected || !migration.pending.empty()) return;
+    const auto& keys = slot_keys[migration.slot];
+    if (keys.empty()) {
+        send_response(migration.fd, "CLUSTER SETSLOT " + std::to_string(migration.slot) + " NODE " + migration.target);
+        migration.pending.emplace_back(SlotMigration::Reply::CONTROL, "");
+        migration.handing_over = true;
+        return;
+    }
+    for (const auto& key : keys) {
+        if (migration.pending.size() >= config.cluster_migration_batch) break;
+        std::string payload;
+        kv_store.at(key).serialize(payload);
+        send_response(migration.fd, "RESTORE-ASKING " + quote_token(key) + " " + to_hex(payload) + " REPLACE");
+        migration.pending.emplace_back(SlotMigration::Reply::KEY, key);
+        migration.in_flight.insert(key);
+    }
+}
+
+// one reply line per command sent, in order
+void RedisServer::cluster_migration_read() {
+    auto& buffer = clients[migration.fd].buffer;
+    size_t pos;
+    while ((pos = buffer.find('\n')) != std::string::npos) {
+        const std::string reply = buffer.substr(0, pos);
+        buffer.erase(0, pos + 1);
+        if (migration.pending.empty()) {
+            close_client(migration.fd);
+            return;
+        }
+        const auto [kind, key] = std::move(migration.pending.front());
+        migration.pending.pop_front();
+        if (kind == SlotMigration::Reply::DELETE) continue; // OK or (nil), both are fine
+        if (reply != "OK") {
+            // the target refused, start over with a new connection
+            close_client(migration.fd);
+            return;
+        }
+        if (kind == SlotMigration::Reply::CONTROL) {
+            if (migration.handing_over) {
+                slot_owner[migration.slot] = migration.target;
+                cluster_abort_migration(); // nothing left to abort, resets the state
+                return;
+            }
+            continue;
+        }
+        migration.in_flight.erase(key);
+        if (migration.dirty.erase(key)) {
+            if (!kv_store.count(key)) {
+                // deleted after it was sent, delete the copy on the target too
+                send_response(migration.fd, "ASKING");
+                migration.pending.emplace_back(SlotMigration::Reply::CONTROL, "");
+                send_response(migration.fd, "DEL " + quote_token(key));
+                migration.pending.emplace_back(SlotMigration::Reply::DELETE, key);
+            }
+            continue; // otherwise sent again with the next batch
+        }
+        if (job_keys.count(key)) wait_for_jobs();
+        if (const int before = key_type(key); kv_store.erase(key)) {
+            recount_key(key, before);
+            touch_key(key);
+            propagate({"DEL", key});
+        }
+    }
+    cluster_migration_send_batch();
+}
+
+void RedisServer::cluster_abort_migration() {
+    const int fd = migration.fd;
+    migration = SlotMigration {};
+    if (fd >= 0 && clients.count(fd)) close_client(fd);
+}
+
+void RedisServer::cluster_cron() {
+    if (migration.slot >= 0 && migration.fd < 0 && now_ms() - migration.last_attempt_ms >= 1000) {
+        cluster_connect_migration();
+    }
+}
@@ -0,0 +1,211 @@
+#include "command.h"
+
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+thread_local bool command_failed = false;
+
+constexpr unsigned W = CommandSpec::WRITE;
+constexpr unsigned NS = CommandSpec::NO_SCRIPT;
+constexpr unsigned NP = CommandSpec::NO_PROPAGATE;
+constexpr unsigned AS = CommandSpec::ASKING;
+constexpr unsigned NT = CommandSpec::NO_TOUCH;
+
+const CommandSpec command_table[] = {
+    // String
+    {"GET", 2, 0, 1, 1, 1},
+    {"SET", 3, W, 1, 1, 1},
+    {"SETNX", 3, W, 1, 1, 1},
+    {"INCR", 2, W, 1, 1, 1},
+    {"INCRBY", 3, W, 1, 1, 1},
+    {"INCRBYFLOAT", 3, W, 1, 1, 1},
+    {"STRLEN", 2, 0, 1, 1, 1},
+    {"EXISTS", 2, 0, 1, 1, 1},
+    {"DEL", 2, W, 1, 1, 1},
+    // Keyspace
+    {"KEYS", 2, 0, 0, 0, 0},
+    {"SCAN", -2, 0, 0, 0, 0},
+    {"DELPREFIX", 2, W, 0, 0, 0},
+    {"MEMORY", -2, 0, 0, 0, 0},
+    {"TYPE", 2, NT, 1, 1, 1},
+    {"OBJECT", 3, NT, 2, 2, 1},
+    // Bitmap
+    {"SETBIT", 4, W, 1, 1, 1},
+    {"GETBIT", 3, 0, 1, 1, 1},
+    {"BITCOUNT", -2, 0, 1, 1, 1},
+    {"BITPOS", -3, 0, 1, 1, 1},
+    {"BITOP", -4, W, 2, -1, 1},
+    {"BITFIELD", -2, W, 1, 1, 1},
+    // List
+    {"LPUSH", 3, W, 1, 1, 1},
+    {"LPOP", 2, W, 1, 1, 1},
+    {"RPUSH", 3, W, 1, 1, 1},
+    {"RPOP", 2, W, 1, 1, 1},
+    {"LRANGE", 4, 0, 1, 1, 1},
+    {"LLEN", 2, 0, 1, 1, 1},
+    {"BLPOP", -3, W | NP, 1, -2, 1},
+    {"BRPOP", -3, W | NP, 1, -2, 1},
+    {"BLMOVE", 6, W | NP, 1, 2, 1},
+    // Hash
+    {"HSET", 4, W, 1, 1, 1},
+    {"HGET", 3, 0, 1, 1, 1},
+    {"HGETALL", 2, 0, 1, 1, 1},
+    {"HKEYS", 2, 0, 1, 1, 1},
+    {"HVALS", 2, 0, 1, 1, 1},
+    {"HLEN", 2, 0, 1, 1, 1},
+    {"HSETNX", 4, W, 1, 1, 1},
+    {"HINCRBY", 4, W, 1, 1, 1},
+    {"HINCRBYFLOAT", 4, W, 1, 1, 1},
+    // Set
+    {"SADD", 3, W, 1, 1, 1},
+    {"SREM", 3, W, 1, 1, 1},
+    {"SCARD", 2, 0, 1, 1, 1},
+    {"SISMEMBER", 3, 0, 1, 1, 1},
+    {"SMEMBERS", 2, 0, 1, 1, 1},
+    {"SINTER", 3, 0, 1, 2, 1},
+    {"SUNION", 3, 0, 1, 2, 1},
+    {"SDIFF", 3, 0, 1, 2, 1},
+    // ZSet
+    {"ZADD", 4, W, 1, 1, 1},
+    {"ZREM", 3, W, 1, 1, 1},
+    {"ZSCORE", 3, 0, 1, 1, 1},
+    {"ZRANK", 3, 0, 1, 1, 1},
+    {"ZCARD", 2, 0, 1, 1, 1},
+    {"ZCOUNT", 4, 0, 1, 1, 1},
+    {"ZINCRBY", 4, W, 1, 1, 1},
+    {"ZRANGE", -4, 0, 1, 1, 1},
+    {"ZRANGEBYSCORE", -4, 0, 1, 1, 1},
+    {"ZRANGEBYLEX", -4, 0, 1, 1, 1},
+    {"ZREVRANGEBYLEX", -4, 0, 1, 1, 1},
+    {"ZLEXCOUNT", 4, 0, 1, 1, 1},
+    {"ZREMRANGEBYLEX", 4, W, 1, 1, 1},
+    {"ZINTER", 3, 0, 1, 2, 1},
+    {"ZUNION", 3, 0, 1, 2, 1},
+    {"ZUNIONSTORE", -4, W, 1, 1, 1, 2},
+    {"ZINTERSTORE", -4, W, 1, 1, 1, 2},
+    {"ZDIFFSTORE", -4, W, 1, 1, 1, 2},
+    // Geo
+    {"GEOADD", -5, W, 1, 1, 1},
+    {"GEOPOS", -2, 0, 1, 1, 1},
+    {"GEODIST", -4, 0, 1, 1, 1},
+    {"GEOSEARCH", -7, 0, 1, 1, 1},
+    // HyperLogLog
+    {"PFADD", -2, W, 1, 1, 1},
+    {"PFCOUNT", -2, 0, 1, -1, 1},
+    {"PFMERGE", -2, W, 1, -1, 1},
+    // Stream
+    {"XADD", -5, W, 1, 1, 1},
+    {"XRANGE", -4, 0, 1, 1, 1},
+    {"XREVRANGE", -4, 0, 1, 1, 1},
+    {"XLEN", 2, 0, 1, 1, 1},
+    {"XTRIM", -4, W, 1, 1, 1},
+    {"XGROUP", -4, W, 2, 2, 1},
+    {"XREADGROUP", -7, W, 0, 0, 0, 0, 4},
+    {"XACK", -4, W, 1, 1, 1},
+    {"XPENDING", -3, 0, 1, 1, 1},
+    // Transaction
+    {"MULTI", 1, NS, 0, 0, 0},
+    {"EXEC", 1, NS, 0, 0, 0},
+    {"DISCARD", 1, NS, 0, 0, 0},
+    {"WATCH", -2, NS, 1, -1, 1},
+    {"UNWATCH", 1, NS, 0, 0, 0},
+    // Server
+    {"CONFIG", -2, NS, 0, 0, 0},
+    {"CLIENT", -2, NS, 0, 0, 0},
+    {"INFO", -1, 0, 0, 0, 0},
+    {"LATENCY", -2, NS, 0, 0, 0},
+    {"SLOWLOG", -2, NS, 0, 0, 0},
+    {"HOTKEYS", -1, 0, 0, 0, 0},
+    // Cluster
+    {"CLUSTER", -2, NS, 0, 0, 0},
+    {"ASKING", 1, 0, 0, 0, 0},
+    {"RESTORE", -3, W, 1, 1, 1},
+    {"RESTORE-ASKING", -3, W | AS, 1, 1, 1},
+    // Replication
+    {"PSYNC", 3, NS, 0, 0, 0},
+    {"REPLICAOF", 3, NS, 0, 0, 0},
+    {"ROLE", 1, 0, 0, 0, 0},
+    // Pub/Sub
+    {"PUBLISH", 3, 0, 0, 0, 0},
+    {"SUBSCRIBE", -2, NS, 0, 0, 0},
+    {"UNSUBSCRIBE", -1, NS, 0, 0, 0},
+    {"PSUBSCRIBE", -2, NS, 0, 0, 0},
+    {"PUNSUBSCRIBE", -1, NS, 0, 0, 0},
+    // Scripting
+    {"EVAL", -3, W | NS, 0, 0, 0, 2},
+    {"EVALSHA", -3, W | NS, 0, 0, 0, 2},
+    {"SCRIPT", -2, NS, 0, 0, 0},
+};
+
+} // namespace
+
+bool CommandSpec::arity_ok(const size_t token_count) const {
+    if (arity > 0) return token_count == static_cast<size_t>(arity);
+    return token_count >= static_cast<size_t>(-arity);
+}
+
+const CommandSpec* lookup_command(const std::string& name) {
+    static const auto index = [] {
+        std::unordered_map<std::string, const CommandSpec*> m;
+        for (const auto& spec : command_table) {
+            m.emplace(spec.name, &spec);
+        }
+        return m;
+    }();
+    const auto it = index.find(name);
+    return it == index.end() ? nullptr : it->second;
+}
+
+std::string quote_token(const std::string& token) {
+    std::string quoted = "\"";
+    for (const char c : token) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+std::string command_error(std::string message) {
+    command_failed = true;
+    return message;
+}
+
+bool take_command_error() {
+    return std::exchange(command_failed, false);
+}
+
+std::vector<std::string> command_keys(const CommandSpec& spec, const std::vector<std::string>& tokens) {
+    std::vector<std::string> keys;
+    if (!spec.arity_ok(tokens.size())) return keys;
+    const int size = static_cast<int>(tokens.size());
+    if (spec.first_key > 0) {
+        const int last = spec.last_key < 0 ? size + spec.last_key : spec.last_key;
+        for (int i = spec.first_key; i <= last && i < size; i += spec.step) {
+            keys.push_back(tokens[i]);
+        }
+    }
+    if (spec.keynum_index > 0 && spec.keynum_index < size) {
+        int numkeys;
+        try {
+            numkeys = std::stoi(tokens[spec.keynum_index]);
+        } catch (...) {
+            return keys;
+        }
+        for (int i = spec.keynum_index + 1; i <= spec.keynum_index + numkeys && i < size; ++i) {
+            keys.push_back(tokens[i]);
+        }
+    }
+    if (spec.streams_index > 0) {
+        for (int i = spec.streams_index; i < size; ++i) {
+            std::string token = tokens[i];
+            for (char& c : token) c = static_cast<char>(toupper(c));
+            if (token != "STREAMS") continue;
+            const int rest = size - i - 1;
+            if (rest % 2 == 0) keys.insert(keys.end(), tokens.begin() + i + 1, tokens.begin() + i + 1 + rest / 2);
+            break;
+        }
+    }
+    return keys;
+}
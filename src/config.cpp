@@ -0,0 +1,339 @@
+#include "config.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <arpa/inet.h>
+#include <sys/un.h>
+
+namespace {
+
+bool parse_yes_no(const std::string& value, bool& out) {
+    if (value == "yes") {
+        out = true;
+    } else if (value == "no") {
+        out = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_int(const std::string& value, long long& out) {
+    try {
+        size_t pos;
+        out = std::stoll(value, &pos);
+        return pos == value.size();
+    } catch (...) {
+        return false;
+    }
+}
+
+bool parse_size(const std::string& value, size_t& out) {
+    try {
+        size_t pos;
+        const long long n = std::stoll(value, &pos);
+        if (pos != value.size() || n < 0) return false;
+        out = static_cast<size_t>(n);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+// sizes may end with k, kb, m, mb, g or gb
+bool parse_memory(std::string value, size_t& out) {
+    for (char& c : value) c = static_cast<char>(tolower(c));
+    size_t unit = 1;
+    for (const auto& [suffix, bytes] : {std::pair<const char*, size_t> {"kb", 1024}, {"k", 1000},
+                                        {"mb", 1024 * 1024}, {"m", 1000 * 1000},
+                                        {"gb", 1024 * 1024 * 1024}, {"g", 1000 * 1000 * 1000}}) {
+        const size_t len = std::char_traits<char>::length(suffix);
+        if (value.size() > len && value.compare(value.size() - len, len, suffix) == 0) {
+            value.resize(value.size() - len);
+            unit = bytes;
+            break;
+        }
+    }
+    if (!parse_size(value, out) || out > SIZE_MAX / unit) return false;
+    out *= unit;
+    return true;
+}
+
+const char* const CLIENT_CLASS_NAMES[] = {"normal", "replica", "pubsub"};
+
+} // namespace
+
+std::string ServerConfig::set(const std::string& name, const std::string& value, const bool startup) {
+    if (name == "notify-keyspace-events") {
+        unsigned flags = 0;
+        for (const char c : value) {
+            switch (c) {
+                case 'K': flags |= NOTIFY_KEYSPACE; break;
+                case 'E': flags |= NOTIFY_KEYEVENT; break;
+                case 'g': flags |= NOTIFY_GENERIC; break;
+                case 'x': flags |= NOTIFY_EXPIRED; break;
+                case 'e': flags |= NOTIFY_EVICTED; break;
+                case 'A': flags |= NOTIFY_ALL; break;
+                default: return std::string("Invalid event class character ") + c;
+            }
+        }
+        // without K or E no channel would receive anything
+        if (!(flags & (NOTIFY_KEYSPACE | NOTIFY_KEYEVENT))) flags = 0;
+        notify_flags = flags;
+        notify_keyspace_events = value;
+        return "";
+    }
+    if (name == "tracking-table-max-keys") {
+        if (!parse_size(value, tracking_table_max_keys)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "repl-backlog-size") {
+        size_t size;
+        if (!parse_size(value, size) || size < 16 * 1024) return "Value should be an integer of at least 16384";
+        repl_backlog_size = size;
+        return "";
+    }
+    if (name == "cluster-enabled") {
+        if (!startup) return "Parameter cluster-enabled can only be set at startup";
+        if (!parse_yes_no(value, cluster_enabled)) return "Value should be yes or no";
+        return "";
+    }
+    if (name == "cluster-announce-ip") {
+        if (value.empty() || value.find(':') != std::string::npos) return "Invalid address";
+        cluster_announce_ip = value;
+        return "";
+    }
+    if (name == "cluster-migration-batch") {
+        size_t batch;
+        if (!parse_size(value, batch) || batch == 0) return "Value should be a positive integer";
+        cluster_migration_batch = batch;
+        return "";
+    }
+    if (name == "metrics-port") {
+        if (!startup) return "Parameter metrics-port can only be set at startup";
+        size_t port;
+        if (!parse_size(value, port) || port > 65535) return "Value should be a port number";
+        metrics_port = static_cast<int>(port);
+        return "";
+    }
+    if (name == "slowlog-log-slower-than") {
+        if (!parse_int(value, slowlog_log_slower_than)) return "Value should be an integer";
+        return "";
+    }
+    if (name == "slowlog-max-len") {
+        if (!parse_size(value, slowlog_max_len)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "latency-monitor-threshold") {
+        if (!parse_size(value, latency_monitor_threshold)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "io-backend") {
+        if (!startup) return "Parameter io-backend can only be set at startup";
+        if (value != "epoll" && value != "io_uring") return "Value should be epoll or io_uring";
+        io_backend = value;
+        return "";
+    }
+    if (name == "bind") {
+        if (!startup) return "Parameter bind can only be set at startup";
+        in_addr addr {};
+        if (inet_pton(AF_INET, value.c_str(), &addr) != 1) return "Value should be an IPv4 address";
+        bind = value;
+        return "";
+    }
+    if (name == "tcp-backlog") {
+        if (!startup) return "Parameter tcp-backlog can only be set at startup";
+        size_t backlog;
+        if (!parse_size(value, backlog) || backlog == 0 || backlog > 65535) return "Value should be between 1 and 65535";
+        tcp_backlog = static_cast<int>(backlog);
+        return "";
+    }
+    if (name == "unixsocket") {
+        if (!startup) return "Parameter unixsocket can only be set at startup";
+        if (value.size() >= sizeof(sockaddr_un::sun_path)) return "Path too long";
+        unixsocket = value;
+        return "";
+    }
+    if (name == "unixsocketperm") {
+        if (!startup) return "Parameter unixsocketperm can only be set at startup";
+        try {
+            size_t pos;
+            const unsigned long perm = std::stoul(value, &pos, 8);
+            if (pos != value.size() || perm > 0777) return "Value should be octal permissions";
+            unixsocketperm = static_cast<unsigned>(perm);
+        } catch (...) {
+            return "Value should be octal permissions";
+        }
+        return "";
+    }
+    if (name == "tcp-nodelay") {
+        if (!parse_yes_no(value, tcp_nodelay)) return "Value should be yes or no";
+        return "";
+    }
+    if (name == "tcp-keepalive") {
+        if (!parse_size(value, tcp_keepalive)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "socket-rcvbuf" || name == "socket-sndbuf") {
+        if (!startup) return "Parameter " + name + " can only be set at startup";
+        size_t size;
+        if (!parse_memory(value, size) || size > 1024 * 1024 * 1024) return "Value should be a size of at most 1gb";
+        (name == "socket-rcvbuf" ? socket_rcvbuf : socket_sndbuf) = size;
+        return "";
+    }
+    if (name == "maxclients") {
+        size_t n;
+        if (!parse_size(value, n) || n == 0) return "Value should be a positive integer";
+        maxclients = n;
+        return "";
+    }
+    if (name == "timeout") {
+        if (!parse_size(value, timeout)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "key-index") {
+        if (!startup) return "Parameter key-index can only be set at startup";
+        if (!parse_yes_no(value, key_index)) return "Value should be yes or no";
+        return "";
+    }
+    if (name == "worker-threads") {
+        if (!startup) return "Parameter worker-threads can only be set at startup";
+        size_t n;
+        if (!parse_size(value, n) || n > 256) return "Value should be an integer between 0 and 256";
+        worker_threads = n;
+        return "";
+    }
+    if (name == "worker-min-elements") {
+        if (!parse_size(value, worker_min_elements)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "lfu-log-factor" || name == "lfu-decay-time") {
+        size_t n;
+        if (!parse_size(value, n) || n > 1000000) return "Value should be an integer between 0 and 1000000";
+        (name == "lfu-log-factor" ? lfu_log_factor : lfu_decay_time) = n;
+        return "";
+    }
+    if (name == "hotkeys-decay-time") {
+        if (!parse_size(value, hotkeys_decay_time)) return "Value should be a non-negative integer";
+        return "";
+    }
+    if (name == "client-query-buffer-limit") {
+        size_t limit;
+        if (!parse_memory(value, limit) || limit < 1024) return "Value should be a size of at least 1kb";
+        client_query_buffer_limit = limit;
+        return "";
+    }
+    if (name == "client-output-buffer-limit") {
+        // <class> <hard> <soft> <soft seconds>, for any number of classes
+        std::vector<std::string> words;
+        for (size_t pos = 0; (pos = value.find_first_not_of(' ', pos)) != std::string::npos;) {
+            const size_t end = value.find(' ', pos);
+            words.push_back(value.substr(pos, end - pos));
+            pos = end;
+        }
+        if (words.empty() || words.size() % 4 != 0) return "Value should be groups of <class> <hard> <soft> <seconds>";
+        OutputBufferLimit limits[3];
+        std::copy(std::begin(client_output_buffer_limit), std::end(client_output_buffer_limit), limits);
+        for (size_t i = 0; i < words.size(); i += 4) {
+            std::string cls = words[i];
+            if (cls == "slave") cls = "replica";
+            const auto it = std::find(std::begin(CLIENT_CLASS_NAMES), std::end(CLIENT_CLASS_NAMES), cls);
+            if (it == std::end(CLIENT_CLASS_NAMES)) return "Invalid client class " + words[i];
+            auto& limit = limits[it - std::begin(CLIENT_CLASS_NAMES)];
+            size_t seconds;
+            if (!parse_memory(words[i + 1], limit.hard) || !parse_memory(words[i + 2], limit.soft) ||
+                !parse_size(words[i + 3], seconds)) {
+                return "Invalid limit for class " + words[i];
+            }
+            limit.soft_seconds = seconds;
+        }
+        std::copy(std::begin(limits), std::end(limits), client_output_buffer_limit);
+        return "";
+    }
+    return "Unknown parameter " + name;
+}
+
+bool ServerConfig::get(const std::string& name, std::string& value) const {
+    if (name == "notify-keyspace-events") {
+        value = notify_keyspace_events;
+    } else if (name == "tracking-table-max-keys") {
+        value = std::to_string(tracking_table_max_keys);
+    } else if (name == "repl-backlog-size") {
+        value = std::to_string(repl_backlog_size);
+    } else if (name == "cluster-enabled") {
+        value = cluster_enabled ? "yes" : "no";
+    } else if (name == "cluster-announce-ip") {
+        value = cluster_announce_ip;
+    } else if (name == "cluster-migration-batch") {
+        value = std::to_string(cluster_migration_batch);
+    } else if (name == "metrics-port") {
+        value = std::to_string(metrics_port);
+    } else if (name == "slowlog-log-slower-than") {
+        value = std::to_string(slowlog_log_slower_than);
+    } else if (name == "slowlog-max-len") {
+        value = std::to_string(slowlog_max_len);
+    } else if (name == "latency-monitor-threshold") {
+        value = std::to_string(latency_monitor_threshold);
+    } else if (name == "io-backend") {
+        value = io_backend;
+    } else if (name == "bind") {
+        value = bind;
+    } else if (name == "tcp-backlog") {
+        value = std::to_string(tcp_backlog);
+    } else if (name == "unixsocket") {
+        value = unixsocket;
+    } else if (name == "unixsocketperm") {
+        char perm[8];
+        std::snprintf(perm, sizeof(perm), "%o", unixsocketperm);
+        value = perm;
+    } else if (name == "tcp-nodelay") {
+        value = tcp_nodelay ? "yes" : "no";
+    } else if (name == "tcp-keepalive") {
+        value = std::to_string(tcp_keepalive);
+    } else if (name == "socket-rcvbuf") {
+        value = std::to_string(socket_rcvbuf);
+    } else if (name == "socket-sndbuf") {
+        value = std::to_string(socket_sndbuf);
+    } else if (name == "maxclients") {
+        value = std::to_string(maxclients);
+    } else if (name == "timeout") {
+        value = std::to_string(timeout);
+    } else if (name == "key-index") {
+        value = key_index ? "yes" : "no";
+    } else if (name == "worker-threads") {
+        value = std::to_string(worker_threads);
+    } else if (name == "worker-min-elements") {
+        value = std::to_string(worker_min_elements);
+    } else if (name == "lfu-log-factor") {
+        value = std::to_string(lfu_log_factor);
+    } else if (name == "lfu-decay-time") {
+        value = std::to_string(lfu_decay_time);
+    } else if (name == "hotkeys-decay-time") {
+        value = std::to_string(hotkeys_decay_time);
+    } else if (name == "client-query-buffer-limit") {
+        value = std::to_string(client_query_buffer_limit);
+    } else if (name == "client-output-buffer-limit") {
+        value.clear();
+        for (size_t i = 0; i < std::size(CLIENT_CLASS_NAMES); ++i) {
+            const auto& limit = client_output_buffer_limit[i];
+            if (i) value += " ";
+            value += std::string(CLIENT_CLASS_NAMES[i]) + " " + std::to_string(limit.hard) + " " +
+                     std::to_string(limit.soft) + " " + std::to_string(limit.soft_seconds);
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::vector<std::string> ServerConfig::names() const {
+    return {"notify-keyspace-events", "tracking-table-max-keys", "repl-backlog-size", "cluster-enabled", "cluster-announce-ip",
+            "cluster-migration-batch", "slowlog-log-slower-than", "slowlog-max-len",
+            "latency-monitor-threshold", "metrics-port", "io-backend", "bind", "tcp-backlog", "unixsocket", "unixsocketperm",
+            "tcp-nodelay", "tcp-keepalive", "socket-rcvbuf", "socket-sndbuf", "maxclients", "timeout", "key-index", "worker-threads",
+            "worker-min-elements", "lfu-log-factor", "lfu-decay-time", "hotkeys-decay-time",
+            "client-query-buffer-limit",
+            "client-output-buffer-limit"};
+}
@@ -0,0 +1,119 @@
+#include "geohash.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr double EARTH_RADIUS = 6372797.560856; // meters, the value Redis uses
+constexpr double PI = 3.14159265358979323846;
+
+double to_radians(const double degrees) {
+    return degrees * PI / 180.0;
+}
+
+// the low 32 bits of v spread over the even bits
+uint64_t spread(uint64_t v) {
+    v &= 0xffffffffULL;
+    v = (v | (v << 16)) & 0x0000ffff0000ffffULL;
+    v = (v | (v << 8)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v << 2)) & 0x3333333333333333ULL;
+    v = (v | (v << 1)) & 0x5555555555555555ULL;
+    return v;
+}
+
+uint64_t squash(uint64_t v) {
+    v &= 0x5555555555555555ULL;
+    v = (v | (v >> 1)) & 0x3333333333333333ULL;
+    v = (v | (v >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    v = (v | (v >> 4)) & 0x00ff00ff00ff00ffULL;
+    v = (v | (v >> 8)) & 0x0000ffff0000ffffULL;
+    v = (v | (v >> 16)) & 0x00000000ffffffffULL;
+    return v;
+}
+
+// latitude in the even bits, longitude in the odd ones
+uint64_t interleave(const uint64_t latitude_cell, const uint64_t longitude_cell) {
+    return spread(latitude_cell) | spread(longitude_cell) << 1;
+}
+
+uint64_t cell_of(const double value, const double min, const double max, const int step) {
+    const double offset = (value - min) / (max - min) * static_cast<double>(uint64_t(1) << step);
+    return std::min(static_cast<uint64_t>(offset), (uint64_t(1) << step) - 1);
+}
+
+} // namespace
+
+uint64_t geohash_encode(const double longitude, const double latitude) {
+    return interleave(cell_of(latitude, GEO_LATITUDE_MIN, GEO_LATITUDE_MAX, GEO_STEP_MAX),
+                      cell_of(longitude, GEO_LONGITUDE_MIN, GEO_LONGITUDE_MAX, GEO_STEP_MAX));
+}
+
+void geohash_decode(const uint64_t hash, double& longitude, double& latitude) {
+    constexpr double cells = uint64_t(1) << GEO_STEP_MAX;
+    const double latitude_cell = static_cast<double>(squash(hash)) + 0.5;
+    const double longitude_cell = static_cast<double>(squash(hash >> 1)) + 0.5;
+    latitude = GEO_LATITUDE_MIN + latitude_cell / cells * (GEO_LATITUDE_MAX - GEO_LATITUDE_MIN);
+    longitude = GEO_LONGITUDE_MIN + longitude_cell / cells * (GEO_LONGITUDE_MAX - GEO_LONGITUDE_MIN);
+}
+
+double geo_distance(const double longitude1, const double latitude1, const double longitude2, const double latitude2) {
+    const double u = std::sin((to_radians(latitude2) - to_radians(latitude1)) / 2);
+    const double v = std::sin((to_radians(longitude2) - to_radians(longitude1)) / 2);
+    const double a = u * u + std::cos(to_radians(latitude1)) * std::cos(to_radians(latitude2)) * v * v;
+    return 2.0 * EARTH_RADIUS * std::asin(std::sqrt(a));
+}
+
+std::vector<std::pair<uint64_t, uint64_t>> geohash_ranges(const double longitude, const double latitude,
+                                                          const double width, const double height) {
+    // the box in degrees, its width taken at its latitude nearest to a pole, where it is widest
+    const double half_height = height / 2 / EARTH_RADIUS * 180.0 / PI;
+    const double polar_latitude = std::min(90.0, std::abs(latitude) + half_height);
+    const double cos_polar = std::cos(to_radians(polar_latitude));
+    const double half_width = cos_polar < 1e-9 ? 360.0 : std::min(360.0, width / 2 / (EARTH_RADIUS * cos_polar) * 180.0 / PI);
+    const double south = std::max(GEO_LATITUDE_MIN, latitude - half_height);
+    const double north = std::min(GEO_LATITUDE_MAX, latitude + half_height);
+
+    // the finest step at which the cell of the center and its neighbors cover the box
+    int step = GEO_STEP_MAX;
+    for (; step > 1; --step) {
+        const double cells = static_cast<double>(uint64_t(1) << step);
+        const double cell_height = (GEO_LATITUDE_MAX - GEO_LATITUDE_MIN) / cells;
+        const double cell_width = (GEO_LONGITUDE_MAX - GEO_LONGITUDE_MIN) / cells;
+        const double y = static_cast<double>(cell_of(latitude, GEO_LATITUDE_MIN, GEO_LATITUDE_MAX, step));
+        const double x = static_cast<double>(cell_of(longitude, GEO_LONGITUDE_MIN, GEO_LONGITUDE_MAX, step));
+        const double cell_south = GEO_LATITUDE_MIN + (y - 1) * cell_height;
+        const double cell_north = GEO_LATITUDE_MIN + (y + 2) * cell_height;
+        const double cell_west = GEO_LONGITUDE_MIN + (x - 1) * cell_width;
+        const double cell_east = GEO_LONGITUDE_MIN + (x + 2) * cell_width;
+        if (cell_south <= south && north <= cell_north && cell_west <= longitude - half_width &&
+            longitude + half_width <= cell_east) {
+            break;
+        }
+    }
+
+    const uint64_t cells = uint64_t(1) << step;
+    const uint64_t y = cell_of(latitude, GEO_LATITUDE_MIN, GEO_LATITUDE_MAX, step);
+    const uint64_t x = cell_of(longitude, GEO_LONGITUDE_MIN, GEO_LONGITUDE_MAX, step);
+    const int shift = 2 * (GEO_STEP_MAX - step);
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for (int dy = -1; dy <= 1; ++dy) {
+        if ((y == 0 && dy < 0) || (y == cells - 1 && dy > 0)) continue;
+        for (int dx = -1; dx <= 1; ++dx) {
+            const uint64_t hash = interleave(y + dy, (x + cells + dx) % cells); // the longitude wraps around
+            ranges.emplace_back(hash << shift, (hash + 1) << shift);
+        }
+    }
+    // sorted, with the duplicates of a narrow grid and the adjacent cells merged
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<std::pair<uint64_t, uint64_t>> merged;
+    for (const auto& range : ranges) {
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    return merged;
+}
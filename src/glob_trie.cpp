@@ -0,0 +1,158 @@
+#include "glob_trie.h"
+
+#include <set>
+
+bool GlobTrie::CharClass::contains(const char c) const {
+    bool found = false;
+    for (const auto& [lo, hi] : ranges) {
+        if (lo <= c && c <= hi) {
+            found = true;
+            break;
+        }
+    }
+    return found != negated;
+}
+
+bool GlobTrie::Node::leaf() const {
+    return literals.empty() && !any && !star && classes.empty() && !pattern;
+}
+
+GlobTrie::GlobTrie() : root(std::make_unique<Node>()) {}
+
+GlobTrie::~GlobTrie() = default;
+
+std::vector<GlobTrie::Element> GlobTrie::compile(const std::string& pattern) {
+    std::vector<Element> elements;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        Element e;
+        const char c = pattern[i];
+        if (c == '*') {
+            if (!elements.empty() && elements.back().kind == Element::Kind::STAR) continue; // ** is *
+            e.kind = Element::Kind::STAR;
+        } else if (c == '?') {
+            e.kind = Element::Kind::ANY;
+        } else if (c == '[' && pattern.find(']', i + 1) != std::string::npos) {
+            const size_t end = pattern.find(']', i + 1);
+            e.kind = Element::Kind::CLASS;
+            e.cls.source = pattern.substr(i + 1, end - i - 1);
+            size_t j = 0;
+            if (j < e.cls.source.size() && e.cls.source[j] == '^') {
+                e.cls.negated = true;
+                ++j;
+            }
+            for (; j < e.cls.source.size(); ++j) {
+                char lo = e.cls.source[j];
+                if (lo == '\\' && j + 1 < e.cls.source.size()) lo = e.cls.source[++j];
+                char hi = lo;
+                if (j + 2 < e.cls.source.size() && e.cls.source[j + 1] == '-') {
+                    hi = e.cls.source[j + 2];
+                    j += 2;
+                    if (lo > hi) std::swap(lo, hi);
+                }
+                e.cls.ranges.emplace_back(lo, hi);
+            }
+            i = end;
+        } else {
+            e.kind = Element::Kind::LITERAL;
+            e.literal = c == '\\' && i + 1 < pattern.size() ? pattern[++i] : c;
+        }
+        elements.push_back(std::move(e));
+    }
+    return elements;
+}
+
+std::unique_ptr<GlobTrie::Node>* GlobTrie::child(Node& node, const Element& element) {
+    switch (element.kind) {
+        case Element::Kind::LITERAL:
+            return &node.literals[element.literal];
+        case Element::Kind::ANY:
+            return &node.any;
+        case Element::Kind::STAR:
+            return &node.star;
+        default:
+            for (auto& [cls, next] : node.classes) {
+                if (cls.source == element.cls.source) return &next;
+            }
+            node.classes.emplace_back(element.cls, nullptr);
+            return &node.classes.back().second;
+    }
+}
+
+void GlobTrie::insert(const std::string& pattern) {
+    Node* node = root.get();
+    for (const auto& element : compile(pattern)) {
+        auto* next = child(*node, element);
+        if (!*next) *next = std::make_unique<Node>();
+        node = next->get();
+    }
+    if (!node->pattern) node->pattern = std::make_unique<std::string>(pattern);
+}
+
+// returns true when node became a leaf and can be pruned by its parent
+bool GlobTrie::erase(Node& node, const std::vector<Element>& elements, const size_t i) {
+    if (i == elements.size()) {
+        node.pattern.reset();
+        return node.leaf();
+    }
+    const auto& element = elements[i];
+    switch (element.kind) {
+        case Element::Kind::LITERAL:
+            if (const auto it = node.literals.find(element.literal);
+                it != node.literals.end() && erase(*it->second, elements, i + 1)) {
+                node.literals.erase(it);
+            }
+            break;
+        case Element::Kind::ANY:
+            if (node.any && erase(*node.any, elements, i + 1)) node.any.reset();
+            break;
+        case Element::Kind::STAR:
+            if (node.star && erase(*node.star, elements, i + 1)) node.star.reset();
+            break;
+        default:
+            for (auto it = node.classes.begin(); it != node.classes.end(); ++it) {
+                if (it->first.source == element.cls.source) {
+                    if (erase(*it->second, elements, i + 1)) node.classes.erase(it);
+                    break;
+                }
+            }
+    }
+    return node.leaf();
+}
+
+void GlobTrie::erase(const std::string& pattern) {
+    erase(*root, compile(pattern), 0);
+}
+
+bool GlobTrie::empty() const {
+    return root->leaf();
+}
+
+std::vector<const std::string*> GlobTrie::match(const std::string& subject) const {
+    std::vector<const std::string*> matched;
+    // (node, position in subject) pairs, each explored once so * can not blow up the search
+    std::set<std::pair<const Node*, size_t>> visited;
+    std::vector<std::pair<const Node*, size_t>> stack = {{root.get(), 0}};
+    while (!stack.empty()) {
+        const auto [node, pos] = stack.back();
+        stack.pop_back();
+        if (!visited.emplace(node, pos).second) continue;
+
+        if (pos == subject.size() && node->pattern) matched.push_back(node->pattern.get());
+        if (node->star) {
+            // * consumes zero or more characters
+            for (size_t p = pos; p <= subject.size(); ++p) {
+                stack.emplace_back(node->star.get(), p);
+            }
+        }
+        if (pos == subject.size()) continue;
+        const char c = subject[pos];
+        if (const auto it = node->literals.find(c); it != node->literals.end()) {
+            stack.emplace_back(it->second.get(), pos + 1);
+        }
+        if (node->any) stack.emplace_back(node->any.get(), pos + 1);
+        for (const auto& [cls, next] : node->classes) {
+            if (cls.contains(c)) stack.emplace_back(next.get(), pos + 1);
+        }
+    }
+    return matched;
+}
@@ -0,0 +1,120 @@
+#include "hotkeys.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// one column per row from a single hash, h1 + i * h2 with h2 odd
+void columns_of(const std::string& key, size_t (&columns)[HotKeys::DEPTH]) {
+    const uint64_t h = std::hash<std::string>{}(key);
+    const uint64_t h1 = h & 0xFFFFFFFF, h2 = (h >> 32) | 1;
+    for (size_t row = 0; row < HotKeys::DEPTH; ++row) {
+        columns[row] = row * HotKeys::WIDTH + ((h1 + row * h2) & (HotKeys::WIDTH - 1));
+    }
+}
+
+} // namespace
+
+HotKeys::HotKeys() : reads(DEPTH * WIDTH), writes(DEPTH * WIDTH) {}
+
+uint32_t HotKeys::estimate(const std::vector<uint32_t>& sketch, const size_t (&columns)[DEPTH]) {
+    uint32_t min = sketch[columns[0]];
+    for (size_t row = 1; row < DEPTH; ++row) min = std::min(min, sketch[columns[row]]);
+    return min;
+}
+
+uint32_t HotKeys::increment(std::vector<uint32_t>& sketch, const size_t (&columns)[DEPTH]) {
+    const uint32_t min = estimate(sketch, columns);
+    if (min == UINT32_MAX) return min;
+    for (const size_t column : columns) {
+        if (sketch[column] == min) ++sketch[column];
+    }
+    return min + 1;
+}
+
+void HotKeys::record(const std::string& key, const bool write) {
+    ++accesses_;
+    size_t columns[DEPTH];
+    columns_of(key, columns);
+    const uint64_t r = write ? estimate(reads, columns) : increment(reads, columns);
+    const uint64_t w = write ? increment(writes, columns) : estimate(writes, columns);
+
+    if (const auto it = position.find(key); it != position.end()) {
+        // estimates only grow between two decays, the entry can only move away from the root
+        heap[it->second].reads = r;
+        heap[it->second].writes = w;
+        sift_down(it->second);
+    } else if (heap.size() < CAPACITY) {
+        heap.push_back({key, r, w});
+        position[key] = heap.size() - 1;
+        sift_up(heap.size() - 1);
+    } else if (r + w > heap[0].total()) {
+        position.erase(heap[0].key);
+        heap[0] = {key, r, w};
+        position[key] = 0;
+        sift_down(0);
+    }
+}
+
+void HotKeys::decay() {
+    for (auto& counter : reads) counter >>= 1;
+    for (auto& counter : writes) counter >>= 1;
+    std::vector<Entry> entries;
+    for (auto& entry : heap) {
+        entry.reads >>= 1;
+        entry.writes >>= 1;
+        if (entry.total() > 0) entries.push_back(std::move(entry));
+    }
+    // halving keeps the order, but the keys gone cold leave holes
+    heap = std::move(entries);
+    position.clear();
+    for (size_t i = 0; i < heap.size(); ++i) {
+        position[heap[i].key] = i;
+        sift_up(i);
+    }
+}
+
+void HotKeys::clear() {
+    std::fill(reads.begin(), reads.end(), 0);
+    std::fill(writes.begin(), writes.end(), 0);
+    heap.clear();
+    position.clear();
+    accesses_ = 0;
+}
+
+std::vector<HotKeys::Entry> HotKeys::top(const size_t count) const {
+    std::vector<Entry> sorted = heap;
+    std::sort(sorted.begin(), sorted.end(), [](const Entry& a, const Entry& b) {
+        return a.total() != b.total() ? a.total() > b.total() : a.key < b.key;
+    });
+    if (sorted.size() > count) sorted.resize(count);
+    return sorted;
+}
+
+void HotKeys::sift_up(size_t i) {
+    while (i > 0) {
+        const size_t parent = (i - 1) / 2;
+        if (heap[parent].total() <= heap[i].total()) break;
+        swap_entries(i, parent);
+        i = parent;
+    }
+}
+
+void HotKeys::sift_down(size_t i) {
+    while (true) {
+        size_t smallest = i;
+        for (const size_t child : {2 * i + 1, 2 * i + 2}) {
+            if (child < heap.size() && heap[child].total() < heap[smallest].total()) smallest = child;
+        }
+        if (smallest == i) break;
+        swap_entries(i, smallest);
+        i = smallest;
+    }
+}
+
+void HotKeys::swap_entries(const size_t i, const size_t j) {
+    std::swap(heap[i], heap[j]);
+    position[heap[i].key] = i;
+    position[heap[j].key] = j;
+}
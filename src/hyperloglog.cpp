@@ -0,0 +1,287 @@
+#include "hyperloglog.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint8_t ZERO = 0x00;  // 00xxxxxx
+constexpr uint8_t XZERO = 0x40; // 01xxxxxx yyyyyyyy
+constexpr uint8_t VAL = 0x80;   // 1vvvvvxx
+constexpr size_t ZERO_MAX_LEN = 64;
+constexpr size_t XZERO_MAX_LEN = 16384;
+constexpr uint8_t VAL_MAX_VALUE = 32;
+constexpr size_t VAL_MAX_LEN = 4;
+constexpr int Q = 64 - HyperLogLog::P; // bits of the hash left after the register index
+
+uint64_t murmur_hash64a(const std::string& key, const uint64_t seed) {
+    constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+    constexpr int r = 47;
+    const size_t len = key.size();
+    uint64_t h = seed ^ (len * m);
+    const auto* data = reinterpret_cast<const unsigned char*>(key.data());
+    const unsigned char* end = data + (len - len % 8);
+    for (; data != end; data += 8) {
+        uint64_t k;
+        std::memcpy(&k, data, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    switch (len & 7) {
+        case 7: h ^= static_cast<uint64_t>(data[6]) << 48; [[fallthrough]];
+        case 6: h ^= static_cast<uint64_t>(data[5]) << 40; [[fallthrough]];
+        case 5: h ^= static_cast<uint64_t>(data[4]) << 32; [[fallthrough]];
+        case 4: h ^= static_cast<uint64_t>(data[3]) << 24; [[fallthrough]];
+        case 3: h ^= static_cast<uint64_t>(data[2]) << 16; [[fallthrough]];
+        case 2: h ^= static_cast<uint64_t>(data[1]) << 8; [[fallthrough]];
+        case 1:
+            h ^= static_cast<uint64_t>(data[0]);
+            h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// length in registers and value of the opcode at p, advances p
+size_t decode(const std::string& s, size_t& p, uint8_t& value) {
+    const auto op = static_cast<uint8_t>(s[p]);
+    if (op & VAL) {
+        ++p;
+        value = ((op >> 2) & 0x1f) + 1;
+        return (op & 0x3) + 1;
+    }
+    value = 0;
+    if (op & XZERO) {
+        const size_t len = ((op & 0x3f) << 8 | static_cast<uint8_t>(s[p + 1])) + 1;
+        p += 2;
+        return len;
+    }
+    ++p;
+    return (op & 0x3f) + 1;
+}
+
+void append_zeros(std::string& out, size_t len) {
+    while (len > 0) {
+        if (len <= ZERO_MAX_LEN) {
+            out += static_cast<char>(ZERO | (len - 1));
+            return;
+        }
+        const size_t n = std::min(len, XZERO_MAX_LEN);
+        out += static_cast<char>(XZERO | ((n - 1) >> 8));
+        out += static_cast<char>((n - 1) & 0xff);
+        len -= n;
+    }
+}
+
+void append_values(std::string& out, const uint8_t value, size_t len) {
+    for (; len > 0; len -= std::min(len, VAL_MAX_LEN)) {
+        out += static_cast<char>(VAL | (value - 1) << 2 | (std::min(len, VAL_MAX_LEN) - 1));
+    }
+}
+
+// Ertl's improved estimator, from the number of registers holding each value
+uint64_t estimate_from_histogram(const uint32_t (&histogram)[Q + 2]) {
+    constexpr double m = HyperLogLog::REGISTERS;
+    const auto sigma = [](double x) {
+        if (x == 1.0) return HUGE_VAL;
+        double y = 1.0, z = x, previous;
+        do {
+            x *= x;
+            previous = z;
+            z += x * y;
+            y += y;
+        } while (previous != z);
+        return z;
+    };
+    const auto tau = [](double x) {
+        if (x == 0.0 || x == 1.0) return 0.0;
+        double y = 1.0, z = 1.0 - x, previous;
+        do {
+            x = std::sqrt(x);
+            previous = z;
+            y *= 0.5;
+            z -= std::pow(1.0 - x, 2) * y;
+        } while (previous != z);
+        return z / 3.0;
+    };
+    double z = m * tau((m - histogram[Q + 1]) / m);
+    for (int j = Q; j >= 1; --j) {
+        z += histogram[j];
+        z *= 0.5;
+    }
+    z += m * sigma(histogram[0] / m);
+    return static_cast<uint64_t>(std::llround(0.5 / std::log(2.0) * m * m / z));
+}
+
+uint8_t dense_get(const std::string& d, const size_t index) {
+    const size_t bit = index * 6, b = bit / 8, fb = bit % 8;
+    unsigned v = static_cast<uint8_t>(d[b]) >> fb;
+    if (fb > 2) v |= static_cast<unsigned>(static_cast<uint8_t>(d[b + 1])) << (8 - fb);
+    return v & 63;
+}
+
+void dense_set(std::string& d, const size_t index, const uint8_t value) {
+    const size_t bit = index * 6, b = bit / 8, fb = bit % 8;
+    d[b] = static_cast<char>((static_cast<uint8_t>(d[b]) & ~(63u << fb)) | (value << fb));
+    if (fb > 2) {
+        d[b + 1] = static_cast<char>((static_cast<uint8_t>(d[b + 1]) & ~(63u >> (8 - fb))) | (value >> (8 - fb)));
+    }
+}
+
+} // namespace
+
+HyperLogLog::HyperLogLog() {
+    append_zeros(data, REGISTERS);
+}
+
+bool HyperLogLog::from_bytes(const bool sparse, const std::string& bytes, HyperLogLog& out) {
+    if (sparse) {
+        size_t registers = 0;
+        for (size_t p = 0; p < bytes.size();) {
+            if ((static_cast<uint8_t>(bytes[p]) & (VAL | XZERO)) == XZERO && p + 1 >= bytes.size()) return false;
+            uint8_t value;
+            registers += decode(bytes, p, value);
+        }
+        if (registers != REGISTERS) return false;
+    } else {
+        if (bytes.size() != DENSE_BYTES) return false;
+        // a register holds at most Q + 1, the histograms of the estimate have no room for more
+        for (size_t i = 0; i < REGISTERS; ++i) {
+            if (dense_get(bytes, i) > Q + 1) return false;
+        }
+    }
+    out.data = bytes;
+    out.sparse_ = sparse;
+    out.cache_valid = false;
+    return true;
+}
+
+bool HyperLogLog::add(const std::string& element) {
+    uint64_t hash = murmur_hash64a(element, 0xadc83b19ULL);
+    const size_t index = hash & (REGISTERS - 1);
+    hash >>= P;
+    hash |= uint64_t(1) << Q; // the run of zeros ends by Q at the latest
+    return set_register(index, static_cast<uint8_t>(__builtin_ctzll(hash) + 1));
+}
+
+bool HyperLogLog::set_register(const size_t index, const uint8_t value) {
+    bool changed;
+    if (sparse_ && value > VAL_MAX_VALUE) promote();
+    if (sparse_) {
+        changed = sparse_set(index, value);
+        if (changed && data.size() > SPARSE_MAX_BYTES) promote();
+    } else {
+        changed = dense_get(data, index) < value;
+        if (changed) dense_set(data, index, value);
+    }
+    if (changed) cache_valid = false;
+    return changed;
+}
+
+// splits the run holding the register into the part before it, the register, and the part after
+bool HyperLogLog::sparse_set(const size_t index, const uint8_t value) {
+    size_t p = 0, first = 0, len = 0;
+    uint8_t current = 0;
+    while (p < data.size()) {
+        const size_t start = p;
+        len = decode(data, p, current);
+        if (index < first + len) {
+            if (current >= value) return false;
+            std::string replacement;
+            const auto append_run = [&](const size_t n) {
+                current ? append_values(replacement, current, n) : append_zeros(replacement, n);
+            };
+            append_run(index - first);
+            append_values(replacement, value, 1);
+            append_run(first + len - index - 1);
+            data.replace(start, p - start, replacement);
+            return true;
+        }
+        first += len;
+    }
+    return false;
+}
+
+void HyperLogLog::promote() {
+    Registers registers(REGISTERS, 0);
+    merge_into(registers);
+    assign(registers);
+}
+
+uint64_t HyperLogLog::count() const {
+    if (cache_valid) return cached_count;
+    uint32_t histogram[Q + 2] = {};
+    if (sparse_) {
+        for (size_t p = 0; p < data.size();) {
+            uint8_t value;
+            const size_t len = decode(data, p, value);
+            histogram[value] += len;
+        }
+    } else {
+        for (size_t i = 0; i < REGISTERS; ++i) {
+            ++histogram[dense_get(data, i)];
+        }
+    }
+    cached_count = estimate_from_histogram(histogram);
+    cache_valid = true;
+    return cached_count;
+}
+
+void HyperLogLog::merge_into(Registers& registers) const {
+    if (sparse_) {
+        size_t index = 0;
+        for (size_t p = 0; p < data.size();) {
+            uint8_t value;
+            const size_t len = decode(data, p, value);
+            if (value) {
+                for (size_t i = index; i < index + len; ++i) {
+                    registers[i] = std::max(registers[i], value);
+                }
+            }
+            index += len;
+        }
+        return;
+    }
+    // four registers in every three bytes, unpacked without branches so that the loop vectorizes;
+    // values are clamped to Q + 1 so that no out of range register reaches the estimate
+    const auto* d = reinterpret_cast<const uint8_t*>(data.data());
+    uint8_t* r = registers.data();
+    const auto merge = [](const uint8_t current, const unsigned value) {
+        return std::max<uint8_t>(current, static_cast<uint8_t>(std::min<unsigned>(value, Q + 1)));
+    };
+    for (size_t i = 0, b = 0; i < REGISTERS; i += 4, b += 3) {
+        const uint8_t b0 = d[b], b1 = d[b + 1], b2 = d[b + 2];
+        r[i] = merge(r[i], b0 & 63);
+        r[i + 1] = merge(r[i + 1], (b0 >> 6 | b1 << 2) & 63);
+        r[i + 2] = merge(r[i + 2], (b1 >> 4 | b2 << 4) & 63);
+        r[i + 3] = merge(r[i + 3], b2 >> 2);
+    }
+}
+
+void HyperLogLog::assign(const Registers& registers) {
+    std::string dense(DENSE_BYTES, '\0');
+    auto* d = reinterpret_cast<uint8_t*>(dense.data());
+    const uint8_t* r = registers.data();
+    for (size_t i = 0, b = 0; i < REGISTERS; i += 4, b += 3) {
+        d[b] = static_cast<uint8_t>(r[i] | r[i + 1] << 6);
+        d[b + 1] = static_cast<uint8_t>(r[i + 1] >> 2 | r[i + 2] << 4);
+        d[b + 2] = static_cast<uint8_t>(r[i + 2] >> 4 | r[i + 3] << 2);
+    }
+    data = std::move(dense);
+    sparse_ = false;
+    cache_valid = false;
+}
+
+uint64_t HyperLogLog::estimate(const Registers& registers) {
+    uint32_t histogram[Q + 2] = {};
+    for (const uint8_t value : registers) {
+        ++histogram[value];
+    }
+    return estimate_from_histogram(histogram);
+}
@@ -0,0 +1,192 @@
+#include "io_uring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+int io_uring_setup(const unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int io_uring_enter(const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags,
+                   const void* arg, const size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+int io_uring_register(const int fd, const unsigned opcode, const void* arg, const unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+void* map(const size_t size, const int fd, const off_t offset) {
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? nullptr : p;
+}
+
+} // namespace
+
+IoUring::~IoUring() {
+    if (buffer_base) munmap(buffer_base, buffers_size);
+    if (buf_ring) munmap(buf_ring, buf_ring_size);
+    if (sqes) munmap(sqes, sqes_size);
+    if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+    if (sq_ring) munmap(sq_ring, sq_ring_size);
+    if (fd >= 0) close(fd);
+}
+
+bool IoUring::init(const unsigned entries) {
+    io_uring_params params {};
+    // completions are only reaped by this thread, in wait(), which lets the kernel defer its
+    // completion work to that point instead of interrupting the event loop
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER |
+                   IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = entries * 4; // multishot requests post many completions per submission
+    fd = io_uring_setup(entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        params = {};
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        fd = io_uring_setup(entries, &params);
+    }
+    if (fd < 0) return false;
+    ext_arg = params.features & IORING_FEAT_EXT_ARG;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring = map(sq_ring_size, fd, IORING_OFF_SQ_RING);
+    if (!sq_ring) return false;
+    cq_ring = params.features & IORING_FEAT_SINGLE_MMAP ? sq_ring : map(cq_ring_size, fd, IORING_OFF_CQ_RING);
+    if (!cq_ring) return false;
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = static_cast<io_uring_sqe*>(map(sqes_size, fd, IORING_OFF_SQES));
+    if (!sqes) return false;
+
+    auto* sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sq_entries = params.sq_entries;
+    sqe_tail = *sq_tail;
+    // the indirection array is never used for anything but the identity
+    for (unsigned i = 0; i < sq_entries; ++i) {
+        sq_array[i] = i;
+    }
+    auto* cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool IoUring::supports(const std::initializer_list<uint8_t> opcodes) const {
+    constexpr unsigned OPS = 256;
+    std::vector<char> buffer(sizeof(io_uring_probe) + OPS * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+    if (io_uring_register(fd, IORING_REGISTER_PROBE, probe, OPS) < 0) return false;
+    for (const uint8_t op : opcodes) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+bool IoUring::sq_full() const {
+    return sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+    if (overflow.empty() && sq_full()) submit(0, 0);
+    // the kernel takes fewer entries than it is given when it is short of memory or its completion
+    // queue overflowed, a slot it has not consumed yet must not be reused
+    if (!overflow.empty() || sq_full()) return &overflow.emplace_back();
+    io_uring_sqe* sqe = &sqes[sqe_tail & *sq_mask];
+    ++sqe_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void IoUring::flush_overflow() {
+    while (!overflow.empty() && !sq_full()) {
+        sqes[sqe_tail & *sq_mask] = overflow.front();
+        ++sqe_tail;
+        overflow.pop_front();
+    }
+}
+
+int IoUring::submit(unsigned wait_nr, const int timeout_ms) {
+    flush_overflow();
+    const unsigned to_submit = sqe_tail - *sq_tail;
+    __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    if (wait_nr && timeout_ms >= 0 && ext_arg) {
+        __kernel_timespec ts {timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+        io_uring_getevents_arg arg {};
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        return io_uring_enter(fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+    if (wait_nr && timeout_ms >= 0 && !sq_full()) {
+        // kernels without IORING_FEAT_EXT_ARG: a timeout request completes the wait instead
+        io_uring_sqe* sqe = get_sqe();
+        static __kernel_timespec ts;
+        ts = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000LL};
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = reinterpret_cast<uint64_t>(&ts);
+        sqe->len = 1;
+        sqe->user_data = 0;
+        __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+        return io_uring_enter(fd, to_submit + 1, wait_nr, flags, nullptr, 0);
+    }
+    // without room for the timeout request the wait could last forever, the loop comes back instead
+    if (timeout_ms >= 0 && !ext_arg) wait_nr = 0;
+    return io_uring_enter(fd, to_submit, wait_nr, wait_nr ? flags : 0, nullptr, 0);
+}
+
+int IoUring::wait(const int timeout_ms) {
+    // completions already posted, from a submission made while the queue was full, need no wait
+    const bool ready = *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    const int rc = submit(ready ? 0 : 1, timeout_ms);
+    return rc < 0 && (errno == ETIME || errno == EINTR) ? 0 : rc;
+}
+
+bool IoUring::setup_buffers(const uint16_t group, const unsigned count, const unsigned size) {
+    // count must be a power of two
+    buf_ring_size = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) return false;
+    buf_ring = static_cast<io_uring_buf*>(ring);
+    io_uring_buf_reg reg {};
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (io_uring_register(fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+    buffers_size = static_cast<size_t>(count) * size;
+    void* buffers = mmap(nullptr, buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffers == MAP_FAILED) return false;
+    buffer_base = static_cast<char*>(buffers);
+    buffer_size = size;
+    buf_mask = count - 1;
+    for (unsigned i = 0; i < count; ++i) {
+        recycle_buffer(static_cast<uint16_t>(i));
+    }
+    return true;
+}
+
+void IoUring::recycle_buffer(const uint16_t id) {
+    io_uring_buf& buf = buf_ring[buf_tail & buf_mask];
+    buf.addr = reinterpret_cast<uint64_t>(buffer(id));
+    buf.len = buffer_size;
+    buf.bid = id;
+    // the tail shares its place with the reserved field of the first entry
+    __atomic_store_n(&buf_ring[0].resv, ++buf_tail, __ATOMIC_RELEASE);
+}
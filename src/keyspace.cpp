@@ -0,0 +1,329 @@
+#include "server.h"
+#include "cycle_clock.h"
+
+#include <algorithm>
+#include <map>
+
+// KEYS, SCAN, DELPREFIX and MEMORY PREFIXES. With key-index enabled the key names are also kept in
+// a radix tree, updated wherever slot_keys is, so that a pattern starting with a literal prefix
+// only visits the keys below that prefix and SCAN walks the keys in lexicographic order; without
+// it every key of kv_store is looked at.
+//
+// MEMORY USAGE counts what the allocator hands out for a key: its node in kv_store, the strings
+// that do not fit in place, and every node, bucket array and vector of the value, sampling the
+// first elements of large containers. TYPE and OBJECT look at a key without counting as an access.
+
+namespace {
+
+std::string to_hex(const std::string& data) {
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(data.size() * 2);
+    for (const char c : data) {
+        out += hex[(static_cast<unsigned char>(c) >> 4) & 0xF];
+        out += hex[static_cast<unsigned char>(c) & 0xF];
+    }
+    return out;
+}
+
+bool from_hex(const std::string& hex, std::string& out) {
+    if (hex.size() % 2 != 0) return false;
+    const auto nibble = [](const char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    out.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        const int hi = nibble(hex[i]), lo = nibble(hex[i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        out += static_cast<char>(hi << 4 | lo);
+    }
+    return true;
+}
+
+// The literal characters every subject matching pattern starts with. all_match is set when any
+// subject with that prefix matches, that is when only a * follows it.
+std::string glob_prefix(const std::string& pattern, bool& all_match) {
+    std::string prefix;
+    size_t i = 0;
+    for (; i < pattern.size(); ++i) {
+        const char c = pattern[i];
+        if (c == '*' || c == '?' || (c == '[' && pattern.find(']', i + 1) != std::string::npos)) break;
+        if (c == '\\' && i + 1 < pattern.size()) ++i;
+        prefix += pattern[i];
+    }
+    all_match = i < pattern.size() && pattern.find_first_not_of('*', i) == std::string::npos;
+    return prefix;
+}
+
+// one pattern, matched the way the Pub/Sub patterns are
+class GlobMatcher {
+public:
+    explicit GlobMatcher(const std::string& pattern) : prefix(glob_prefix(pattern, all_match)) {
+        trie.insert(pattern);
+    }
+    bool operator()(const std::string& subject) const {
+        if (subject.compare(0, prefix.size(), prefix) != 0) return false;
+        return all_match || !trie.match(subject).empty();
+    }
+    const std::string& literal_prefix() const { return prefix; }
+
+private:
+    bool all_match = false;
+    std::string prefix;
+    GlobTrie trie;
+};
+
+std::string format_list(const std::vector<std::string>& items) {
+    std::string result;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) result += "\n";
+        result += std::to_string(i + 1) + ") " + items[i];
+    }
+    return result.empty() ? "(empty array)" : result;
+}
+
+} // namespace
+
+// keeps key_index in sync with kv_store, called for every modified key
+void RedisServer::key_index_update(const std::string& key) {
+    if (!config.key_index) return;
+    if (kv_store.count(key)) {
+        key_index.insert(key);
+    } else {
+        key_index.erase(key);
+    }
+}
+
+void RedisServer::key_index_rebuild() {
+    if (!config.key_index) return;
+    key_index.clear();
+    for (const auto& [key, ro] : kv_store) {
+        key_index.insert(key);
+    }
+}
+
+void RedisServer::for_each_key(const std::string& prefix, const std::function<void(const std::string&)>& fn) const {
+    if (config.key_index) {
+        key_index.visit(prefix, "", [&](const std::string& key) {
+            fn(key);
+            return true;
+        });
+        return;
+    }
+    for (const auto& [key, ro] : kv_store) {
+        if (key.compare(0, prefix.size(), prefix) == 0) fn(key);
+    }
+}
+
+std::string RedisServer::keys_command(const std::vector<std::string>& tokens) const {
+    const GlobMatcher match(tokens[1]);
+    std::vector<std::string> keys;
+    for_each_key(match.literal_prefix(), [&](const std::string& key) {
+        if (match(key)) keys.push_back(key);
+    });
+    return format_list(keys);
+}
+
+// SCAN cursor [MATCH pattern] [COUNT count], replies with the next cursor followed by the keys
+// found, the cursor being 0 once the iteration is over. COUNT is the number of keys looked at.
+// With key-index the cursor is the next key in hex, so that a key present for the whole
+// iteration is returned exactly once however the keyspace changes; without it the cursor is a
+// bucket of kv_store, and a key may be missed or repeated when the table is resized meanwhile.
+std::string RedisServer::scan_command(const std::vector<std::string>& tokens) const {
+    std::string pattern = "*";
+    size_t count = 10;
+    for (size_t i = 2; i < tokens.size(); i += 2) {
+        std::string option = tokens[i];
+        for (char& c : option) c = static_cast<char>(toupper(c));
+        if (i + 1 >= tokens.size()) return command_error("Incorrect argument number");
+        if (option == "MATCH") {
+            pattern = tokens[i + 1];
+        } else if (option == "COUNT") {
+            try {
+                size_t pos;
+                const long long n = std::stoll(tokens[i + 1], &pos);
+                if (pos != tokens[i + 1].size() || n <= 0) return command_error("Count should be a positive integer");
+                count = static_cast<size_t>(n);
+            } catch (...) {
+                return command_error("Count should be a positive integer");
+            }
+        } else {
+            return command_error("Unknown option " + tokens[i]);
+        }
+    }
+    const GlobMatcher match(pattern);
+    std::vector<std::string> items = {"0"};
+
+    if (config.key_index) {
+        std::string from = match.literal_prefix();
+        if (tokens[1] != "0") {
+            std::string next;
+            if (!from_hex(tokens[1], next)) return command_error("Invalid cursor");
+            from = std::max(from, next);
+        }
+        size_t seen = 0;
+        key_index.visit(match.literal_prefix(), from, [&](const std::string& key) {
+            if (seen++ == count) {
+                items[0] = to_hex(key);
+                return false;
+            }
+            if (match(key)) items.push_back(key);
+            return true;
+        });
+    } else {
+        size_t bucket;
+        try {
+            size_t pos;
+            bucket = std::stoull(tokens[1], &pos);
+            if (pos != tokens[1].size()) return command_error("Invalid cursor");
+        } catch (...) {
+            return command_error("Invalid cursor");
+        }
+        size_t seen = 0;
+        for (; bucket < kv_store.bucket_count() && seen < count; ++bucket) {
+            for (auto it = kv_store.begin(bucket); it != kv_store.end(bucket); ++it) {
+                ++seen;
+                if (match(it->first)) items.push_back(it->first);
+            }
+        }
+        if (bucket < kv_store.bucket_count()) items[0] = std::to_string(bucket);
+    }
+
+    std::string result;
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (i > 0) result += "\n";
+        result += std::to_string(i + 1) + ") " + items[i];
+    }
+    return result;
+}
+
+// DELPREFIX prefix: deletes every key starting with prefix, replies with their number. It names
+// no key, so in a cluster it only deletes the keys of this node.
+std::string RedisServer::del_prefix_command(const std::vector<std::string>& tokens) {
+    if (!job_keys.empty()) wait_for_jobs();
+    std::vector<std::string> keys;
+    for_each_key(tokens[1], [&](const std::string& key) { keys.push_back(key); });
+    for (const auto& key : keys) {
+        const int before = key_type(key);
+        kv_store.erase(key);
+        recount_key(key, before);
+        notify_keyspace_event(NOTIFY_GENERIC, "del", key);
+        touch_key(key);
+    }
+    return std::to_string(keys.size());
+}
+
+// MEMORY PREFIXES [prefix] [DELIMITER delimiter] [COUNT count]: the keys starting with prefix
+// grouped by their name up to the next delimiter (":" by default), the largest groups first, each
+// with its number of keys and their bytes; keys without a further delimiter are counted under
+// prefix itself
+std::string RedisServer::memory_command(const std::vector<std::string>& tokens) {
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub == "PREFIXES") {
+        std::string prefix, delimiter = ":";
+        size_t count = 10;
+        size_t i = 2;
+        if (i < tokens.size() && tokens.size() % 2 == 1) prefix = tokens[i++];
+        for (; i + 1 < tokens.size(); i += 2) {
+            std::string option = tokens[i];
+            for (char& c : option) c = static_cast<char>(toupper(c));
+            if (option == "DELIMITER" && !tokens[i + 1].empty()) {
+                delimiter = tokens[i + 1];
+            } else if (option == "COUNT") {
+                try {
+                    size_t pos;
+                    const long long n = std::stoll(tokens[i + 1], &pos);
+                    if (pos != tokens[i + 1].size() || n <= 0) {
+                        return command_error("Count should be a positive integer");
+                    }
+                    count = static_cast<size_t>(n);
+                } catch (...) {
+                    return command_error("Count should be a positive integer");
+                }
+            } else {
+                return command_error("Unknown option " + tokens[i]);
+            }
+        }
+        if (i != tokens.size()) return command_error("Incorrect argument number");
+
+        std::map<std::string, std::pair<size_t, size_t>> groups; // name -> keys, bytes
+        for_each_key(prefix, [&](const std::string& key) {
+            const size_t end = key.find(delimiter, prefix.size());
+            auto& [keys, bytes] = groups[end == std::string::npos ? prefix : key.substr(0, end + delimiter.size())];
+            ++keys;
+            bytes += key_memory_usage(key, kv_store.at(key), 0);
+        });
+        std::vector<std::pair<std::string, std::pair<size_t, size_t>>> sorted(groups.begin(), groups.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const auto& a, const auto& b) { return a.second.second > b.second.second; });
+        if (sorted.size() > count) sorted.resize(count);
+        std::vector<std::string> items;
+        for (const auto& [name, stats] : sorted) {
+            items.push_back(name + " " + std::to_string(stats.first) + " " + std::to_string(stats.second));
+        }
+        return format_list(items);
+    }
+    if (sub == "USAGE" && (tokens.size() == 3 || tokens.size() == 5)) {
+        // MEMORY USAGE key [SAMPLES count], 0 samples every element
+        size_t samples = 5;
+        if (tokens.size() == 5) {
+            std::string option = tokens[3];
+            for (char& c : option) c = static_cast<char>(toupper(c));
+            if (option != "SAMPLES") return command_error("Unknown option " + tokens[3]);
+            try {
+                size_t pos;
+                const long long n = std::stoll(tokens[4], &pos);
+                if (pos != tokens[4].size() || n < 0) return command_error("Samples should be a non-negative integer");
+                samples = static_cast<size_t>(n);
+            } catch (...) {
+                return command_error("Samples should be a non-negative integer");
+            }
+        }
+        const auto it = kv_store.find(tokens[2]);
+        if (it == kv_store.end()) return "(nil)";
+        return std::to_string(key_memory_usage(it->first, it->second, samples));
+    }
+    return command_error("Unknown MEMORY subcommand or incorrect argument number");
+}
+
+// the node of kv_store holding the key (next pointer, key, object, cached hash), the key's
+// characters when they do not fit in place, and the value beyond the object
+size_t RedisServer::key_memory_usage(const std::string& key, const RedisObject& ro, const size_t samples) const {
+    size_t bytes = allocation_size(sizeof(void*) + sizeof(decltype(kv_store)::value_type) + sizeof(size_t));
+    if (key.capacity() > 15) bytes += allocation_size(key.capacity() + 1);
+    return bytes + ro.memory_usage(samples) - sizeof(RedisObject);
+}
+
+std::string RedisServer::type_command(const std::vector<std::string>& tokens) const {
+    const auto it = kv_store.find(tokens[1]);
+    return it == kv_store.end() ? "none" : it->second.type_name();
+}
+
+// OBJECT ENCODING|IDLETIME|FREQ key
+std::string RedisServer::object_command(const std::vector<std::string>& tokens) const {
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub != "ENCODING" && sub != "IDLETIME" && sub != "FREQ") {
+        return command_error("Unknown OBJECT subcommand " + tokens[1]);
+    }
+    const auto it = kv_store.find(tokens[2]);
+    if (it == kv_store.end()) return "(nil)";
+    if (sub == "ENCODING") return it->second.encoding_name();
+    if (sub == "IDLETIME") return std::to_string(it->second.idle_ms(now_ms()) / 1000);
+    return std::to_string(it->second.freq(now_ms(), static_cast<unsigned>(config.lfu_decay_time)));
+}
+
+void RedisServer::record_access(const CommandSpec& spec, const std::vector<std::string>& tokens) {
+    if (spec.first_key == 0) return;
+    const uint64_t now = now_ms();
+    for (const auto& key : command_keys(spec, tokens)) {
+        if (const auto it = kv_store.find(key); it != kv_store.end()) {
+            it->second.touch(now, static_cast<unsigned>(config.lfu_log_factor),
+                             static_cast<unsigned>(config.lfu_decay_time));
+        }
+    }
+}
@@ -1,7 +1,28 @@
 #include "server.h"
 
-int main() {
-    RedisServer server(6379);
+#include <iostream>
+#include <string>
+
+int port = 6379;
+ServerConfig config;
+
+// -port N, or -<parameter> <value> for any CONFIG parameter
+void parse_args(const int argc, char* argv[]) {
+    for (int i = 1; i < argc - 1; ++i) {
+        if (std::string arg = argv[i]; arg == "-port") {
+            port = std::stoi(argv[++i]);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            if (const std::string error = config.set(arg.substr(1), argv[++i], true); !error.empty()) {
+                std::cerr << error << std::endl;
+                exit(1);
+            }
+        }
+    }
+}
+
+int main(const int argc, char* argv[]) {
+    parse_args(argc, argv);
+    RedisServer server(port, config);
     server.run();
     return 0;
 }
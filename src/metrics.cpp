@@ -0,0 +1,201 @@
+#include "server.h"
+#include "cycle_clock.h"
+
+#include <cstdio>
+#include <malloc.h>
+#include <unistd.h>
+
+// OpenMetrics exporter: with metrics-port set, a second listening socket in the same epoll loop
+// answers HTTP GET /metrics with the counters INFO reports, the per command histograms and the
+// event loop iteration times. A scrape only reads counters the event loop already keeps: the
+// per type key counts are updated wherever keys are written, from the type of each key before and
+// after the change.
+
+namespace {
+
+constexpr size_t HTTP_MAX_REQUEST = 8192;
+
+std::string lower(std::string s) {
+    for (char& c : s) c = static_cast<char>(tolower(c));
+    return s;
+}
+
+std::string seconds(const double s) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", s);
+    return buf;
+}
+
+class MetricsWriter {
+public:
+    void family(const std::string& name, const std::string& type, const std::string& help) {
+        out += "# TYPE " + name + " " + type + "\n# HELP " + name + " " + help + "\n";
+    }
+
+    void sample(const std::string& name, const std::string& labels, const std::string& value) {
+        out += name + (labels.empty() ? "" : "{" + labels + "}") + " " + value + "\n";
+    }
+
+    void sample(const std::string& name, const std::string& labels, const uint64_t value) {
+        sample(name, labels, std::to_string(value));
+    }
+
+    void counter(const std::string& name, const std::string& help, const uint64_t value) {
+        family(name, "counter", help);
+        sample(name + "_total", "", value);
+    }
+
+    void gauge(const std::string& name, const std::string& help, const std::string& value) {
+        family(name, "gauge", help);
+        sample(name, "", value);
+    }
+
+    // buckets at every power of two of microseconds from 1us to about 1s
+    template <int SubBits>
+    void histogram(const std::string& name, const std::string& labels, const LogLinearHistogram<SubBits>& h,
+                   const double sum_seconds) {
+        const std::string prefix = labels.empty() ? "" : labels + ",";
+        uint64_t bound_ns = 1000, cumulative = 0;
+        int emitted = 0;
+        const auto emit = [&] {
+            sample(name + "_bucket", prefix + "le=\"" + seconds(static_cast<double>(bound_ns) / 1e9) + "\"", cumulative);
+            bound_ns <<= 1;
+            ++emitted;
+        };
+        h.for_each_bucket([&](const uint64_t upper_ns, const uint64_t n) {
+            while (upper_ns > bound_ns && emitted < BUCKETS) emit();
+            cumulative += n;
+        });
+        while (emitted < BUCKETS) emit();
+        sample(name + "_bucket", prefix + "le=\"+Inf\"", h.total());
+        sample(name + "_count", labels, h.total());
+        sample(name + "_sum", labels, seconds(sum_seconds));
+    }
+
+    std::string finish() {
+        out += "# EOF\n";
+        return std::move(out);
+    }
+
+private:
+    static constexpr int BUCKETS = 21;
+    std::string out;
+};
+
+} // namespace
+
+// called with the new bytes of an HTTP connection, replies once the request head is complete
+void RedisServer::http_read(const int client_fd) {
+    auto& client = clients[client_fd];
+    size_t end = client.buffer.find("\r\n\r\n");
+    if (end == std::string::npos) end = client.buffer.find("\n\n");
+    if (end == std::string::npos) {
+        if (client.buffer.size() > HTTP_MAX_REQUEST) free_client_async(client_fd);
+        return;
+    }
+    const std::string line = client.buffer.substr(0, client.buffer.find_first_of("\r\n"));
+    client.buffer.clear();
+
+    std::string status = "200 OK", type = "application/openmetrics-text; version=1.0.0; charset=utf-8", body;
+    if (line.rfind("GET ", 0) != 0) {
+        status = "405 Method Not Allowed";
+        type = "text/plain";
+        body = "Method not allowed\n";
+    } else if (const std::string path = line.substr(4, line.find(' ', 4) - 4);
+               path != "/metrics" && path.rfind("/metrics?", 0) != 0) {
+        status = "404 Not Found";
+        type = "text/plain";
+        body = "Not found\n";
+    } else {
+        body = metrics_text();
+    }
+    client.close_after_reply = true;
+    add_reply(client_fd, std::make_shared<const std::string>(
+        "HTTP/1.1 " + status + "\r\nContent-Type: " + type + "\r\nContent-Length: " + std::to_string(body.size()) +
+        "\r\nConnection: close\r\n\r\n" + body));
+}
+
+std::string RedisServer::metrics_text() {
+    MetricsWriter w;
+    w.gauge("redis_uptime_seconds", "Seconds since the server started.",
+            std::to_string((now_ms() - stats.start_ms) / 1000));
+
+    size_t connected = 0, blocked = 0, pubsub = 0;
+    for (const auto& [fd, client] : clients) {
+        if (client.is_master || client.http || fd == migration.fd) continue;
+        ++connected;
+        if (client.blocked) ++blocked;
+        if (!client.channels.empty() || !client.patterns.empty()) ++pubsub;
+    }
+    w.gauge("redis_connected_clients", "Client connections, replicas included.", std::to_string(connected));
+    w.gauge("redis_blocked_clients", "Clients waiting in a blocking command.", std::to_string(blocked));
+    w.gauge("redis_pubsub_clients", "Clients in subscribed mode.", std::to_string(pubsub));
+    w.counter("redis_connections_received", "Connections accepted.", stats.connections_received);
+    w.counter("redis_rejected_connections", "Connections refused because of maxclients.", stats.rejected_connections);
+    w.counter("redis_commands_processed", "Commands executed.", stats.commands_processed);
+    w.gauge("redis_instantaneous_ops_per_sec", "Commands per second over the last seconds.",
+            std::to_string(instantaneous_ops_per_sec()));
+    w.counter("redis_rejected_calls", "Commands refused before execution.", stats.rejected_calls);
+    w.counter("redis_error_replies", "Error replies sent.", stats.error_replies);
+    w.counter("redis_net_input_bytes", "Bytes read from clients.", stats.net_input_bytes);
+    w.counter("redis_net_output_bytes", "Bytes written to clients.", stats.net_output_bytes);
+
+    const struct mallinfo2 mi = mallinfo2();
+    w.gauge("redis_memory_used_bytes", "Bytes allocated with malloc.", std::to_string(mi.uordblks + mi.hblkhd));
+    w.gauge("redis_memory_peak_bytes", "Highest used memory seen.", std::to_string(stats.peak_memory));
+    w.gauge("redis_repl_backlog_bytes", "Size of the replication backlog.", std::to_string(repl_backlog.size()));
+
+    static const char* const type_names[] = {"string", "list", "set", "hash", "zset", "hyperloglog", "stream"};
+    static_assert(std::size(type_names) == std::size(decltype(keys_by_type) {}));
+    w.family("redis_keys", "gauge", "Keys by type.");
+    for (size_t t = 0; t < std::size(type_names); ++t) {
+        w.sample("redis_keys", std::string("type=\"") + type_names[t] + "\"", keys_by_type[t]);
+    }
+
+    w.family("redis_event_loop_iteration_seconds", "histogram",
+             "Time spent handling the events of one event loop iteration, the lag of the next events.");
+    w.histogram("redis_event_loop_iteration_seconds", "", stats.event_loop_latency,
+                static_cast<double>(CycleClock::to_ns(stats.event_loop_ticks)) / 1e9);
+    w.gauge("redis_event_loop_max_lag_seconds", "Longest event loop iteration since the previous scrape.",
+            seconds(static_cast<double>(CycleClock::to_ns(stats.event_loop_max_ticks)) / 1e9));
+    stats.event_loop_max_ticks = 0;
+
+    w.family("redis_command_calls", "counter", "Calls by command.");
+    for (const auto& [spec, cs] : command_stats) {
+        w.sample("redis_command_calls_total", "cmd=\"" + lower(spec->name) + "\"", cs.calls);
+    }
+    w.family("redis_command_rejected_calls", "counter", "Calls refused before execution, by command.");
+    for (const auto& [spec, cs] : command_stats) {
+        w.sample("redis_command_rejected_calls_total", "cmd=\"" + lower(spec->name) + "\"", cs.rejected_calls);
+    }
+    w.family("redis_command_failed_calls", "counter", "Calls that replied with an error, by command.");
+    for (const auto& [spec, cs] : command_stats) {
+        w.sample("redis_command_failed_calls_total", "cmd=\"" + lower(spec->name) + "\"", cs.failed_calls);
+    }
+    w.family("redis_command_duration_seconds", "histogram", "Execution time by command.");
+    for (const auto& [spec, cs] : command_stats) {
+        if (cs.calls == 0) continue;
+        w.histogram("redis_command_duration_seconds", "cmd=\"" + lower(spec->name) + "\"", cs.latency,
+                    static_cast<double>(CycleClock::to_ns(cs.ticks)) / 1e9);
+    }
+    return w.finish();
+}
+
+int RedisServer::key_type(const std::string& key) const {
+    const auto it = kv_store.find(key);
+    return it == kv_store.end() ? -1 : static_cast<int>(it->second.type());
+}
+
+void RedisServer::recount_key(const std::string& key, const int before) {
+    const int after = key_type(key);
+    if (after == before) return;
+    if (before >= 0) --keys_by_type[before];
+    if (after >= 0) ++keys_by_type[after];
+}
+
+void RedisServer::rebuild_key_counts() {
+    std::fill(std::begin(keys_by_type), std::end(keys_by_type), 0);
+    for (const auto& [key, ro] : kv_store) {
+        ++keys_by_type[static_cast<size_t>(ro.type())];
+    }
+}
@@ -1,5 +1,12 @@
 #include "object.h"
+#include "command.h"
+#include "cycle_clock.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <random>
 #include <stdexcept>
 
 RedisString::RedisString(const std::string& str) {
@@ -24,12 +31,23 @@ std::string RedisString::std_string() const {
         case Encoding::STRING_DOUBLE:
             return str;
         case Encoding::ONLY_STRING:
+        case Encoding::BYTES:
             return "\"" + str + "\"";
         default:
             return "(nil)";
     }
 }
 
+const std::string& RedisString::raw_string() const {
+    return str;
+}
+
+std::string& RedisString::bytes() {
+    num = nullptr;
+    encoding_ = Encoding::BYTES;
+    return str;
+}
+
 void RedisString::update_num(const int delta) {
     int val = std::get<int>(this->num);
     val += delta;
@@ -117,7 +135,8 @@ void RedisString::update_str() {
     }
 }
 
-RedisObject::RedisObject(const Type type) {
+RedisObject::RedisObject(const Type type)
+    : access_ms(now_ms()) {
     switch (type) {
         case Type::STRING:
             this->type_ = Type::STRING;
@@ -144,27 +163,355 @@ RedisObject::RedisObject(const Type type) {
             this->encoding_ = Encoding::SKIPLIST_STD_UNORDERED_MAP;
             this->value = ZSet{};
             break;
+        case Type::HYPERLOGLOG:
+            this->type_ = Type::HYPERLOGLOG;
+            this->encoding_ = Encoding::HLL_SPARSE;
+            this->value = HyperLogLog{};
+            break;
+        case Type::STREAM:
+            this->type_ = Type::STREAM;
+            this->encoding_ = Encoding::STREAM_BLOCKS;
+            this->value = Stream{};
+            break;
         default: ;
     }
 }
 
-inline RedisObject::Type RedisObject::type() const {
+RedisObject::Type RedisObject::type() const {
     return this->type_;
 }
 
-inline RedisObject::Encoding RedisObject::encoding() const {
+RedisObject::Encoding RedisObject::encoding() const {
     return this->encoding_;
 }
 
+size_t allocation_size(const size_t n) {
+    if (n == 0) return 0;
+    return std::max<size_t>(32, (n + 8 + 15) & ~size_t(15));
+}
+
+namespace {
+
+// heap bytes of a string, nothing while it fits in the string itself
+size_t string_heap(const std::string& s) {
+    return s.capacity() > 15 ? allocation_size(s.capacity() + 1) : 0;
+}
+
+// bucket array of a node-based hash table
+template <typename Table>
+size_t buckets_bytes(const Table& table) {
+    return allocation_size(table.bucket_count() * sizeof(void*));
+}
+
+// a node of a hash table with string keys: next pointer, value, cached hash
+template <typename Table>
+size_t node_bytes() {
+    return allocation_size(sizeof(void*) + sizeof(typename Table::value_type) + sizeof(size_t));
+}
+
+// Sum of bytes(element) over the first samples elements of a range holding size elements,
+// scaled to size (every element when samples is 0)
+template <typename Range, typename Bytes>
+size_t sampled_bytes(const Range& range, const size_t size, const size_t samples, const Bytes& bytes) {
+    size_t total = 0, seen = 0;
+    for (const auto& element : range) {
+        if (samples > 0 && seen == samples) break;
+        total += bytes(element);
+        ++seen;
+    }
+    return seen == 0 ? 0 : total * size / seen;
+}
+
+} // namespace
+
+size_t RedisObject::memory_usage(const size_t samples) const {
+    size_t bytes = sizeof(RedisObject);
+    switch (this->type_) {
+        case Type::STRING:
+            bytes += string_heap(std::get<RedisString>(this->value).raw_string());
+            break;
+        case Type::LIST: {
+            const auto& list = std::get<std::vector<std::string>>(this->value);
+            bytes += allocation_size(list.capacity() * sizeof(std::string));
+            bytes += sampled_bytes(list, list.size(), samples, string_heap);
+            break;
+        }
+        case Type::SET: {
+            using Set = std::unordered_set<std::string>;
+            const auto& set = std::get<Set>(this->value);
+            bytes += buckets_bytes(set);
+            bytes += sampled_bytes(set, set.size(), samples,
+                                   [](const std::string& member) { return node_bytes<Set>() + string_heap(member); });
+            break;
+        }
+        case Type::HASH: {
+            using Hash = std::unordered_map<std::string, RedisString>;
+            const auto& hash = std::get<Hash>(this->value);
+            bytes += buckets_bytes(hash);
+            bytes += sampled_bytes(hash, hash.size(), samples, [](const Hash::value_type& entry) {
+                return node_bytes<Hash>() + string_heap(entry.first) + string_heap(entry.second.raw_string());
+            });
+            break;
+        }
+        case Type::ZSET: {
+            const auto& [skipList, map] = std::get<ZSet>(this->value);
+            bytes += buckets_bytes(map);
+            bytes += sampled_bytes(map, map.size(), samples, [](const std::pair<const std::string, double>& entry) {
+                return node_bytes<std::unordered_map<std::string, double>>() + string_heap(entry.first);
+            });
+            // every node holds its own copy of the member, and a pointer and a span per level
+            size_t head = 0, nodes = 0, seen = 0;
+            skipList.forEachNode(samples, [&](const SkipListNode& node) {
+                const size_t node_size = allocation_size(sizeof(SkipListNode)) + string_heap(node.member) +
+                                         allocation_size(node.forward.capacity() * sizeof(SkipListNode*)) +
+                                         allocation_size(node.span.capacity() * sizeof(int));
+                if (head == 0) {
+                    head = node_size;
+                } else {
+                    nodes += node_size;
+                    ++seen;
+                }
+            });
+            bytes += head + (seen == 0 ? 0 : nodes * map.size() / seen);
+            break;
+        }
+        case Type::HYPERLOGLOG:
+            bytes += string_heap(std::get<HyperLogLog>(this->value).bytes());
+            break;
+        case Type::STREAM:
+            bytes += std::get<Stream>(this->value).memory_usage();
+            break;
+    }
+    return bytes;
+}
+
+std::string RedisObject::encoding_name() const {
+    switch (this->encoding_) {
+        case Encoding::REDIS_STRING:
+            switch (std::get<RedisString>(this->value).encoding()) {
+                case RedisString::Encoding::STRING_INT: return "int";
+                case RedisString::Encoding::STRING_DOUBLE: return "double";
+                case RedisString::Encoding::BYTES: return "bytes";
+                default: return "raw";
+            }
+        case Encoding::STD_VECTOR: return "vector";
+        case Encoding::STD_UNORDERED_SET:
+        case Encoding::STD_UNORDERED_MAP: return "hashtable";
+        case Encoding::SKIPLIST_STD_UNORDERED_MAP: return "skiplist";
+        case Encoding::HLL_SPARSE: return "sparse";
+        case Encoding::HLL_DENSE: return "dense";
+        case Encoding::STREAM_BLOCKS: return "stream";
+    }
+    return "unknown";
+}
+
+std::string RedisObject::type_name() const {
+    static const char* const names[] = {"string", "list", "set", "hash", "zset", "hyperloglog", "stream"};
+    return names[static_cast<size_t>(this->type_)];
+}
+
+namespace {
+
+// access counter periods elapsed since last_ms
+unsigned lfu_decay(const uint64_t last_ms, const uint64_t now_ms, const unsigned lfu_decay_time) {
+    if (lfu_decay_time == 0 || now_ms <= last_ms) return 0;
+    const uint64_t periods = (now_ms - last_ms) / 60000 / lfu_decay_time;
+    return periods > 255 ? 255 : static_cast<unsigned>(periods);
+}
+
+} // namespace
+
+void RedisObject::touch(const uint64_t now_ms, const unsigned lfu_log_factor, const unsigned lfu_decay_time) {
+    unsigned counter = freq(now_ms, lfu_decay_time);
+    // incremented with a probability shrinking as the counter grows, so that 255 takes about a
+    // million accesses with the default factor of 10
+    if (counter < 255) {
+        static thread_local std::minstd_rand rng(std::random_device{}());
+        const double base = counter > LFU_INIT_VAL ? counter - LFU_INIT_VAL : 0;
+        if (std::uniform_real_distribution<>(0, 1)(rng) < 1.0 / (base * lfu_log_factor + 1)) ++counter;
+    }
+    this->lfu_counter = static_cast<uint8_t>(counter);
+    this->access_ms = now_ms;
+}
+
+uint64_t RedisObject::idle_ms(const uint64_t now_ms) const {
+    return now_ms > this->access_ms ? now_ms - this->access_ms : 0;
+}
+
+unsigned RedisObject::freq(const uint64_t now_ms, const unsigned lfu_decay_time) const {
+    const unsigned periods = lfu_decay(this->access_ms, now_ms, lfu_decay_time);
+    return periods > this->lfu_counter ? 0 : this->lfu_counter - periods;
+}
+
+namespace {
+
+void put_u32(std::string& out, const uint32_t v) {
+    for (int i = 0; i < 4; ++i) out += static_cast<char>((v >> (i * 8)) & 0xFF);
+}
+
+void put_str(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+void put_double(std::string& out, const double d) {
+    char bytes[sizeof(double)];
+    std::memcpy(bytes, &d, sizeof(double));
+    out.append(bytes, sizeof(double));
+}
+
+bool get_u32(const std::string& in, size_t& pos, uint32_t& v) {
+    if (pos + 4 > in.size()) return false;
+    v = 0;
+    for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(static_cast<unsigned char>(in[pos + i])) << (i * 8);
+    pos += 4;
+    return true;
+}
+
+bool get_str(const std::string& in, size_t& pos, std::string& s) {
+    uint32_t len;
+    if (!get_u32(in, pos, len) || pos + len > in.size()) return false;
+    s = in.substr(pos, len);
+    pos += len;
+    return true;
+}
+
+bool get_double(const std::string& in, size_t& pos, double& d) {
+    if (pos + sizeof(double) > in.size()) return false;
+    std::memcpy(&d, in.data() + pos, sizeof(double));
+    pos += sizeof(double);
+    return true;
+}
+
+} // namespace
+
+// type byte, then the payload of the type:
+//   STRING: bytes byte, str        LIST: count, str...
+//   HASH:   count, (field, value)... SET:  count, str...
+//   ZSET:   count, (member, double)...   HYPERLOGLOG: sparse byte, str of the registers
+//   STREAM: str of Stream::serialize
+// where count is a little-endian u32 and str is a count followed by the bytes
+void RedisObject::serialize(std::string& out) const {
+    out += static_cast<char>(this->type_);
+    switch (this->type_) {
+        case Type::STRING: {
+            // the BYTES encoding is kept, a bitmap that reads as a number must not become one
+            const auto& rs = std::get<RedisString>(this->value);
+            out += static_cast<char>(rs.encoding() == RedisString::Encoding::BYTES);
+            put_str(out, rs.raw_string());
+            break;
+        }
+        case Type::LIST: {
+            const auto& list = std::get<std::vector<std::string>>(this->value);
+            put_u32(out, static_cast<uint32_t>(list.size()));
+            for (const auto& item : list) put_str(out, item);
+            break;
+        }
+        case Type::HASH: {
+            const auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value);
+            put_u32(out, static_cast<uint32_t>(map.size()));
+            for (const auto& [field, rs] : map) {
+                put_str(out, field);
+                put_str(out, rs.raw_string());
+            }
+            break;
+        }
+        case Type::SET: {
+            const auto& set = std::get<std::unordered_set<std::string>>(this->value);
+            put_u32(out, static_cast<uint32_t>(set.size()));
+            for (const auto& member : set) put_str(out, member);
+            break;
+        }
+        case Type::ZSET: {
+            const auto& map = std::get<ZSet>(this->value).map;
+            put_u32(out, static_cast<uint32_t>(map.size()));
+            for (const auto& [member, score] : map) {
+                put_str(out, member);
+                put_double(out, score);
+            }
+            break;
+        }
+        case Type::HYPERLOGLOG: {
+            const auto& hll = std::get<HyperLogLog>(this->value);
+            out += static_cast<char>(hll.sparse());
+            put_str(out, hll.bytes());
+            break;
+        }
+        case Type::STREAM: {
+            std::string stream;
+            std::get<Stream>(this->value).serialize(stream);
+            put_str(out, stream);
+            break;
+        }
+    }
+}
+
+std::optional<RedisObject> RedisObject::deserialize(const std::string& in, size_t& pos) {
+    if (pos >= in.size()) return std::nullopt;
+    const auto type_byte = static_cast<unsigned char>(in[pos++]);
+    if (type_byte > static_cast<unsigned char>(Type::STREAM)) return std::nullopt;
+    const auto type = static_cast<Type>(type_byte);
+    RedisObject ro(type);
+    if (type == Type::STRING) {
+        std::string str;
+        if (pos >= in.size() || static_cast<unsigned char>(in[pos]) > 1) return std::nullopt;
+        const bool bytes = in[pos++] != 0;
+        if (!get_str(in, pos, str)) return std::nullopt;
+        if (bytes) {
+            ro.set_bytes(std::move(str));
+        } else {
+            ro.value = RedisString(str);
+        }
+        return ro;
+    }
+    if (type == Type::HYPERLOGLOG) {
+        std::string registers;
+        if (pos >= in.size()) return std::nullopt;
+        const bool sparse = in[pos++] != 0;
+        auto& hll = std::get<HyperLogLog>(ro.value);
+        if (!get_str(in, pos, registers) || !HyperLogLog::from_bytes(sparse, registers, hll)) return std::nullopt;
+        ro.encoding_ = sparse ? Encoding::HLL_SPARSE : Encoding::HLL_DENSE;
+        return ro;
+    }
+    if (type == Type::STREAM) {
+        std::string stream;
+        if (!get_str(in, pos, stream) || !Stream::deserialize(stream, std::get<Stream>(ro.value))) return std::nullopt;
+        return ro;
+    }
+    uint32_t count;
+    if (!get_u32(in, pos, count)) return std::nullopt;
+    for (uint32_t i = 0; i < count; ++i) {
+        std::string a, b;
+        double score;
+        if (!get_str(in, pos, a)) return std::nullopt;
+        switch (type) {
+            case Type::LIST:
+                std::get<std::vector<std::string>>(ro.value).push_back(std::move(a));
+                break;
+            case Type::HASH:
+                if (!get_str(in, pos, b)) return std::nullopt;
+                std::get<std::unordered_map<std::string, RedisString>>(ro.value)[a] = RedisString(b);
+                break;
+            case Type::SET:
+                std::get<std::unordered_set<std::string>>(ro.value).insert(std::move(a));
+                break;
+            default:
+                if (!get_double(in, pos, score)) return std::nullopt;
+                ro.z_add(score, a);
+        }
+    }
+    return ro;
+}
+
 // String
 std::string RedisObject::get() const {
-    if (this->type_ != Type::STRING) return "Redis object type error";
-    const auto rs = std::get<RedisString>(this->value);
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    const auto& rs = std::get<RedisString>(this->value);
     return rs.std_string();
 }
 
 std::string RedisObject::set(const std::string& value) {
-    if (this->type_ != Type::STRING) return "Redis object type error";
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
     this->value = RedisString(value);
     return "OK";
 }
@@ -174,37 +521,135 @@ std::string RedisObject::incr() {
 }
 
 std::string RedisObject::incr_by(const int increment) {
-    if (this->type_ != Type::STRING) return "Redis object type error";
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    auto& rs = std::get<RedisString>(this->value);
+    if (rs.encoding() == RedisString::Encoding::BYTES) rs = RedisString(rs.raw_string());
     // encoding_ must be STRING_INT
-    if (auto& rs = std::get<RedisString>(this->value); rs.encoding() == RedisString::Encoding::STRING_INT) {
+    if (rs.encoding() == RedisString::Encoding::STRING_INT) {
         rs.update_num(increment);
         return rs.std_string();
     }
-    return "Redis string can not be recognized as an integer";
+    return command_error("Redis string can not be recognized as an integer");
+}
+
+std::string RedisObject::str_len() const {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    return std::to_string(std::get<RedisString>(this->value).raw_string().size());
 }
 
 std::string RedisObject::incr_by_float(const double increment) {
-    if (this->type_ != Type::STRING) return "Redis object type error";
-    switch (auto& rs = std::get<RedisString>(this->value); rs.encoding()) {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    auto& rs = std::get<RedisString>(this->value);
+    if (rs.encoding() == RedisString::Encoding::BYTES) rs = RedisString(rs.raw_string());
+    switch (rs.encoding()) {
         case RedisString::Encoding::STRING_INT:
         case RedisString::Encoding::STRING_DOUBLE:
             rs.update_num(increment);
             return rs.std_string();
         default:
-            return "Redis string can not be recognized as a number";
+            return command_error("Redis string can not be recognized as a number");
+    }
+}
+
+// Bitmap
+namespace {
+
+// clamps an inclusive byte range whose negative indexes count from the end, false if it is empty
+bool clamp_range(int64_t& start, int64_t& end, const int64_t len) {
+    if (start < 0) start = std::max<int64_t>(0, start + len);
+    if (end < 0) end = std::max<int64_t>(0, end + len);
+    end = std::min(end, len - 1);
+    return start <= end;
+}
+
+} // namespace
+
+std::string RedisObject::set_bit(const uint64_t offset, const int bit) {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    auto& str = std::get<RedisString>(this->value).bytes();
+    const uint64_t index = offset >> 3;
+    if (str.size() <= index) str.resize(index + 1, '\0');
+    auto& byte = reinterpret_cast<unsigned char&>(str[index]);
+    const auto mask = static_cast<unsigned char>(0x80 >> (offset & 7));
+    const bool old = byte & mask;
+    byte = bit ? byte | mask : byte & ~mask;
+    return old ? "1" : "0";
+}
+
+std::string RedisObject::get_bit(const uint64_t offset) const {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    const auto& str = std::get<RedisString>(this->value).raw_string();
+    const uint64_t index = offset >> 3;
+    if (index >= str.size()) return "0";
+    return static_cast<unsigned char>(str[index]) >> (7 - (offset & 7)) & 1 ? "1" : "0";
+}
+
+std::string RedisObject::bit_count(int64_t start, int64_t end) const {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    const auto& str = std::get<RedisString>(this->value).raw_string();
+    if (!clamp_range(start, end, static_cast<int64_t>(str.size()))) return "0";
+    const auto* p = reinterpret_cast<const unsigned char*>(str.data());
+    return std::to_string(bitmap_count(p + start, end - start + 1));
+}
+
+std::string RedisObject::bit_pos(const int bit, int64_t start, int64_t end, const bool end_given) const {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    const auto& str = std::get<RedisString>(this->value).raw_string();
+    if (str.empty()) return bit ? "-1" : "0";
+    if (!clamp_range(start, end, static_cast<int64_t>(str.size()))) return "-1";
+    const auto* p = reinterpret_cast<const unsigned char*>(str.data());
+    if (const int64_t pos = bitmap_position(p + start, end - start + 1, bit); pos >= 0) {
+        return std::to_string(start * 8 + pos);
     }
+    // without an end, the string is taken as followed by clear bits
+    return bit == 0 && !end_given ? std::to_string((end + 1) * 8) : "-1";
+}
+
+std::string RedisObject::bit_field(const std::vector<BitfieldOp>& ops) {
+    if (this->type_ != Type::STRING) return command_error("Redis object type error");
+    auto& rs = std::get<RedisString>(this->value);
+    std::string result;
+    int count = 0;
+    for (const auto& op : ops) {
+        int64_t value;
+        bool ok = true;
+        if (op.kind == BitfieldOp::Kind::GET) {
+            value = bitfield_get(rs.raw_string(), op);
+        } else {
+            ok = bitfield_set(rs.bytes(), op, value);
+        }
+        if (count > 0) {
+            result += "\n";
+        }
+        count++;
+        result += std::to_string(count) + ") " + (ok ? std::to_string(value) : "(nil)");
+    }
+    if (count == 0) {
+        return "(empty array)";
+    }
+    return result;
+}
+
+const std::string* RedisObject::bytes() const {
+    if (this->type_ != Type::STRING) return nullptr;
+    return &std::get<RedisString>(this->value).raw_string();
+}
+
+void RedisObject::set_bytes(std::string bytes) {
+    if (this->type_ != Type::STRING) return;
+    std::get<RedisString>(this->value).bytes() = std::move(bytes);
 }
 
 // List
 std::string RedisObject::l_push(const std::string& value) {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     auto& list = std::get<std::vector<std::string>>(this->value);
     list.insert(list.begin(), value);
     return "OK";
 }
 
 std::string RedisObject::l_pop() {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     auto& list = std::get<std::vector<std::string>>(this->value);
     if (list.empty()) return "(nil)";
     auto val = list.front();
@@ -213,14 +658,14 @@ std::string RedisObject::l_pop() {
 }
 
 std::string RedisObject::r_push(const std::string& value) {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     auto& list = std::get<std::vector<std::string>>(this->value);
     list.emplace_back(value);
     return "OK";
 }
 
 std::string RedisObject::r_pop() {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     auto& list = std::get<std::vector<std::string>>(this->value);
     if (list.empty()) return "(nil)";
     auto val = list.back();
@@ -229,7 +674,7 @@ std::string RedisObject::r_pop() {
 }
 
 std::string RedisObject::l_range(int start, int end) const {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     const auto& list = std::get<std::vector<std::string>>(this->value);
     const int size = list.size();
 
@@ -251,21 +696,21 @@ std::string RedisObject::l_range(int start, int end) const {
 }
 
 std::string RedisObject::l_len() const {
-    if (this->type_ != Type::LIST) return "Redis object type error";
+    if (this->type_ != Type::LIST) return command_error("Redis object type error");
     const auto& list = std::get<std::vector<std::string>>(this->value);
     return std::to_string(list.size());
 }
 
 // Hash
 std::string RedisObject::h_set(const std::string& field, const std::string& value) {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value);
     map[field] = RedisString(value);
     return "OK";
 }
 
 std::string RedisObject::h_get(const std::string& field) {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     if (auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value); map.find(field) != map.end()) {
         return map[field].std_string();
     }
@@ -273,7 +718,7 @@ std::string RedisObject::h_get(const std::string& field) {
 }
 
 std::string RedisObject::h_get_all() const {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     const auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value);
     std::string result;
     int count = 0;
@@ -287,8 +732,13 @@ std::string RedisObject::h_get_all() const {
     return result;
 }
 
+std::string RedisObject::h_len() const {
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
+    return std::to_string(std::get<std::unordered_map<std::string, RedisString>>(this->value).size());
+}
+
 std::string RedisObject::h_keys() const {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     const auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value);
     std::string result;
     int count = 0;
@@ -303,7 +753,7 @@ std::string RedisObject::h_keys() const {
 }
 
 std::string RedisObject::h_vals() const {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     const auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value);
     std::string result;
     int count = 0;
@@ -318,7 +768,7 @@ std::string RedisObject::h_vals() const {
 }
 
 std::string RedisObject::h_set_n_x(const std::string& field, const std::string& value) {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     if (auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value); map.find(field) == map.end()) {
         map[field] = RedisString(value);
         return "OK";
@@ -327,7 +777,7 @@ std::string RedisObject::h_set_n_x(const std::string& field, const std::string&
 }
 
 std::string RedisObject::h_incr_by(const std::string& field, int increment) {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     if (auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value); map.find(field) != map.end()) {
         auto& rs = map[field];
         switch (rs.encoding()) {
@@ -335,7 +785,7 @@ std::string RedisObject::h_incr_by(const std::string& field, int increment) {
                 rs.update_num(increment);
                 break;
             default:
-                return "Hash value can not be recognized as an integer";
+                return command_error("Hash value can not be recognized as an integer");
         }
         return rs.std_string();
     }
@@ -343,7 +793,7 @@ std::string RedisObject::h_incr_by(const std::string& field, int increment) {
 }
 
 std::string RedisObject::h_incr_by_float(const std::string& field, double increment) {
-    if (this->type_ != Type::HASH) return "Redis object type error";
+    if (this->type_ != Type::HASH) return command_error("Redis object type error");
     if (auto& map = std::get<std::unordered_map<std::string, RedisString>>(this->value); map.find(field) != map.end()) {
         auto& rs = map[field];
         switch (rs.encoding()) {
@@ -352,7 +802,7 @@ std::string RedisObject::h_incr_by_float(const std::string& field, double increm
                 rs.update_num(increment);
                 break;
             default:
-                return "Hash value can not be recognized as a float number";
+                return command_error("Hash value can not be recognized as a float number");
         }
         return rs.std_string();
     }
@@ -361,14 +811,14 @@ std::string RedisObject::h_incr_by_float(const std::string& field, double increm
 
 // Set
 std::string RedisObject::s_add(const std::string& member) {
-    if (this->type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     set.emplace(member);
     return "OK";
 }
 
 std::string RedisObject::s_rem(const std::string& member) {
-    if (this->type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     if (const auto it = set.find(member); it != set.end()) {
         set.erase(it);
@@ -378,19 +828,19 @@ std::string RedisObject::s_rem(const std::string& member) {
 }
 
 std::string RedisObject::s_card() const {
-    if (this->type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     return std::to_string(set.size());
 }
 
 std::string RedisObject::s_is_member(const std::string& member) const {
-    if (this->type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     return set.find(member) != set.end() ? "true" : "false";
 }
 
 std::string RedisObject::s_members() const {
-    if (this->type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     std::string result;
     int count = 0;
@@ -408,8 +858,8 @@ std::string RedisObject::s_members() const {
 }
 
 std::string RedisObject::s_inter(const RedisObject& other) const {
-    if (this->type_ != Type::SET) return "Redis object type error";
-    if (other.type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
+    if (other.type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     auto& set2 = std::get<std::unordered_set<std::string>>(other.value);
     std::string result;
@@ -430,8 +880,8 @@ std::string RedisObject::s_inter(const RedisObject& other) const {
 }
 
 std::string RedisObject::s_diff(const RedisObject& other) const {
-    if (this->type_ != Type::SET) return "Redis object type error";
-    if (other.type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
+    if (other.type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     auto& set2 = std::get<std::unordered_set<std::string>>(other.value);
     std::string result;
@@ -451,9 +901,13 @@ std::string RedisObject::s_diff(const RedisObject& other) const {
     return result;
 }
 
+const std::unordered_set<std::string>* RedisObject::members() const {
+    return std::get_if<std::unordered_set<std::string>>(&this->value);
+}
+
 std::string RedisObject::s_union(const RedisObject& other) const {
-    if (this->type_ != Type::SET) return "Redis object type error";
-    if (other.type_ != Type::SET) return "Redis object type error";
+    if (this->type_ != Type::SET) return command_error("Redis object type error");
+    if (other.type_ != Type::SET) return command_error("Redis object type error");
     auto& set = std::get<std::unordered_set<std::string>>(this->value);
     auto& set2 = std::get<std::unordered_set<std::string>>(other.value);
     std::string result;
@@ -482,7 +936,7 @@ std::string RedisObject::s_union(const RedisObject& other) const {
 
 // ZSet
 std::string RedisObject::z_add(const double score, const std::string& member) {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     if (const auto it = map.find(member); it != map.end()) {
         skipList.erase(member, it->second);
@@ -493,7 +947,7 @@ std::string RedisObject::z_add(const double score, const std::string& member) {
 }
 
 std::string RedisObject::z_rem(const std::string& member) {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     const auto it = map.find(member);
     if (it == map.end()) return "(nil)";
@@ -502,15 +956,15 @@ std::string RedisObject::z_rem(const std::string& member) {
     return "OK";
 }
 
-const auto double2string = [](const double& d) -> std::string {
+std::string double2string(const double d) {
     if (const int temp = static_cast<int>(d); temp == d) {
         return std::to_string(temp);
     }
     return std::to_string(d);
-};
+}
 
 std::string RedisObject::z_score(const std::string& member) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     const auto it = map.find(member);
     if (it == map.end()) return "(nil)";
@@ -518,7 +972,7 @@ std::string RedisObject::z_score(const std::string& member) const {
 }
 
 std::string RedisObject::z_rank(const std::string& member, const bool with_score) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     const auto it = map.find(member);
     if (it == map.end()) return "(nil)";
@@ -526,19 +980,19 @@ std::string RedisObject::z_rank(const std::string& member, const bool with_score
 }
 
 std::string RedisObject::z_card() const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     return std::to_string(map.size());
 }
 
-std::string RedisObject::z_count(const double min, const double max) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+std::string RedisObject::z_count(const double min, const bool minExclusive, const double max, const bool maxExclusive) const {
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
-    return std::to_string(skipList.rangeByScore(min, false, max, false).size());
+    return std::to_string(skipList.rangeByScore(min, minExclusive, max, maxExclusive).size());
 }
 
 std::string RedisObject::z_incr_by(const double increment, const std::string& member) {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     double newScore;
     if (const auto it = map.find(member); it != map.end()) {
@@ -553,7 +1007,7 @@ std::string RedisObject::z_incr_by(const double increment, const std::string& me
 }
 
 std::string RedisObject::z_range(const int idx1, const int idx2, const bool with_scores) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     std::string result;
     int count = 0;
@@ -562,7 +1016,7 @@ std::string RedisObject::z_range(const int idx1, const int idx2, const bool with
             result += "\n";
         }
         count++;
-        result += std::to_string(count) + ") " + item + (with_scores ? double2string(map.at(item)) : "");
+        result += std::to_string(count) + ") " + item + (with_scores ? " " + double2string(map.at(item)) : "");
     }
     if (count == 0) {
         return "(empty array)";
@@ -571,7 +1025,7 @@ std::string RedisObject::z_range(const int idx1, const int idx2, const bool with
 }
 
 std::string RedisObject::z_range_by_score(const double min, const bool minExclusive, const double max, const bool maxExclusive, const bool with_scores) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     std::string result;
     int count = 0;
@@ -580,7 +1034,7 @@ std::string RedisObject::z_range_by_score(const double min, const bool minExclus
             result += "\n";
         }
         count++;
-        result += std::to_string(count) + ") " + item + (with_scores ? double2string(map.at(item)) : "");
+        result += std::to_string(count) + ") " + item + (with_scores ? " " + double2string(map.at(item)) : "");
     }
     if (count == 0) {
         return "(empty array)";
@@ -588,9 +1042,44 @@ std::string RedisObject::z_range_by_score(const double min, const bool minExclus
     return result;
 }
 
+std::string RedisObject::z_range_by_lex(const LexBound& min, const LexBound& max, const int offset, const int count,
+                                        const bool reverse) const {
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    auto&[skipList, map] = std::get<ZSet>(this->value);
+    std::string result;
+    int n = 0;
+    for (const auto& item : skipList.rangeByLex(min, max, offset, count, reverse)) {
+        if (n > 0) {
+            result += "\n";
+        }
+        n++;
+        result += std::to_string(n) + ") " + item;
+    }
+    if (n == 0) {
+        return "(empty array)";
+    }
+    return result;
+}
+
+std::string RedisObject::z_lex_count(const LexBound& min, const LexBound& max) const {
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    auto&[skipList, map] = std::get<ZSet>(this->value);
+    return std::to_string(skipList.lexCount(min, max));
+}
+
+std::string RedisObject::z_rem_range_by_lex(const LexBound& min, const LexBound& max) {
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    auto&[skipList, map] = std::get<ZSet>(this->value);
+    const auto removed = skipList.eraseRangeByLex(min, max);
+    for (const auto& member : removed) {
+        map.erase(member);
+    }
+    return std::to_string(removed.size());
+}
+
 std::string RedisObject::z_inter(const RedisObject& other) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
-    if (other.type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    if (other.type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     auto&[skipList2, map2] = std::get<ZSet>(other.value);
     std::string result;
@@ -611,8 +1100,8 @@ std::string RedisObject::z_inter(const RedisObject& other) const {
 }
 
 std::string RedisObject::z_union(const RedisObject& other) const {
-    if (this->type_ != Type::ZSET) return "Redis object type error";
-    if (other.type_ != Type::ZSET) return "Redis object type error";
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    if (other.type_ != Type::ZSET) return command_error("Redis object type error");
     auto&[skipList, map] = std::get<ZSet>(this->value);
     auto&[skipList2, map2] = std::get<ZSet>(other.value);
     std::string result;
@@ -628,8 +1117,123 @@ std::string RedisObject::z_union(const RedisObject& other) const {
             result += std::to_string(count) + ") " + k + " " + double2string(v);
         }
     }
+    for (const auto&[k, v] : map2) {
+        if (map.count(k)) continue;
+        if (count > 0) {
+            result += "\n";
+        }
+        count++;
+        result += std::to_string(count) + ") " + k + " " + double2string(v);
+    }
     if (count == 0) {
         return "(empty array)";
     }
     return result;
 }
+
+const ZSet* RedisObject::zset() const {
+    return std::get_if<ZSet>(&this->value);
+}
+
+// The result is accumulated in the member map of the destination, then sorted once and loaded
+// into its skiplist in a single pass instead of one insert per member
+std::string RedisObject::z_store(const ZStoreOp op, const std::vector<const ZSet*>& sets,
+                                 const std::vector<double>& weights, const ZAggregate aggregate) {
+    if (this->type_ != Type::ZSET) return command_error("Redis object type error");
+    auto&[skipList, map] = std::get<ZSet>(this->value);
+    const auto weighted = [&](const size_t i, const double score) {
+        const double w = score * weights[i];
+        return std::isnan(w) ? 0 : w; // inf * 0
+    };
+    const auto combine = [aggregate](const double a, const double b) {
+        if (aggregate == ZAggregate::MIN) return std::min(a, b);
+        if (aggregate == ZAggregate::MAX) return std::max(a, b);
+        const double sum = a + b;
+        return std::isnan(sum) ? 0 : sum; // inf + -inf
+    };
+
+    if (op == ZStoreOp::UNION) {
+        for (size_t i = 0; i < sets.size(); ++i) {
+            if (!sets[i]) continue;
+            for (const auto&[member, score] : sets[i]->map) {
+                const double w = weighted(i, score);
+                if (auto [it, inserted] = map.emplace(member, w); !inserted) {
+                    it->second = combine(it->second, w);
+                }
+            }
+        }
+    } else if (op == ZStoreOp::INTER) {
+        // members of the smallest input are looked up in the others
+        std::vector<size_t> order(sets.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            if (!sets[i] || sets[i]->map.empty()) return "0";
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(),
+                  [&](const size_t a, const size_t b) { return sets[a]->map.size() < sets[b]->map.size(); });
+        for (const auto&[member, score] : sets[order[0]]->map) {
+            double acc = weighted(order[0], score);
+            bool everywhere = true;
+            for (size_t j = 1; j < order.size() && everywhere; ++j) {
+                const auto it = sets[order[j]]->map.find(member);
+                if (it == sets[order[j]]->map.end()) {
+                    everywhere = false;
+                } else {
+                    acc = combine(acc, weighted(order[j], it->second));
+                }
+            }
+            if (everywhere) map.emplace(member, acc);
+        }
+    } else if (sets[0]) {
+        for (const auto&[member, score] : sets[0]->map) {
+            bool elsewhere = false;
+            for (size_t j = 1; j < sets.size() && !elsewhere; ++j) {
+                elsewhere = sets[j] && sets[j]->map.count(member);
+            }
+            if (!elsewhere) map.emplace(member, score);
+        }
+    }
+
+    std::vector<std::pair<std::string, double>> sorted(map.begin(), map.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second < b.second : a.first < b.first;
+    });
+    skipList.bulkLoad(sorted);
+    return std::to_string(map.size());
+}
+
+// HyperLogLog
+std::string RedisObject::pf_add(const std::vector<std::string>& elements) {
+    if (this->type_ != Type::HYPERLOGLOG) return command_error("Redis object type error");
+    auto& hll = std::get<HyperLogLog>(this->value);
+    bool changed = false;
+    for (const auto& element : elements) {
+        changed |= hll.add(element);
+    }
+    if (!hll.sparse()) this->encoding_ = Encoding::HLL_DENSE;
+    return changed ? "1" : "0";
+}
+
+std::string RedisObject::pf_count() const {
+    if (this->type_ != Type::HYPERLOGLOG) return command_error("Redis object type error");
+    return std::to_string(std::get<HyperLogLog>(this->value).count());
+}
+
+const HyperLogLog* RedisObject::hyperloglog() const {
+    return std::get_if<HyperLogLog>(&this->value);
+}
+
+void RedisObject::pf_assign(const HyperLogLog::Registers& registers) {
+    if (this->type_ != Type::HYPERLOGLOG) return;
+    std::get<HyperLogLog>(this->value).assign(registers);
+    this->encoding_ = Encoding::HLL_DENSE;
+}
+
+// Stream
+Stream* RedisObject::stream() {
+    return std::get_if<Stream>(&this->value);
+}
+
+const Stream* RedisObject::stream() const {
+    return std::get_if<Stream>(&this->value);
+}
@@ -0,0 +1,151 @@
+#include "radix_tree.h"
+
+#include <algorithm>
+
+RadixTree::RadixTree() : root(std::make_unique<Node>()) {}
+
+RadixTree::~RadixTree() = default;
+
+std::vector<std::unique_ptr<RadixTree::Node>>::iterator RadixTree::child(Node& node, const unsigned char c) {
+    return std::lower_bound(node.children.begin(), node.children.end(), c,
+                            [](const std::unique_ptr<Node>& n, const unsigned char ch) {
+                                return static_cast<unsigned char>(n->label[0]) < ch;
+                            });
+}
+
+const RadixTree::Node* RadixTree::find_child(const Node& node, const unsigned char c) {
+    const auto it = child(const_cast<Node&>(node), c);
+    return it != node.children.end() && static_cast<unsigned char>((*it)->label[0]) == c ? it->get() : nullptr;
+}
+
+size_t RadixTree::size() const {
+    return root->count;
+}
+
+void RadixTree::clear() {
+    root = std::make_unique<Node>();
+}
+
+bool RadixTree::contains(const std::string& key) const {
+    const Node* node = root.get();
+    size_t pos = 0;
+    while (pos < key.size()) {
+        node = find_child(*node, key[pos]);
+        if (!node || key.compare(pos, node->label.size(), node->label) != 0) return false;
+        pos += node->label.size();
+    }
+    return node->is_key;
+}
+
+bool RadixTree::insert(const std::string& key) {
+    if (contains(key)) return false;
+    Node* node = root.get();
+    ++node->count;
+    size_t pos = 0;
+    while (pos < key.size()) {
+        const auto it = child(*node, key[pos]);
+        if (it == node->children.end() || (*it)->label[0] != key[pos]) {
+            // no edge starts with the next character, the rest of the key becomes one
+            auto leaf = std::make_unique<Node>();
+            leaf->label = key.substr(pos);
+            leaf->is_key = true;
+            leaf->count = 1;
+            node->children.insert(it, std::move(leaf));
+            return true;
+        }
+        Node& next = **it;
+        size_t common = 1;
+        while (common < next.label.size() && pos + common < key.size() && next.label[common] == key[pos + common]) {
+            ++common;
+        }
+        if (common < next.label.size()) {
+            // the key leaves the edge midway, which is split there
+            auto split = std::make_unique<Node>();
+            split->label = next.label.substr(0, common);
+            split->count = next.count;
+            next.label.erase(0, common);
+            split->children.push_back(std::move(*it));
+            *it = std::move(split);
+        }
+        node = it->get();
+        ++node->count;
+        pos += common;
+    }
+    node->is_key = true;
+    return true;
+}
+
+bool RadixTree::erase(const std::string& key) {
+    return erase(*root, key, 0);
+}
+
+// pos: characters of key consumed down to node; an emptied node is removed and a node left with
+// a single child and no key is merged with it, so that every inner node keeps branching
+bool RadixTree::erase(Node& node, const std::string& key, const size_t pos) {
+    if (pos == key.size()) {
+        if (!node.is_key) return false;
+        node.is_key = false;
+        --node.count;
+        return true;
+    }
+    const auto it = child(node, key[pos]);
+    if (it == node.children.end() || (*it)->label[0] != key[pos] ||
+        key.compare(pos, (*it)->label.size(), (*it)->label) != 0) {
+        return false;
+    }
+    Node& next = **it;
+    if (!erase(next, key, pos + next.label.size())) return false;
+    --node.count;
+    if (next.count == 0) {
+        node.children.erase(it);
+    } else if (!next.is_key && next.children.size() == 1) {
+        auto only = std::move(next.children.front());
+        only->label.insert(0, next.label);
+        *it = std::move(only);
+    }
+    return true;
+}
+
+size_t RadixTree::count_prefix(const std::string& prefix) const {
+    const Node* node = root.get();
+    size_t pos = 0;
+    while (pos < prefix.size()) {
+        node = find_child(*node, prefix[pos]);
+        if (!node) return 0;
+        const size_t n = std::min(node->label.size(), prefix.size() - pos);
+        if (prefix.compare(pos, n, node->label, 0, n) != 0) return 0;
+        pos += node->label.size();
+    }
+    return node->count;
+}
+
+void RadixTree::visit(const std::string& prefix, const std::string& from,
+                      const std::function<bool(const std::string&)>& fn) const {
+    // down to the subtree of the keys starting with prefix, whose path may go past it
+    const Node* node = root.get();
+    std::string path;
+    while (path.size() < prefix.size()) {
+        node = find_child(*node, prefix[path.size()]);
+        if (!node) return;
+        const size_t n = std::min(node->label.size(), prefix.size() - path.size());
+        if (prefix.compare(path.size(), n, node->label, 0, n) != 0) return;
+        path += node->label;
+    }
+    visit(*node, path, from, fn);
+}
+
+// path: the characters down to node, included
+bool RadixTree::visit(const Node& node, std::string& path, const std::string& from,
+                      const std::function<bool(const std::string&)>& fn) {
+    if (node.is_key && path >= from && !fn(path)) return false;
+    for (const auto& next : node.children) {
+        const size_t length = path.size();
+        path += next->label;
+        // every key below starts with path, they are all less than from if its start is greater
+        const bool before = from.compare(0, path.size(), path) > 0;
+        const bool go_on = before || visit(*next, path, from, fn);
+        path.resize(length);
+        if (!go_on) return false;
+    }
+    return true;
+}
@@ -0,0 +1,247 @@
+#include "server.h"
+#include "snapshot.h"
+#include "cycle_clock.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <random>
+#include <sys/socket.h>
+
+// Primary side: every write command run at the top level is appended, as a command line, to the
+// replication stream. master_repl_offset counts the bytes ever appended, and a circular backlog
+// keeps the tail of the stream so that a replica that reconnects with a recent offset only gets
+// what it missed (+CONTINUE) instead of a new snapshot (+FULLRESYNC).
+//
+// Replica side: the connection to the primary is a client flagged is_master whose replies are
+// dropped. It sends PSYNC <replid> <offset> (or PSYNC ? -1), loads the snapshot on a full resync,
+// and then executes the stream like any other client input, counting the bytes it consumed.
+
+std::string RedisServer::generate_replid() {
+    static std::mt19937_64 rng(std::random_device{}());
+    static constexpr char hex[] = "0123456789abcdef";
+    std::string id;
+    for (int i = 0; i < 40; ++i) id += hex[rng() % 16];
+    return id;
+}
+
+void RedisServer::propagate(const std::vector<std::string>& tokens) {
+    if (replicas.empty() && repl_backlog.empty()) return; // nobody has asked for the stream yet
+
+    std::string line;
+    for (const auto& token : tokens) {
+        if (!line.empty()) line += ' ';
+        line += quote_token(token);
+    }
+    line += '\n';
+
+    for (const char c : line) {
+        repl_backlog[repl_backlog_idx] = c;
+        repl_backlog_idx = (repl_backlog_idx + 1) % repl_backlog.size();
+    }
+    repl_backlog_histlen = std::min(repl_backlog_histlen + line.size(), repl_backlog.size());
+    master_repl_offset += line.size();
+
+    const auto buffer = std::make_shared<const std::string>(std::move(line));
+    for (const int fd : replicas) {
+        add_reply(fd, buffer);
+    }
+}
+
+std::string RedisServer::psync_command(const int client_fd, const std::vector<std::string>& tokens) {
+    auto& client = clients[client_fd];
+    if (client.is_replica) return command_error("Already a replica");
+    if (repl_backlog.empty()) {
+        repl_backlog.assign(config.repl_backlog_size, '\0');
+        repl_backlog_idx = 0;
+        repl_backlog_histlen = 0;
+    }
+
+    // PSYNC replid offset, where offset is the number of stream bytes the replica has processed
+    uint64_t offset = 0;
+    bool offset_ok = false;
+    try {
+        size_t pos;
+        const long long n = std::stoll(tokens[2], &pos);
+        offset_ok = pos == tokens[2].size() && n >= 0;
+        offset = static_cast<uint64_t>(n);
+    } catch (...) {}
+
+    client.is_replica = true;
+    replicas.insert(client_fd);
+    if (offset_ok && tokens[1] == replid && offset <= master_repl_offset &&
+        offset >= master_repl_offset - repl_backlog_histlen) {
+        add_reply(client_fd, std::make_shared<const std::string>("+CONTINUE " + replid + "\n"));
+        if (const size_t missing = master_repl_offset - offset; missing > 0) {
+            // the byte at master_repl_offset - 1 sits right before repl_backlog_idx
+            const size_t start = (repl_backlog_idx + repl_backlog.size() - missing) % repl_backlog.size();
+            std::string data;
+            data.reserve(missing);
+            for (size_t i = 0; i < missing; ++i) {
+                data += repl_backlog[(start + i) % repl_backlog.size()];
+            }
+            add_reply(client_fd, std::make_shared<const std::string>(std::move(data)));
+        }
+        return "";
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    auto snapshot = dump_snapshot(kv_store);
+    ++stats.snapshots;
+    stats.last_snapshot_bytes = snapshot.size();
+    stats.last_snapshot_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    latency_add_sample("snapshot", stats.last_snapshot_usec / 1000);
+    add_reply(client_fd, std::make_shared<const std::string>(
+        "+FULLRESYNC " + replid + " " + std::to_string(master_repl_offset) + "\n"));
+    add_reply(client_fd, std::make_shared<const std::string>(
+        "$" + std::to_string(snapshot.size()) + "\n" + snapshot));
+    return "";
+}
+
+std::string RedisServer::replicaof_command(const std::vector<std::string>& tokens) {
+    std::string host = tokens[1], port = tokens[2];
+    for (char& c : host) c = static_cast<char>(toupper(c));
+    for (char& c : port) c = static_cast<char>(toupper(c));
+    if (host == "NO" && port == "ONE") {
+        if (master_host.empty()) return "OK";
+        master_host.clear();
+        if (master_fd >= 0) close_client(master_fd);
+        // a new history starts here, replicas of this server will have to resync
+        replid = generate_replid();
+        return "OK";
+    }
+
+    int new_port;
+    try {
+        new_port = std::stoi(tokens[2]);
+    } catch (...) {
+        return command_error("Port should be an integer");
+    }
+    if (new_port <= 0 || new_port > 65535) return command_error("Port out of range");
+    if (master_host == tokens[1] && master_port == new_port) return "OK Already connected to specified master";
+
+    if (master_fd >= 0) close_client(master_fd);
+    // writes done while this server was a primary are not part of the new primary's history
+    if (master_host.empty()) {
+        master_replid.clear();
+        master_offset = 0;
+    }
+    master_host = tokens[1];
+    master_port = new_port;
+    connect_to_master();
+    return "OK";
+}
+
+std::string RedisServer::role_command() const {
+    if (master_host.empty()) {
+        return "1) master\n2) " + std::to_string(master_repl_offset) + "\n3) " + std::to_string(replicas.size());
+    }
+    static const char* states[] = {"connect", "connecting", "sync", "sync", "connected"};
+    return "1) slave\n2) " + master_host + "\n3) " + std::to_string(master_port) + "\n4) " +
+           states[static_cast<int>(repl_state)] + "\n5) " + std::to_string(master_offset);
+}
+
+void RedisServer::connect_to_master() {
+    last_master_attempt_ms = now_ms();
+    const int fd = connect_nonblocking(master_host, master_port);
+    if (fd < 0) return; // retried by the cron
+    Client master;
+    master.is_master = true;
+    clients.emplace(fd, std::move(master));
+    master_fd = fd;
+    repl_state = ReplState::CONNECTING;
+}
+
+void RedisServer::master_connected() {
+    int err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(master_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+        close_client(master_fd);
+        return;
+    }
+    epoll_event ev { EPOLLIN, { .fd = master_fd } };
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, master_fd, &ev);
+
+    // replies to the primary are dropped, so the handshake is written directly; it fits in any socket buffer
+    const std::string psync = master_replid.empty()
+        ? "PSYNC ? -1\n"
+        : "PSYNC " + master_replid + " " + std::to_string(master_offset) + "\n";
+    if (send(master_fd, psync.data(), psync.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(psync.size())) {
+        close_client(master_fd);
+        return;
+    }
+    repl_state = ReplState::WAIT_PSYNC_REPLY;
+}
+
+// consumes the PSYNC reply and the snapshot from the primary, then the command stream
+void RedisServer::replica_read_master() {
+    auto& client = clients[master_fd];
+    if (repl_state == ReplState::WAIT_PSYNC_REPLY) {
+        const size_t pos = client.buffer.find('\n');
+        if (pos == std::string::npos) return;
+        const std::string line = client.buffer.substr(0, pos);
+        client.buffer.erase(0, pos + 1);
+        if (line.rfind("+FULLRESYNC ", 0) == 0) {
+            const size_t space = line.find(' ', 12);
+            try {
+                master_replid = line.substr(12, space - 12);
+                master_offset = std::stoull(line.substr(space + 1));
+            } catch (...) {
+                close_client(master_fd);
+                return;
+            }
+            repl_state = ReplState::TRANSFER;
+        } else if (line.rfind("+CONTINUE", 0) == 0) {
+            repl_state = ReplState::CONNECTED;
+        } else {
+            close_client(master_fd);
+            return;
+        }
+    }
+    if (repl_state == ReplState::TRANSFER) {
+        const size_t pos = client.buffer.find('\n');
+        if (pos == std::string::npos) return;
+        size_t len;
+        try {
+            len = std::stoull(client.buffer.substr(1, pos - 1));
+        } catch (...) {
+            close_client(master_fd);
+            return;
+        }
+        if (client.buffer.size() < pos + 1 + len) return;
+        const std::string snapshot = client.buffer.substr(pos + 1, len);
+        client.buffer.erase(0, pos + 1 + len);
+        wait_for_jobs(); // they read objects of the keyspace being replaced
+        if (!load_snapshot(snapshot, kv_store)) {
+            master_replid.clear();
+            close_client(master_fd);
+            return;
+        }
+        signal_flushed_db();
+        repl_state = ReplState::CONNECTED;
+    }
+    if (repl_state == ReplState::CONNECTED) process_input_buffer(master_fd);
+}
+
+// every key may have changed: fail all WATCHes and flush every client side cache
+void RedisServer::signal_flushed_db() {
+    for (const auto& [key, fds] : watched_keys) {
+        for (const int fd : fds) {
+            clients[fd].dirty_cas = true;
+        }
+    }
+    tracking_table.clear();
+    for (auto& [fd, client] : clients) {
+        if (client.tracking) send_response(fd, "1) invalidate\n2) (nil)");
+    }
+    cluster_rebuild_slot_index();
+    key_index_rebuild();
+    rebuild_key_counts();
+}
+
+void RedisServer::replication_cron() {
+    if (!master_host.empty() && master_fd < 0 && now_ms() - last_master_attempt_ms >= 1000) {
+        connect_to_master();
+    }
+}
@@ -0,0 +1,286 @@
+#include "script.h"
+#include "command.h"
+
+#include <cctype>
+#include <cmath>
+#include <unordered_map>
+
+namespace {
+
+std::vector<std::string> split_words(const std::string& source) {
+    std::vector<std::string> words;
+    size_t i = 0;
+    while (i < source.size()) {
+        if (std::isspace(static_cast<unsigned char>(source[i]))) {
+            ++i;
+            continue;
+        }
+        std::string word;
+        if (source[i] == '\'') {
+            // keep the leading quote so that the compiler can tell literals from words
+            word += source[i++];
+            bool closed = false;
+            while (i < source.size()) {
+                if (source[i] == '\\' && i + 1 < source.size()) {
+                    word += source[i + 1];
+                    i += 2;
+                } else if (source[i] == '\'') {
+                    closed = true;
+                    ++i;
+                    break;
+                } else {
+                    word += source[i++];
+                }
+            }
+            if (!closed) throw ScriptError("unterminated string literal");
+        } else {
+            while (i < source.size() && !std::isspace(static_cast<unsigned char>(source[i]))) {
+                word += source[i++];
+            }
+        }
+        words.push_back(std::move(word));
+    }
+    return words;
+}
+
+bool parse_number(const std::string& s, double& out) {
+    if (s.empty()) return false;
+    try {
+        size_t pos;
+        out = std::stod(s, &pos);
+        return pos == s.size() && std::isfinite(out); // "inf" and "nan" are not numbers
+    } catch (...) {
+        return false;
+    }
+}
+
+double to_number(const std::string& s) {
+    double d;
+    if (!parse_number(s, d)) throw ScriptError("value is not a number: " + s);
+    return d;
+}
+
+std::string number_to_string(const double d) {
+    if (std::floor(d) == d && std::fabs(d) < 9e15) {
+        return std::to_string(static_cast<long long>(d));
+    }
+    return std::to_string(d);
+}
+
+bool truthy(const std::string& s) {
+    return !(s.empty() || s == "0" || s == "false" || s == "(nil)");
+}
+
+// "KEYS[3]" -> 3, "ARGV[1]" -> 1, 0 when word does not match prefix
+int parse_index(const std::string& word, const std::string& prefix) {
+    if (word.size() <= prefix.size() + 1 || word.compare(0, prefix.size(), prefix) != 0 || word.back() != ']') {
+        return 0;
+    }
+    try {
+        size_t pos;
+        const std::string inner = word.substr(prefix.size(), word.size() - prefix.size() - 1);
+        const int n = std::stoi(inner, &pos);
+        return pos == inner.size() && n > 0 ? n : 0;
+    } catch (...) {
+        return 0;
+    }
+}
+
+} // namespace
+
+std::shared_ptr<const Script> Script::compile(const std::string& source) {
+    static const std::unordered_map<std::string, Op> keywords = {
+        {"dup", Op::DUP}, {"drop", Op::DROP}, {"swap", Op::SWAP}, {"over", Op::OVER},
+        {"+", Op::ADD}, {"-", Op::SUB}, {"*", Op::MUL}, {"/", Op::DIV}, {"%", Op::MOD},
+        {"=", Op::EQ}, {"!=", Op::NE}, {"<", Op::LT}, {">", Op::GT}, {"<=", Op::LE}, {">=", Op::GE},
+        {"not", Op::NOT}, {"and", Op::AND}, {"or", Op::OR}, {"..", Op::CONCAT}, {"nil?", Op::IS_NIL},
+        {"return", Op::RETURN},
+    };
+
+    auto script = std::make_shared<Script>();
+    script->source_ = source;
+    auto& code = script->code;
+    std::vector<size_t> open_blocks; // positions of unresolved if/else jumps
+
+    for (const auto& word : split_words(source)) {
+        double number;
+        if (word[0] == '\'') {
+            code.push_back({Op::PUSH, 0, word.substr(1)});
+        } else if (word == "nil") {
+            code.push_back({Op::PUSH, 0, "(nil)"});
+        } else if (parse_number(word, number)) {
+            code.push_back({Op::PUSH, 0, word});
+        } else if (const int key = parse_index(word, "KEYS["); key > 0) {
+            code.push_back({Op::KEY, key - 1});
+        } else if (const int arg = parse_index(word, "ARGV["); arg > 0) {
+            code.push_back({Op::ARG, arg - 1});
+        } else if (word == "if") {
+            open_blocks.push_back(code.size());
+            code.push_back({Op::JUMP_IF_FALSE});
+        } else if (word == "else") {
+            if (open_blocks.empty() || code[open_blocks.back()].op != Op::JUMP_IF_FALSE) {
+                throw ScriptError("else without if");
+            }
+            code.push_back({Op::JUMP});
+            code[open_blocks.back()].arg = static_cast<int>(code.size());
+            open_blocks.back() = code.size() - 1;
+        } else if (word == "then") {
+            if (open_blocks.empty()) throw ScriptError("then without if");
+            code[open_blocks.back()].arg = static_cast<int>(code.size());
+            open_blocks.pop_back();
+        } else if (const auto it = keywords.find(word); it != keywords.end()) {
+            code.push_back({it->second});
+        } else if (const auto slash = word.rfind('/'); slash != std::string::npos && slash > 0) {
+            std::string name = word.substr(0, slash);
+            for (char& c : name) c = static_cast<char>(toupper(c));
+            int argc;
+            try {
+                size_t pos;
+                argc = std::stoi(word.substr(slash + 1), &pos);
+                if (pos != word.size() - slash - 1 || argc < 0) throw ScriptError("");
+            } catch (...) {
+                throw ScriptError("bad argument count in " + word);
+            }
+            const auto* spec = lookup_command(name);
+            if (!spec || (spec->flags & CommandSpec::NO_SCRIPT)) {
+                throw ScriptError("command not allowed in scripts: " + name);
+            }
+            if (!spec->arity_ok(argc + 1)) throw ScriptError("incorrect argument number for " + name);
+            code.push_back({Op::CALL, argc, std::move(name)});
+        } else {
+            throw ScriptError("unknown word " + word);
+        }
+    }
+    if (!open_blocks.empty()) throw ScriptError("if without then");
+    return script;
+}
+
+const std::string& Script::source() const {
+    return source_;
+}
+
+std::string Script::run(const std::vector<std::string>& keys, const std::vector<std::string>& args,
+                        const Caller& call) const {
+    std::vector<std::string> stack;
+    const auto pop = [&stack] {
+        if (stack.empty()) throw ScriptError("stack underflow");
+        std::string top = std::move(stack.back());
+        stack.pop_back();
+        return top;
+    };
+    const auto push_bool = [&stack](const bool b) { stack.emplace_back(b ? "1" : "0"); };
+
+    size_t pc = 0;
+    while (pc < code.size()) {
+        const Instr& in = code[pc++];
+        switch (in.op) {
+            case Op::PUSH:
+                stack.push_back(in.str);
+                break;
+            case Op::KEY:
+                if (in.arg >= static_cast<int>(keys.size())) throw ScriptError("KEYS index out of range");
+                stack.push_back(keys[in.arg]);
+                break;
+            case Op::ARG:
+                if (in.arg >= static_cast<int>(args.size())) throw ScriptError("ARGV index out of range");
+                stack.push_back(args[in.arg]);
+                break;
+            case Op::CALL: {
+                if (static_cast<int>(stack.size()) < in.arg) throw ScriptError("stack underflow");
+                std::vector<std::string> tokens;
+                tokens.reserve(in.arg + 1);
+                tokens.push_back(in.str);
+                for (auto it = stack.end() - in.arg; it != stack.end(); ++it) {
+                    tokens.push_back(std::move(*it));
+                }
+                stack.resize(stack.size() - in.arg);
+                stack.push_back(call(tokens));
+                break;
+            }
+            case Op::DUP:
+                if (stack.empty()) throw ScriptError("stack underflow");
+                stack.push_back(stack.back());
+                break;
+            case Op::DROP:
+                pop();
+                break;
+            case Op::SWAP: {
+                auto b = pop();
+                auto a = pop();
+                stack.push_back(std::move(b));
+                stack.push_back(std::move(a));
+                break;
+            }
+            case Op::OVER:
+                if (stack.size() < 2) throw ScriptError("stack underflow");
+                stack.push_back(stack[stack.size() - 2]);
+                break;
+            case Op::ADD:
+            case Op::SUB:
+            case Op::MUL:
+            case Op::DIV:
+            case Op::MOD: {
+                const double b = to_number(pop());
+                const double a = to_number(pop());
+                double r;
+                if (in.op == Op::ADD) r = a + b;
+                else if (in.op == Op::SUB) r = a - b;
+                else if (in.op == Op::MUL) r = a * b;
+                else {
+                    if (b == 0) throw ScriptError("division by zero");
+                    r = in.op == Op::DIV ? a / b : std::fmod(a, b);
+                }
+                stack.push_back(number_to_string(r));
+                break;
+            }
+            case Op::EQ:
+            case Op::NE: {
+                const auto b = pop();
+                const auto a = pop();
+                push_bool((a == b) == (in.op == Op::EQ));
+                break;
+            }
+            case Op::LT:
+            case Op::GT:
+            case Op::LE:
+            case Op::GE: {
+                const double b = to_number(pop());
+                const double a = to_number(pop());
+                if (in.op == Op::LT) push_bool(a < b);
+                else if (in.op == Op::GT) push_bool(a > b);
+                else if (in.op == Op::LE) push_bool(a <= b);
+                else push_bool(a >= b);
+                break;
+            }
+            case Op::NOT:
+                push_bool(!truthy(pop()));
+                break;
+            case Op::AND:
+            case Op::OR: {
+                const bool b = truthy(pop());
+                const bool a = truthy(pop());
+                push_bool(in.op == Op::AND ? a && b : a || b);
+                break;
+            }
+            case Op::CONCAT: {
+                const auto b = pop();
+                auto a = pop();
+                stack.push_back(a + b);
+                break;
+            }
+            case Op::IS_NIL:
+                push_bool(pop() == "(nil)");
+                break;
+            case Op::JUMP_IF_FALSE:
+                if (!truthy(pop())) pc = in.arg;
+                break;
+            case Op::JUMP:
+                pc = in.arg;
+                break;
+            case Op::RETURN:
+                pc = code.size();
+                break;
+        }
+    }
+    return stack.empty() ? "(nil)" : stack.back();
+}
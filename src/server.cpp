@@ -1,92 +1,2250 @@
 #include "server.h"
+#include "sha1.h"
+#include "cluster.h"
+#include "cycle_clock.h"
+#include "geohash.h"
 #include <unistd.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <sstream>
+#include <cctype>
+#include <chrono>
 #include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <utility>
 
-RedisServer::RedisServer(const int port) {
-    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+namespace {
+
+// split on whitespace, "double quoted" tokens may contain spaces and \" or \\ escapes
+std::vector<std::string> split_command(const std::string& command) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < command.size()) {
+        if (std::isspace(static_cast<unsigned char>(command[i]))) {
+            ++i;
+            continue;
+        }
+        std::string token;
+        if (command[i] == '"') {
+            ++i;
+            while (i < command.size() && command[i] != '"') {
+                if (command[i] == '\\' && i + 1 < command.size()) ++i;
+                token += command[i++];
+            }
+            ++i; // closing quote
+        } else {
+            while (i < command.size() && !std::isspace(static_cast<unsigned char>(command[i]))) {
+                token += command[i++];
+            }
+        }
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+// wall clock, for what outlives the process such as stream IDs
+uint64_t unix_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// io_uring requests are told apart by their user_data: the operation in the top byte, then the
+// fd and the low bits of the client id, so that completions for a closed client whose fd has
+// been reused are recognised
+enum class UringOp : uint64_t { NONE, ACCEPT, EPOLL, RECV, SEND };
+
+uint64_t uring_data(const UringOp op, const int fd = 0, const uint64_t id = 0) {
+    return static_cast<uint64_t>(op) << 56 | static_cast<uint64_t>(fd & 0xffffff) << 32 | (id & 0xffffffff);
+}
+
+constexpr int EPOLL_BATCH = 1024;
+constexpr unsigned URING_ENTRIES = 4096;
+constexpr uint16_t URING_BUFFER_GROUP = 0;
+constexpr unsigned URING_BUFFERS = 1024;    // receive buffers shared by every connection, a power of two
+constexpr unsigned URING_BUFFER_SIZE = 4096;
+constexpr size_t URING_SEND_IOV_MAX = 64;  // queued replies gathered by one send
+constexpr size_t URING_ZERO_COPY_MIN = 64 * 1024; // smaller sends are cheaper to copy
+constexpr double MAX_BLOCK_TIMEOUT = 1e10; // seconds, longer timeouts wait as long and keep deadlines in range
+
+// accepted sockets inherit the buffer sizes, which must be set before listen() for the TCP
+// window scale to account for them
+void set_buffer_sizes(const int fd, const ServerConfig& config) {
+    if (config.socket_rcvbuf) {
+        const int size = static_cast<int>(config.socket_rcvbuf);
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    if (config.socket_sndbuf) {
+        const int size = static_cast<int>(config.socket_sndbuf);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+}
+
+// returns -1 after reporting the error
+int listen_tcp(const ServerConfig& config, const int port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
     // allow the socket to reuse the address (avoids "address already in use" error)
     constexpr int opt = 1;
-    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
     // set the file descriptor to non-blocking mode
-    fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    set_buffer_sizes(fd, config);
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    inet_pton(AF_INET, config.bind.c_str(), &addr.sin_addr); // validated by ServerConfig::set
+    addr.sin_port = htons(port);
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(fd, config.tcp_backlog) < 0) {
+        perror(("listening on " + config.bind + ":" + std::to_string(port)).c_str());
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int listen_unix(const ServerConfig& config) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    set_buffer_sizes(fd, config);
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, config.unixsocket.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(config.unixsocket.c_str()); // left behind by an earlier run
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+        (config.unixsocketperm && chmod(config.unixsocket.c_str(), config.unixsocketperm) < 0) ||
+        listen(fd, config.tcp_backlog) < 0) {
+        perror(("listening on " + config.unixsocket).c_str());
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+RedisServer::RedisServer(const int port, const ServerConfig& config) : config(config), port(port) {
+    listen_fd = listen_tcp(config, port);
+    if (listen_fd < 0) std::exit(1);
+    if (!config.unixsocket.empty()) {
+        unix_fd = listen_unix(config);
+        if (unix_fd < 0) std::exit(1);
+    }
+    epoll_fd = epoll_create1(0);
+    if (config.io_backend == "io_uring") uring_init();
+    if (!ring) {
+        for (const int fd : {listen_fd, unix_fd}) {
+            if (fd < 0) continue;
+            epoll_event ev { EPOLLIN, { .fd = fd } };
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+        }
+    }
+    if (config.metrics_port != 0) {
+        metrics_fd = listen_tcp(config, config.metrics_port);
+        if (metrics_fd < 0) std::exit(1);
+        epoll_event metrics_ev { EPOLLIN, { .fd = metrics_fd } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, metrics_fd, &metrics_ev);
+    }
+
+    if (config.worker_threads > 0) {
+        workers = std::make_unique<WorkerPool>(config.worker_threads);
+        epoll_event workers_ev { EPOLLIN, { .fd = workers->event_fd() } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, workers->event_fd(), &workers_ev);
+    }
+
+    replid = generate_replid();
+    CycleClock::calibrate();
+    stats.start_ms = now_ms();
+    if (config.cluster_enabled) {
+        slot_owner.resize(CLUSTER_SLOTS);
+        slot_keys.resize(CLUSTER_SLOTS);
+    }
+}
+
+void RedisServer::run() {
+    while (true) {
+        int timeout = block_timers.next_timeout_ms();
+        if (timeout < 0 || timeout > CRON_INTERVAL_MS) timeout = CRON_INTERVAL_MS;
+        const uint64_t loop_start = ring ? uring_process_events(timeout) : epoll_process_events(timeout);
+        const uint64_t expire_start = CycleClock::now();
+        expire_blocked_clients();
+        latency_add_sample("expire-cycle", CycleClock::to_ns(CycleClock::now() - expire_start) / 1000000);
+        if (const uint64_t now = now_ms(); now - last_cron_ms >= CRON_INTERVAL_MS) {
+            last_cron_ms = now;
+            clients_cron();
+            replication_cron();
+            cluster_cron();
+            stats_cron();
+        }
+        // clients served by a push or a timeout may have more commands waiting in their buffers
+        while (!unblocked_clients.empty()) {
+            const auto fds = std::move(unblocked_clients);
+            unblocked_clients.clear();
+            for (const int fd : fds) {
+                if (clients.count(fd)) process_input_buffer(fd);
+            }
+        }
+        // closing is deferred so that no client disappears while another one's command is running
+        while (!clients_to_close.empty()) {
+            const int fd = clients_to_close.back();
+            clients_to_close.pop_back();
+            if (clients.count(fd)) close_client(fd);
+        }
+        const uint64_t loop_ticks = CycleClock::now() - loop_start;
+        stats.event_loop_latency.record(CycleClock::to_ns(loop_ticks));
+        stats.event_loop_ticks += loop_ticks;
+        stats.event_loop_max_ticks = std::max(stats.event_loop_max_ticks, loop_ticks);
+        latency_add_sample("event-loop", CycleClock::to_ns(loop_ticks) / 1000000);
+    }
+}
+
+// waits for events and handles them, returns when the handling started
+uint64_t RedisServer::epoll_process_events(const int timeout) {
+    epoll_event events[EPOLL_BATCH];
+    const int nfds = epoll_wait(epoll_fd, events, EPOLL_BATCH, timeout);
+    const uint64_t loop_start = CycleClock::now();
+    epoll_dispatch(events, nfds);
+    return loop_start;
+}
+
+void RedisServer::epoll_dispatch(const epoll_event* events, const int nfds) {
+    for (int i = 0; i < nfds; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == listen_fd || fd == unix_fd || fd == metrics_fd) {
+            accept_connection(fd);
+            continue;
+        }
+        if (workers && fd == workers->event_fd()) {
+            workers->run_completions();
+            continue;
+        }
+        if (!clients.count(fd)) continue; // closed earlier in this batch
+        if (fd == master_fd && repl_state == ReplState::CONNECTING) {
+            master_connected();
+            continue;
+        }
+        if (fd == migration.fd && !migration.connected) {
+            cluster_migration_connected();
+            continue;
+        }
+        if (events[i].events & EPOLLOUT) write_to_client(fd);
+        if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) handle_client(fd);
+    }
+}
+
+void RedisServer::accept_connection(const int listener) {
+    const int client_fd = accept(listener, nullptr, nullptr);
+    if (client_fd < 0) {
+        // EAGAIN: another event took it; EMFILE and the like: retried on the next event
+        if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+        return;
+    }
+    add_client(client_fd, listener);
+}
+
+// takes an accepted connection in, or refuses it
+void RedisServer::add_client(const int client_fd, const int listener) {
+    // every connection counts, replicas and the primary link included, but neither the scrapes of
+    // the metrics port nor the connection of a slot migration
+    const size_t connected = clients.size() - http_clients - (migration.fd >= 0 ? 1 : 0);
+    if (listener != metrics_fd && connected >= config.maxclients) {
+        static constexpr char error[] = "Max number of clients reached\n";
+        send(client_fd, error, sizeof(error) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(client_fd);
+        ++stats.rejected_connections;
+        return;
+    }
+    Client client;
+    // the ring handles the connections of the main port and the Unix socket, it needs blocking sockets
+    client.uring = ring && listener != metrics_fd;
+    if (!client.uring) {
+        fcntl(client_fd, F_SETFL, O_NONBLOCK);
+        epoll_event ev { EPOLLIN, { .fd = client_fd } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+    }
+    if (listener == unix_fd) {
+        // the peer of a Unix socket has no port, the fd tells the connections apart
+        client.addr = config.unixsocket + ":" + std::to_string(client_fd);
+    } else {
+        set_tcp_options(client_fd);
+        sockaddr_in client_addr {};
+        socklen_t client_len = sizeof(client_addr);
+        getpeername(client_fd, reinterpret_cast<sockaddr *>(&client_addr), &client_len);
+        char ip[INET_ADDRSTRLEN] = "?";
+        inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+        client.addr = std::string(ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
+    }
+    client.http = listener == metrics_fd;
+    if (client.http) ++http_clients;
+    client.id = next_client_id++;
+    client.created_ms = client.last_interaction_ms = now_ms();
+    const auto& added = clients.emplace(client_fd, std::move(client)).first->second;
+    if (listener != metrics_fd) ++stats.connections_received;
+    if (added.uring) uring_arm_recv(client_fd);
+}
+
+void RedisServer::set_tcp_options(const int fd) const {
+    const int nodelay = config.tcp_nodelay;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (config.tcp_keepalive) {
+        // dead peers are detected after about twice the keepalive time, as the probes are sent
+        // every third of it, three times
+        constexpr int yes = 1, probes = 3;
+        const int idle = static_cast<int>(config.tcp_keepalive);
+        const int interval = std::max(1, idle / 3);
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+    }
+}
+
+int RedisServer::connect_nonblocking(const std::string& host, const int port) {
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0 || !res) {
+        return -1;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        freeaddrinfo(res);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    set_tcp_options(fd);
+    const int rc = connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc < 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    // writable once the connection is established
+    epoll_event ev { EPOLLOUT, { .fd = fd } };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    return fd;
+}
+
+void RedisServer::close_client(const int client_fd) {
+    if (client_fd == master_fd) {
+        // keep master_replid and master_offset, the reconnection will try a partial resync
+        master_fd = -1;
+        repl_state = ReplState::NONE;
+    }
+    if (client_fd == migration.fd) {
+        // keep the migration going, the cron reconnects and in_flight keys are sorted out then
+        migration.fd = -1;
+        migration.connected = false;
+        migration.handing_over = false;
+        migration.pending.clear();
+    }
+    replicas.erase(client_fd);
+    unwatch_all(client_fd);
+    unblock_client(client_fd);
+    pubsub_unsubscribe_all(client_fd);
+    disable_tracking(client_fd);
+    if (clients[client_fd].uring) {
+        // the ring holds its own reference to the socket, its pending receive only ends this way
+        shutdown(client_fd, SHUT_RDWR);
+    } else {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
+    }
+    if (clients[client_fd].http) --http_clients;
+    close(client_fd);
+    clients.erase(client_fd);
+}
+
+void RedisServer::handle_client(const int client_fd) {
+    if (clients[client_fd].close_asap) return;
+    char buf[1024];
+    const int n = read(client_fd, buf, sizeof(buf));
+    if (n <= 0) {
+        close_client(client_fd);
+        return;
+    }
+    client_input(client_fd, buf, n);
+}
+
+void RedisServer::client_input(const int client_fd, const char* data, const size_t n) {
+    auto& client = clients[client_fd];
+    client.buffer.append(data, n);
+    client.last_interaction_ms = now_ms();
+    stats.net_input_bytes += n;
+    // a client that never ends its line would make the buffer grow without bound
+    if (client.buffer.size() > config.client_query_buffer_limit && client_fd != master_fd) {
+        free_client_async(client_fd);
+        return;
+    }
+    if (client_fd == master_fd) {
+        replica_read_master();
+    } else if (client_fd == migration.fd) {
+        cluster_migration_read();
+    } else if (client.http) {
+        http_read(client_fd);
+    } else {
+        process_input_buffer(client_fd);
+    }
+}
+
+void RedisServer::process_input_buffer(const int client_fd) {
+    size_t pos;
+    // a blocked client keeps its remaining commands buffered until it is served
+    while (!clients[client_fd].blocked && !clients[client_fd].close_asap && (pos = clients[client_fd].buffer.find('\n')) != std::string::npos) {
+        std::string command = clients[client_fd].buffer.substr(0, pos);
+        clients[client_fd].buffer.erase(0, pos + 1);
+        if (clients[client_fd].is_master) master_offset += pos + 1;
+        parse_and_execute(client_fd, command);
+    }
+}
+
+void RedisServer::send_response(const int client_fd, const std::string& response) {
+    add_reply(client_fd, std::make_shared<const std::string>(response + "\n"));
+}
+
+void RedisServer::add_reply(const int client_fd, std::shared_ptr<const std::string> reply) {
+    auto& client = clients[client_fd];
+    if (client.close_asap || client.is_master) return;
+    client.reply_bytes += reply->size();
+    client.reply_queue.push_back(std::move(reply));
+    // if older replies are still queued the socket is full, the new one waits for EPOLLOUT
+    if (client.reply_queue.size() == 1) write_to_client(client_fd);
+    if (!client.reply_queue.empty()) check_output_limits(client_fd);
+}
+
+void RedisServer::write_to_client(const int client_fd) {
+    auto& client = clients[client_fd];
+    if (client.uring) {
+        uring_write(client_fd);
+        return;
+    }
+    while (!client.reply_queue.empty()) {
+        const auto& front = *client.reply_queue.front();
+        const ssize_t n = send(client_fd, front.data() + client.reply_offset,
+                               front.size() - client.reply_offset, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                free_client_async(client_fd);
+                return;
+            }
+            break;
+        }
+        client.reply_offset += n;
+        client.last_interaction_ms = now_ms();
+        stats.net_output_bytes += n;
+        client.reply_bytes -= n;
+        if (client.reply_offset == front.size()) {
+            client.reply_queue.pop_front();
+            client.reply_offset = 0;
+        }
+    }
+    if (const bool want_write = !client.reply_queue.empty(); want_write != client.want_write) {
+        client.want_write = want_write;
+        epoll_event ev { want_write ? EPOLLIN | EPOLLOUT : EPOLLIN, { .fd = client_fd } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &ev);
+    }
+    if (!client.want_write) client.soft_limit_since = 0;
+    if (client.reply_queue.empty() && client.close_after_reply) free_client_async(client_fd);
+}
+
+// a client that can not keep up would make its queue grow without bound, disconnect it instead
+void RedisServer::check_output_limits(const int client_fd) {
+    auto& client = clients[client_fd];
+    ClientClass cls = ClientClass::NORMAL;
+    if (client.is_replica) {
+        cls = ClientClass::REPLICA;
+    } else if (!client.channels.empty() || !client.patterns.empty()) {
+        cls = ClientClass::PUBSUB;
+    }
+    const auto& limit = config.client_output_buffer_limit[static_cast<int>(cls)];
+    if (limit.hard && client.reply_bytes > limit.hard) {
+        free_client_async(client_fd);
+    } else if (limit.soft && client.reply_bytes > limit.soft) {
+        const uint64_t now = now_ms();
+        if (client.soft_limit_since == 0) {
+            client.soft_limit_since = now;
+        } else if (now - client.soft_limit_since >= limit.soft_seconds * 1000) {
+            free_client_async(client_fd);
+        }
+    } else {
+        client.soft_limit_since = 0;
+    }
+}
+
+void RedisServer::free_client_async(const int client_fd) {
+    auto& client = clients[client_fd];
+    if (client.close_asap) return;
+    client.close_asap = true;
+    client.reply_queue.clear();
+    client.reply_bytes = 0;
+    clients_to_close.push_back(client_fd);
+}
+
+void RedisServer::uring_init() {
+    ring = std::make_unique<IoUring>();
+    if (!ring->init(URING_ENTRIES) || !ring->setup_buffers(URING_BUFFER_GROUP, URING_BUFFERS, URING_BUFFER_SIZE)) {
+        perror("io_uring unavailable, using epoll");
+        ring.reset();
+        config.io_backend = "epoll";
+        return;
+    }
+    // multishot accept and receive are flags the probe can not see, but both predate SENDMSG_ZC;
+    // a kernel refusing them anyway fails the first receive, which falls back to epoll then
+    if (!ring->supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_POLL_ADD, IORING_OP_SENDMSG,
+                         IORING_OP_SENDMSG_ZC, IORING_OP_TIMEOUT})) {
+        std::fprintf(stderr, "io_uring lacks the operations used, using epoll\n");
+        ring.reset();
+        config.io_backend = "epoll";
+        return;
+    }
+    // a non-blocking socket would fail the ring's requests with EAGAIN instead of letting them wait
+    for (const int fd : {listen_fd, unix_fd}) {
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        uring_arm_accept(fd);
+    }
+    uring_arm_epoll();
+}
+
+uint64_t RedisServer::uring_process_events(const int timeout) {
+    ring->wait(timeout);
+    const uint64_t loop_start = CycleClock::now();
+    ring->for_each_cqe([this](const io_uring_cqe& cqe) { uring_complete(cqe); });
+    if (uring_failed) uring_fallback();
+    return loop_start;
+}
+
+void RedisServer::uring_fallback() {
+    std::fprintf(stderr, "io_uring refused a receive, using epoll\n");
+    // closing the ring cancels its requests; the buffers of the sends in flight are kept, the
+    // kernel may still read them while it tears the ring down
+    ring.reset();
+    config.io_backend = "epoll";
+    for (const int fd : {listen_fd, unix_fd}) {
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        epoll_event ev { EPOLLIN, { .fd = fd } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    for (auto& [fd, client] : clients) {
+        if (!client.uring) continue;
+        client.uring = false;
+        client.send_in_flight = false;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        epoll_event ev { EPOLLIN, { .fd = fd } };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    for (auto& [fd, client] : clients) {
+        if (!client.reply_queue.empty()) write_to_client(fd);
+    }
+}
+
+// a multishot request posts a completion per connection, receive... until one comes without
+// IORING_CQE_F_MORE, it must be submitted again then
+void RedisServer::uring_arm_accept(const int listener) {
+    io_uring_sqe* sqe = ring->get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = uring_data(UringOp::ACCEPT, listener);
+}
+
+void RedisServer::uring_arm_epoll() {
+    io_uring_sqe* sqe = ring->get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = epoll_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = uring_data(UringOp::EPOLL);
+}
+
+void RedisServer::uring_arm_recv(const int client_fd) {
+    io_uring_sqe* sqe = ring->get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = client_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = uring_data(UringOp::RECV, client_fd, clients[client_fd].id);
+}
+
+// sends as much of reply_queue as one request can take, the completion sends the rest
+void RedisServer::uring_write(const int client_fd) {
+    auto& client = clients[client_fd];
+    if (client.send_in_flight || client.close_asap) return;
+    if (client.reply_queue.empty()) {
+        client.soft_limit_since = 0;
+        if (client.close_after_reply) free_client_async(client_fd);
+        return;
+    }
+    const uint64_t key = uring_data(UringOp::SEND, client_fd, client.id);
+    auto& send = uring_sends[key];
+    size_t bytes = 0, offset = client.reply_offset;
+    for (const auto& reply : client.reply_queue) {
+        if (send.iov.size() == URING_SEND_IOV_MAX) break;
+        send.buffers.push_back(reply);
+        send.iov.push_back({const_cast<char*>(reply->data()) + offset, reply->size() - offset});
+        bytes += reply->size() - offset;
+        offset = 0;
+    }
+    send.msg.msg_iov = send.iov.data();
+    send.msg.msg_iovlen = send.iov.size();
+    io_uring_sqe* sqe = ring->get_sqe();
+    sqe->opcode = bytes >= URING_ZERO_COPY_MIN ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = client_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&send.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = key;
+    client.send_in_flight = true;
+}
+
+void RedisServer::uring_complete(const io_uring_cqe& cqe) {
+    const auto op = static_cast<UringOp>(cqe.user_data >> 56);
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+    if (op == UringOp::ACCEPT) {
+        const int listener = static_cast<int>(cqe.user_data >> 32 & 0xffffff);
+        if (cqe.res >= 0) add_client(cqe.res, listener);
+        if (!more) uring_arm_accept(listener);
+        return;
+    }
+    if (op == UringOp::EPOLL) {
+        // the poll only fires again for new events, so a full batch may have left some behind
+        epoll_event events[EPOLL_BATCH];
+        int nfds;
+        do {
+            nfds = epoll_wait(epoll_fd, events, EPOLL_BATCH, 0);
+            epoll_dispatch(events, nfds);
+        } while (nfds == EPOLL_BATCH);
+        if (!more) uring_arm_epoll();
+        return;
+    }
+    if (op != UringOp::RECV && op != UringOp::SEND) return;
+
+    const int fd = static_cast<int>(cqe.user_data >> 32 & 0xffffff);
+    const auto it = clients.find(fd);
+    Client* client = it != clients.end() && (it->second.id & 0xffffffff) == (cqe.user_data & 0xffffffff)
+        ? &it->second : nullptr;
+    if (op == UringOp::RECV) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0) uring_recv_works = true;
+            if (client && cqe.res > 0 && !client->close_asap) client_input(fd, ring->buffer(bid), cqe.res);
+            ring->recycle_buffer(bid);
+        }
+        if (!client || clients.find(fd) == clients.end()) return;
+        // before any receive worked, the kernel refusing it is no fault of the client
+        if (!uring_recv_works && (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP)) {
+            uring_failed = true;
+            return;
+        }
+        if (cqe.res == 0 || (cqe.res < 0 && cqe.res != -ENOBUFS)) {
+            close_client(fd);
+        } else if (!more) {
+            uring_arm_recv(fd); // out of buffers, or the kernel ended the multishot
+        }
+        return;
+    }
+
+    // SEND: a zero copy send posts its result, then a notification once the buffers are released
+    const bool notification = cqe.flags & IORING_CQE_F_NOTIF;
+    if (client && !notification && !client->close_asap) {
+        if (cqe.res < 0) {
+            free_client_async(fd);
+        } else {
+            client->reply_bytes -= cqe.res;
+            client->last_interaction_ms = now_ms();
+            stats.net_output_bytes += cqe.res;
+            for (size_t sent = cqe.res; sent > 0;) {
+                const size_t left = client->reply_queue.front()->size() - client->reply_offset;
+                if (sent < left) {
+                    client->reply_offset += sent;
+                    break;
+                }
+                sent -= left;
+                client->reply_queue.pop_front();
+                client->reply_offset = 0;
+            }
+        }
+    }
+    if (more) return;
+    uring_sends.erase(cqe.user_data);
+    if (client) {
+        client->send_in_flight = false;
+        uring_write(fd);
+    }
+}
+
+// closes clients idle for longer than the timeout; replicas, the primary, blocked clients and
+// subscribers are expected to be quiet
+void RedisServer::clients_cron() {
+    if (config.timeout == 0) return;
+    const uint64_t now = now_ms();
+    for (const auto& [fd, client] : clients) {
+        if (client.is_master || client.is_replica || client.blocked || fd == migration.fd) continue;
+        if (!client.channels.empty() || !client.patterns.empty()) continue;
+        if (now - client.last_interaction_ms >= config.timeout * 1000) free_client_async(fd);
+    }
+}
+
+// one line of CLIENT LIST
+std::string RedisServer::client_info(const int client_fd) const {
+    const auto& client = clients.at(client_fd);
+    const uint64_t now = now_ms();
+    std::string flags;
+    if (client.is_master) flags += 'M';
+    if (client.is_replica) flags += 'S';
+    if (client.in_multi) flags += 'x';
+    if (client.blocked) flags += 'b';
+    if (client.tracking) flags += 't';
+    if (client.close_asap) flags += 'A';
+    if (flags.empty()) flags = "N";
+    return "id=" + std::to_string(client.id) + " addr=" + client.addr + " fd=" + std::to_string(client_fd) +
+           " name=" + client.name + " age=" + std::to_string((now - client.created_ms) / 1000) +
+           " idle=" + std::to_string((now - client.last_interaction_ms) / 1000) + " flags=" + flags +
+           " sub=" + std::to_string(client.channels.size()) + " psub=" + std::to_string(client.patterns.size()) +
+           " multi=" + (client.in_multi ? std::to_string(client.queued.size()) : "-1") +
+           " qbuf=" + std::to_string(client.buffer.size()) + " oll=" + std::to_string(client.reply_queue.size()) +
+           " omem=" + std::to_string(client.reply_bytes) +
+           " cmd=" + (client.last_command.empty() ? "NULL" : client.last_command);
+}
+
+std::string RedisServer::client_command(const int client_fd, const std::vector<std::string>& tokens) {
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub == "ID" && tokens.size() == 2) return std::to_string(clients[client_fd].id);
+    if (sub == "GETNAME" && tokens.size() == 2) {
+        const auto& name = clients[client_fd].name;
+        return name.empty() ? "(nil)" : name;
+    }
+    if (sub == "SETNAME" && tokens.size() == 3) {
+        // the name appears in CLIENT LIST, where spaces would break the line apart
+        for (const char c : tokens[2]) {
+            if (c <= ' ' || c > '~') {
+                return command_error("Client names cannot contain spaces, newlines or special characters");
+            }
+        }
+        clients[client_fd].name = tokens[2];
+        return "OK";
+    }
+    if (sub == "LIST" && tokens.size() == 2) {
+        std::vector<int> fds;
+        for (const auto& [fd, client] : clients) {
+            if (!client.http && fd != migration.fd) fds.push_back(fd);
+        }
+        std::sort(fds.begin(), fds.end(), [&](const int a, const int b) { return clients[a].id < clients[b].id; });
+        std::string result;
+        for (const int fd : fds) {
+            if (!result.empty()) result += "\n";
+            result += client_info(fd);
+        }
+        return result;
+    }
+    // the calling client still gets its reply
+    const auto kill_client = [&](const int fd) {
+        if (fd == client_fd) {
+            clients[fd].close_after_reply = true;
+        } else {
+            free_client_async(fd);
+        }
+    };
+    if (sub == "KILL" && tokens.size() == 3) {
+        // CLIENT KILL ip:port
+        for (const auto& [fd, client] : clients) {
+            if (client.addr == tokens[2] && !client.http && fd != migration.fd) {
+                kill_client(fd);
+                return "OK";
+            }
+        }
+        return command_error("No such client");
+    }
+    if (sub == "KILL" && tokens.size() >= 4 && tokens.size() % 2 == 0) {
+        // CLIENT KILL [ID id] [ADDR ip:port] [SKIPME yes|no], replies with the number of clients killed
+        std::vector<uint64_t> ids;
+        std::vector<std::string> addrs;
+        bool skipme = true;
+        for (size_t i = 2; i < tokens.size(); i += 2) {
+            std::string filter = tokens[i];
+            for (char& c : filter) c = static_cast<char>(toupper(c));
+            if (filter == "ID") {
+                try {
+                    size_t pos;
+                    ids.push_back(std::stoull(tokens[i + 1], &pos));
+                    if (pos != tokens[i + 1].size()) return command_error("Client id should be a positive integer");
+                } catch (...) {
+                    return command_error("Client id should be a positive integer");
+                }
+            } else if (filter == "ADDR") {
+                addrs.push_back(tokens[i + 1]);
+            } else if (filter == "SKIPME" && (tokens[i + 1] == "yes" || tokens[i + 1] == "no")) {
+                skipme = tokens[i + 1] == "yes";
+            } else {
+                return command_error("Unknown CLIENT KILL filter " + tokens[i]);
+            }
+        }
+        size_t killed = 0;
+        for (const auto& [fd, client] : clients) {
+            if (client.http || fd == migration.fd || (skipme && fd == client_fd)) continue;
+            if (!ids.empty() && std::find(ids.begin(), ids.end(), client.id) == ids.end()) continue;
+            if (!addrs.empty() && std::find(addrs.begin(), addrs.end(), client.addr) == addrs.end()) continue;
+            kill_client(fd);
+            ++killed;
+        }
+        return std::to_string(killed);
+    }
+    return command_error("Unknown CLIENT subcommand or incorrect argument number");
+}
+
+void RedisServer::parse_and_execute(const int client_fd, const std::string& command) {
+    auto tokens = split_command(command);
+    if (tokens.empty()) return;
+    for (char& i : tokens[0]) {
+        i = toupper(i);
+    }
+    const std::string& command_type = tokens[0];
+    const auto* spec = lookup_command(command_type);
+    auto& client = clients[client_fd];
+    // a write to a key read by a worker job waits for the job, with its command line back in the buffer
+    if (spec && spec->arity_ok(tokens.size()) && !client.in_multi && !client.is_master && touches_job_keys(*spec, tokens)) {
+        client.buffer.insert(0, command + "\n");
+        client.blocked = true;
+        job_waiters.emplace_back(client_fd, client.id);
+        return;
+    }
+    client.last_command = command_type;
+    for (char& c : client.last_command) c = static_cast<char>(tolower(c));
+    if (!client.channels.empty() || !client.patterns.empty()) {
+        if (command_type != "SUBSCRIBE" && command_type != "UNSUBSCRIBE" &&
+            command_type != "PSUBSCRIBE" && command_type != "PUNSUBSCRIBE") {
+            reject_command(spec);
+            send_response(client_fd, "Only (P)SUBSCRIBE / (P)UNSUBSCRIBE are allowed in this context");
+            return;
+        }
+    }
+    if (!master_host.empty() && !client.is_master) {
+        // a script is refused only when it runs a write, see script_command
+        if (spec && (spec->flags & CommandSpec::WRITE) && command_type != "EVAL" && command_type != "EVALSHA") {
+            reject_command(spec);
+            send_response(client_fd, "READONLY You can't write against a read only replica");
+            return;
+        }
+    }
+    if (const bool asking = std::exchange(client.asking, false); config.cluster_enabled && !client.is_master) {
+        if (spec && spec->arity_ok(tokens.size())) {
+            if (auto redirect = cluster_redirect(asking, *spec, tokens); !redirect.empty()) {
+                reject_command(spec);
+                if (client.in_multi) client.dirty_exec = true; // the transaction would run without it
+                send_response(client_fd, redirect);
+                return;
+            }
+        }
+    }
+    // every key named by a command counts once, when the command is received; the keys of a script
+    // count when it runs the commands that use them
+    if (spec && !(spec->flags & CommandSpec::NO_TOUCH) && command_type != "EVAL" && command_type != "EVALSHA") {
+        for (const auto& key : command_keys(*spec, tokens)) {
+            hot_keys.record(key, spec->flags & CommandSpec::WRITE);
+        }
+    }
+    if (command_type == "MULTI" || command_type == "EXEC" || command_type == "DISCARD" ||
+        command_type == "WATCH" || command_type == "UNWATCH") {
+        take_command_error();
+        const uint64_t start = CycleClock::now();
+        auto res = transaction_command(client_fd, tokens);
+        record_command(client_fd, *spec, tokens, CycleClock::now() - start, take_command_error());
+        send_response(client_fd, res);
+        serve_ready_keys();
+        return;
+    }
+    if (client.in_multi) {
+        // validate now so that a malformed transaction is rejected as a whole by EXEC
+        if (!spec) {
+            reject_command(spec);
+            client.dirty_exec = true;
+            send_response(client_fd, "Unknown command " + command_type);
+        } else if (!spec->arity_ok(tokens.size())) {
+            reject_command(spec);
+            client.dirty_exec = true;
+            send_response(client_fd, "Incorrect argument number");
+        } else {
+            client.queued.push_back(std::move(tokens));
+            send_response(client_fd, "QUEUED");
+        }
+        return;
+    }
+    auto res = call(client_fd, tokens);
+    if (!client.blocked && !client.is_replica) send_response(client_fd, res);
+    serve_ready_keys();
+}
+
+std::string RedisServer::call(const int client_fd, std::vector<std::string>& tokens) {
+    const auto* spec = lookup_command(tokens[0]);
+    const bool valid = spec && spec->arity_ok(tokens.size());
+    // writers that can not wait in line (the primary link, transactions, scripts) wait for the jobs
+    if (valid && touches_job_keys(*spec, tokens)) wait_for_jobs();
+    // the types of the keys written, for the per type key counts
+    std::vector<std::string> keys;
+    std::vector<int> types;
+    if (valid && (spec->flags & CommandSpec::WRITE)) {
+        keys = command_keys(*spec, tokens);
+        for (const auto& key : keys) types.push_back(key_type(key));
+    }
+    take_command_error(); // left by code that ran outside of a command, e.g. serve_ready_keys
+    const uint64_t start = CycleClock::now();
+    ++call_depth;
+    auto res = execute_command(client_fd, tokens);
+    --call_depth;
+    const bool failed = take_command_error();
+    if (valid) {
+        record_command(client_fd, *spec, tokens, CycleClock::now() - start, failed);
+    } else {
+        reject_command(spec); // the handler replied with the error
+    }
+    if (valid && !(spec->flags & CommandSpec::NO_TOUCH)) record_access(*spec, tokens);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        recount_key(keys[i], types[i]);
+    }
+    if (spec && (spec->flags & CommandSpec::WRITE)) {
+        // a blocking pop that parked the client changed nothing, list_move touches the keys once served
+        if (!clients[client_fd].blocked) {
+            for (const auto& key : keys) {
+                touch_key(key);
+            }
+        }
+        // only the outermost command is replicated, a script is replicated as a whole
+        if (call_depth == 0 && !(spec->flags & CommandSpec::NO_PROPAGATE)) {
+            if (tokens[0] == "EVALSHA" && tokens.size() > 1) {
+                // replicas may not have the script cached
+                std::string sha = tokens[1];
+                for (char& c : sha) c = static_cast<char>(tolower(c));
+                if (const auto it = scripts.find(sha); it != scripts.end()) {
+                    auto eval = tokens;
+                    eval[0] = "EVAL";
+                    eval[1] = it->second->source();
+                    propagate(eval);
+                }
+            } else {
+                propagate(tokens);
+            }
+        }
+    } else if (spec && clients[client_fd].tracking && !clients[client_fd].tracking_bcast) {
+        for (const auto& key : command_keys(*spec, tokens)) {
+            track_key(client_fd, key);
+        }
+    }
+    return res;
+}
+
+void RedisServer::touch_key(const std::string& key) {
+    if (const auto it = watched_keys.find(key); it != watched_keys.end()) {
+        for (const int fd : it->second) {
+            clients[fd].dirty_cas = true;
+        }
+    }
+    invalidate_key(key);
+    cluster_update_slot_index(key);
+    key_index_update(key);
+    if (migration.in_flight.count(key)) migration.dirty.insert(key);
+}
+
+void RedisServer::unwatch_all(const int client_fd) {
+    auto& client = clients[client_fd];
+    for (const auto& key : client.watched_keys) {
+        if (const auto it = watched_keys.find(key); it != watched_keys.end()) {
+            it->second.erase(client_fd);
+            if (it->second.empty()) watched_keys.erase(it);
+        }
+    }
+    client.watched_keys.clear();
+    client.dirty_cas = false;
+}
+
+std::string RedisServer::transaction_command(const int client_fd, const std::vector<std::string>& tokens) {
+    auto& client = clients[client_fd];
+    const std::string& command_type = tokens[0];
+    if (command_type == "WATCH") {
+        if (tokens.size() < 2) return command_error("Incorrect argument number");
+        if (client.in_multi) return command_error("WATCH inside MULTI is not allowed");
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            if (client.watched_keys.insert(tokens[i]).second) {
+                watched_keys[tokens[i]].insert(client_fd);
+            }
+        }
+        return "OK";
+    }
+    if (tokens.size() != 1) return command_error("Incorrect argument number");
+    if (command_type == "UNWATCH") {
+        unwatch_all(client_fd);
+        return "OK";
+    }
+    if (command_type == "MULTI") {
+        if (client.in_multi) return command_error("MULTI calls can not be nested");
+        client.in_multi = true;
+        return "OK";
+    }
+    if (!client.in_multi) return command_error(command_type + " without MULTI");
+    auto queued = std::move(client.queued);
+    const bool aborted = client.dirty_exec;
+    const bool cas_failed = client.dirty_cas;
+    client.in_multi = false;
+    client.dirty_exec = false;
+    client.queued.clear();
+    unwatch_all(client_fd);
+    if (command_type == "DISCARD") return "OK";
+    if (aborted) return command_error("Transaction discarded because of previous errors");
+    if (cas_failed) return "(nil)";
+
+    // run every queued command back-to-back: nothing else is served until the whole batch is done
+    std::string result;
+    // replicas apply the writes of a transaction as a transaction too
+    const bool has_writes = std::any_of(queued.begin(), queued.end(), [](const auto& command) {
+        const auto* spec = lookup_command(command[0]);
+        return spec && (spec->flags & CommandSpec::WRITE);
+    });
+    if (has_writes) propagate({"MULTI"});
+    client.deny_blocking = true;
+    exec_running = true;
+    for (size_t i = 0; i < queued.size(); ++i) {
+        if (i > 0) result += "\n";
+        result += std::to_string(i + 1) + ") " + call(client_fd, queued[i]);
+    }
+    exec_running = false;
+    client.deny_blocking = false;
+    if (has_writes) propagate({"EXEC"});
+    return queued.empty() ? "(empty array)" : result;
+}
+
+std::string RedisServer::script_command(const int client_fd, const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    if (command_type == "SCRIPT") {
+        std::string sub = tokens[1];
+        for (char& c : sub) c = static_cast<char>(toupper(c));
+        if (sub == "LOAD" && tokens.size() == 3) {
+            const auto sha = sha1_hex(tokens[2]);
+            if (scripts.find(sha) == scripts.end()) {
+                try {
+                    scripts.emplace(sha, Script::compile(tokens[2]));
+                } catch (const ScriptError& e) {
+                    return command_error(std::string("Script compile error: ") + e.what());
+                }
+            }
+            return sha;
+        }
+        if (sub == "EXISTS" && tokens.size() >= 3) {
+            std::string result;
+            for (size_t i = 2; i < tokens.size(); ++i) {
+                if (i > 2) result += "\n";
+                result += std::to_string(i - 1) + ") " + (scripts.count(tokens[i]) ? "1" : "0");
+            }
+            return result;
+        }
+        if (sub == "FLUSH" && tokens.size() == 2) {
+            scripts.clear();
+            return "OK";
+        }
+        return command_error("Unknown SCRIPT subcommand or incorrect argument number");
+    }
+
+    // EVAL script numkeys [key ...] [arg ...], EVALSHA sha1 numkeys [key ...] [arg ...]
+    int numkeys;
+    try {
+        numkeys = std::stoi(tokens[2]);
+    } catch (...) {
+        return command_error("Number of keys should be an integer");
+    }
+    if (numkeys < 0 || 3 + static_cast<size_t>(numkeys) > tokens.size()) {
+        return command_error("Number of keys can not be greater than number of args");
+    }
+
+    std::shared_ptr<const Script> script;
+    if (command_type == "EVAL") {
+        const auto sha = sha1_hex(tokens[1]);
+        if (const auto it = scripts.find(sha); it != scripts.end()) {
+            script = it->second;
+        } else {
+            try {
+                script = Script::compile(tokens[1]);
+            } catch (const ScriptError& e) {
+                return command_error(std::string("Script compile error: ") + e.what());
+            }
+            scripts.emplace(sha, script);
+        }
+    } else {
+        std::string sha = tokens[1];
+        for (char& c : sha) c = static_cast<char>(tolower(c));
+        const auto it = scripts.find(sha);
+        if (it == scripts.end()) return command_error("NOSCRIPT No matching script");
+        script = it->second;
+    }
+
+    const std::vector<std::string> keys(tokens.begin() + 3, tokens.begin() + 3 + numkeys);
+    const std::vector<std::string> args(tokens.begin() + 3 + numkeys, tokens.end());
+    auto& client = clients[client_fd];
+    const bool deny_blocking = client.deny_blocking;
+    client.deny_blocking = true;
+    std::string res;
+    try {
+        res = script->run(keys, args, [this, client_fd](std::vector<std::string>& command) {
+            const auto* spec = lookup_command(command[0]);
+            if (spec && (spec->flags & CommandSpec::WRITE) && !master_host.empty() && !clients[client_fd].is_master) {
+                throw ScriptError("READONLY You can't write against a read only replica");
+            }
+            // read or written as the command the script runs, not as the script
+            if (spec && !(spec->flags & CommandSpec::NO_TOUCH)) {
+                for (const auto& key : command_keys(*spec, command)) {
+                    hot_keys.record(key, spec->flags & CommandSpec::WRITE);
+                }
+            }
+            return call(client_fd, command);
+        });
+    } catch (const ScriptError& e) {
+        res = command_error(std::string("Script error: ") + e.what());
+    }
+    client.deny_blocking = deny_blocking;
+    return res;
+}
+
+bool RedisServer::list_ready(const std::string& key) const {
+    const auto it = kv_store.find(key);
+    return it != kv_store.end() && it->second.type() == RedisObject::Type::LIST && it->second.l_len() != "0";
+}
+
+// pops an element from src, which must be a non-empty list, and pushes it to dst unless dst is empty
+std::string RedisServer::list_move(const std::string& src, const bool pop_left, const std::string& dst, const bool push_left) {
+    if (!dst.empty()) {
+        if (const auto it = kv_store.find(dst); it != kv_store.end() && it->second.type() != RedisObject::Type::LIST) {
+            return command_error("Redis object type error");
+        }
+    }
+    auto& list = kv_store.at(src);
+    auto value = pop_left ? list.l_pop() : list.r_pop();
+    if (list.l_len() == "0") kv_store.erase(src);
+    touch_key(src);
+    // replicated as the equivalent non-blocking commands, unless a script is replicated as a whole
+    if (call_depth <= 1) propagate({pop_left ? "LPOP" : "RPOP", src});
+    if (dst.empty()) return "1) " + src + "\n2) " + value;
+
+    auto it = kv_store.find(dst);
+    if (it == kv_store.end()) {
+        it = kv_store.emplace(dst, RedisObject(RedisObject::Type::LIST)).first;
+    }
+    if (push_left) {
+        it->second.l_push(value);
+    } else {
+        it->second.r_push(value);
+    }
+    touch_key(dst);
+    if (call_depth <= 1) propagate({push_left ? "LPUSH" : "RPUSH", dst, value});
+    signal_key_as_ready(dst);
+    return value;
+}
+
+std::string RedisServer::bitmap_command(const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    const auto parse_int = [](const std::string& s, int64_t& out) {
+        try {
+            size_t pos;
+            out = std::stoll(s, &pos);
+            return pos == s.size();
+        } catch (...) {
+            return false;
+        }
+    };
+    // offsets stay within a 512 MB string, as in Redis
+    const auto parse_offset = [&](const std::string& s, const uint64_t multiplier, uint64_t& out) {
+        int64_t n;
+        if (!parse_int(s, n) || n < 0 || static_cast<uint64_t>(n) * multiplier >= uint64_t(1) << 32) return false;
+        out = static_cast<uint64_t>(n) * multiplier;
+        return true;
+    };
+
+    if (command_type == "BITOP") {
+        // BITOP AND|OR|XOR|NOT destkey key [key ...], a missing key is an empty string
+        std::string name = tokens[1];
+        for (char& c : name) c = static_cast<char>(toupper(c));
+        BitOp op;
+        if (name == "AND") op = BitOp::AND;
+        else if (name == "OR") op = BitOp::OR;
+        else if (name == "XOR") op = BitOp::XOR;
+        else if (name == "NOT") op = BitOp::NOT;
+        else return command_error("Operation should be AND, OR, XOR or NOT");
+        if (op == BitOp::NOT && tokens.size() != 4) return command_error("BITOP NOT takes a single source key");
+        static const std::string empty;
+        std::vector<const std::string*> sources;
+        for (size_t i = 3; i < tokens.size(); ++i) {
+            const auto it = kv_store.find(tokens[i]);
+            if (it == kv_store.end()) {
+                sources.push_back(&empty);
+            } else if (const std::string* bytes = it->second.bytes()) {
+                sources.push_back(bytes);
+            } else {
+                return command_error("Redis object type error");
+            }
+        }
+        std::string result = bitmap_op(op, sources);
+        const size_t len = result.size();
+        kv_store.erase(tokens[2]);
+        if (len > 0) {
+            auto ro = RedisObject(RedisObject::Type::STRING);
+            ro.set_bytes(std::move(result));
+            kv_store.emplace(tokens[2], std::move(ro));
+        }
+        return std::to_string(len);
+    }
+
+    const auto it = kv_store.find(tokens[1]);
+    if (command_type == "SETBIT") {
+        uint64_t offset;
+        if (!parse_offset(tokens[2], 1, offset)) return command_error("Bit offset is not an integer or out of range");
+        if (tokens[3] != "0" && tokens[3] != "1") return command_error("Bit should be 0 or 1");
+        if (it == kv_store.end()) {
+            auto ro = RedisObject(RedisObject::Type::STRING);
+            auto res = ro.set_bit(offset, tokens[3] == "1");
+            kv_store.emplace(tokens[1], std::move(ro));
+            return res;
+        }
+        return it->second.set_bit(offset, tokens[3] == "1");
+    }
+    if (command_type == "GETBIT") {
+        uint64_t offset;
+        if (!parse_offset(tokens[2], 1, offset)) return command_error("Bit offset is not an integer or out of range");
+        return it == kv_store.end() ? "0" : it->second.get_bit(offset);
+    }
+    if (command_type == "BITCOUNT") {
+        // BITCOUNT key [start end], bytes
+        if (tokens.size() != 2 && tokens.size() != 4) return command_error("Incorrect argument number");
+        int64_t start = 0, end = -1;
+        if (tokens.size() == 4 && (!parse_int(tokens[2], start) || !parse_int(tokens[3], end))) {
+            return command_error("Start and end should be integers");
+        }
+        return it == kv_store.end() ? "0" : it->second.bit_count(start, end);
+    }
+    if (command_type == "BITPOS") {
+        // BITPOS key bit [start [end]], bytes
+        if (tokens.size() > 5) return command_error("Incorrect argument number");
+        if (tokens[2] != "0" && tokens[2] != "1") return command_error("Bit should be 0 or 1");
+        const int bit = tokens[2] == "1";
+        int64_t start = 0, end = -1;
+        if ((tokens.size() > 3 && !parse_int(tokens[3], start)) || (tokens.size() > 4 && !parse_int(tokens[4], end))) {
+            return command_error("Start and end should be integers");
+        }
+        if (it == kv_store.end()) return bit ? "-1" : "0";
+        return it->second.bit_pos(bit, start, end, tokens.size() == 5);
+    }
 
-    sockaddr_in addr {};
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY; // Listen on all available network interfaces
-    addr.sin_port = htons(port);
-    bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
-    listen(listen_fd, SOMAXCONN);
+    // BITFIELD key [GET type offset] [SET type offset value] [INCRBY type offset increment]
+    //          [OVERFLOW WRAP|SAT|FAIL] ..., type i1..i64 or u1..u63, offset N or #N (N fields in)
+    std::vector<BitfieldOp> ops;
+    auto overflow = BitfieldOp::Overflow::WRAP;
+    bool writes = false;
+    for (size_t i = 2; i < tokens.size();) {
+        std::string sub = tokens[i];
+        for (char& c : sub) c = static_cast<char>(toupper(c));
+        if (sub == "OVERFLOW" && i + 1 < tokens.size()) {
+            std::string behavior = tokens[i + 1];
+            for (char& c : behavior) c = static_cast<char>(toupper(c));
+            if (behavior == "WRAP") overflow = BitfieldOp::Overflow::WRAP;
+            else if (behavior == "SAT") overflow = BitfieldOp::Overflow::SAT;
+            else if (behavior == "FAIL") overflow = BitfieldOp::Overflow::FAIL;
+            else return command_error("Overflow should be WRAP, SAT or FAIL");
+            i += 2;
+            continue;
+        }
+        BitfieldOp op {};
+        if (sub == "GET") op.kind = BitfieldOp::Kind::GET;
+        else if (sub == "SET") op.kind = BitfieldOp::Kind::SET;
+        else if (sub == "INCRBY") op.kind = BitfieldOp::Kind::INCRBY;
+        else return command_error("Unknown BITFIELD subcommand " + tokens[i]);
+        const size_t args = op.kind == BitfieldOp::Kind::GET ? 2 : 3;
+        if (i + args >= tokens.size()) return command_error("Incorrect argument number");
+        const std::string& type = tokens[i + 1];
+        int64_t bits;
+        op.is_signed = !type.empty() && (type[0] == 'i' || type[0] == 'I');
+        if (type.empty() || (!op.is_signed && type[0] != 'u' && type[0] != 'U') ||
+            !parse_int(type.substr(1), bits) || bits < 1 || bits > (op.is_signed ? 64 : 63)) {
+            return command_error("Type should be i1 to i64 or u1 to u63");
+        }
+        op.bits = static_cast<unsigned>(bits);
+        const std::string& offset = tokens[i + 2];
+        const bool in_fields = !offset.empty() && offset[0] == '#';
+        if (!parse_offset(in_fields ? offset.substr(1) : offset, in_fields ? op.bits : 1, op.offset)) {
+            return command_error("Bit offset is not an integer or out of range");
+        }
+        if (args == 3 && !parse_int(tokens[i + 3], op.value)) return command_error("Value should be an integer");
+        op.overflow = overflow;
+        writes |= op.kind != BitfieldOp::Kind::GET;
+        ops.push_back(op);
+        i += args + 1;
+    }
+    if (it != kv_store.end()) return it->second.bit_field(ops);
+    auto ro = RedisObject(RedisObject::Type::STRING);
+    auto res = ro.bit_field(ops);
+    if (writes && !ro.bytes()->empty()) kv_store.emplace(tokens[1], std::move(ro));
+    return res;
+}
 
-    epoll_fd = epoll_create1(0);
-    epoll_event ev { EPOLLIN, { .fd = listen_fd } };
-    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+std::string RedisServer::geo_command(const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    const auto upper = [](std::string s) {
+        for (char& c : s) c = static_cast<char>(toupper(c));
+        return s;
+    };
+    const auto parse_double = [](const std::string& s, double& out) {
+        try {
+            size_t pos;
+            out = std::stod(s, &pos);
+            return pos == s.size() && std::isfinite(out);
+        } catch (...) {
+            return false;
+        }
+    };
+    const auto parse_coordinates = [&](const std::string& lon, const std::string& lat, double& longitude, double& latitude) {
+        return parse_double(lon, longitude) && parse_double(lat, latitude) && longitude >= GEO_LONGITUDE_MIN &&
+               longitude <= GEO_LONGITUDE_MAX && latitude >= GEO_LATITUDE_MIN && latitude <= GEO_LATITUDE_MAX;
+    };
+    // meters in a unit
+    const auto parse_unit = [&](const std::string& s, double& meters) {
+        const std::string unit = upper(s);
+        if (unit == "M") meters = 1;
+        else if (unit == "KM") meters = 1000;
+        else if (unit == "FT") meters = 0.3048;
+        else if (unit == "MI") meters = 1609.34;
+        else return false;
+        return true;
+    };
+    const auto format_distance = [](const double distance) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.4f", distance);
+        return std::string(buf);
+    };
+
+    const auto it = kv_store.find(tokens[1]);
+    const ZSet* zset = it == kv_store.end() ? nullptr : it->second.zset();
+    if (it != kv_store.end() && !zset) return command_error("Redis object type error");
+    // the score of a member, null if there is no such member
+    const auto find_score = [&](const std::string& member) -> const double* {
+        if (!zset) return nullptr;
+        const auto found = zset->map.find(member);
+        return found == zset->map.end() ? nullptr : &found->second;
+    };
+
+    if (command_type == "GEOADD") {
+        // GEOADD key [NX|XX] [CH] longitude latitude member [longitude latitude member ...]
+        size_t i = 2;
+        bool nx = false, xx = false, ch = false;
+        for (; i < tokens.size(); ++i) {
+            const std::string option = upper(tokens[i]);
+            if (option == "NX") nx = true;
+            else if (option == "XX") xx = true;
+            else if (option == "CH") ch = true;
+            else break;
+        }
+        if (nx && xx) return command_error("XX and NX options at the same time are not compatible");
+        if (i >= tokens.size() || (tokens.size() - i) % 3 != 0) return command_error("Incorrect argument number");
+        std::vector<std::pair<uint64_t, const std::string*>> points;
+        for (; i < tokens.size(); i += 3) {
+            double longitude, latitude;
+            if (!parse_coordinates(tokens[i], tokens[i + 1], longitude, latitude)) {
+                return command_error("Invalid longitude,latitude pair " + tokens[i] + "," + tokens[i + 1]);
+            }
+            points.emplace_back(geohash_encode(longitude, latitude), &tokens[i + 2]);
+        }
+        RedisObject& ro = it == kv_store.end()
+            ? kv_store.emplace(tokens[1], RedisObject(RedisObject::Type::ZSET)).first->second
+            : it->second;
+        size_t added = 0, changed = 0;
+        for (const auto& [hash, member] : points) {
+            const auto& map = ro.zset()->map;
+            const auto existing = map.find(*member);
+            const bool exists = existing != map.end();
+            if ((nx && exists) || (xx && !exists)) continue;
+            const auto score = static_cast<double>(hash);
+            if (exists && existing->second == score) continue;
+            ro.z_add(score, *member);
+            added += !exists;
+            ++changed;
+        }
+        if (ro.zset()->map.empty()) kv_store.erase(tokens[1]); // XX on a new key
+        return std::to_string(ch ? changed : added);
+    }
+    if (command_type == "GEOPOS") {
+        std::string result;
+        for (size_t i = 2; i < tokens.size(); ++i) {
+            if (i > 2) result += "\n";
+            result += std::to_string(i - 1) + ") ";
+            const double* score = find_score(tokens[i]);
+            if (!score) {
+                result += "(nil)";
+                continue;
+            }
+            double longitude, latitude;
+            geohash_decode(static_cast<uint64_t>(*score), longitude, latitude);
+            result += std::to_string(longitude) + " " + std::to_string(latitude);
+        }
+        return result.empty() ? "(empty array)" : result;
+    }
+    if (command_type == "GEODIST") {
+        // GEODIST key member1 member2 [M|KM|FT|MI]
+        double unit = 1;
+        if (tokens.size() > 5 || (tokens.size() == 5 && !parse_unit(tokens[4], unit))) {
+            return command_error("Unit should be M, KM, FT or MI");
+        }
+        const double *a = find_score(tokens[2]), *b = find_score(tokens[3]);
+        if (!a || !b) return "(nil)";
+        double longitude1, latitude1, longitude2, latitude2;
+        geohash_decode(static_cast<uint64_t>(*a), longitude1, latitude1);
+        geohash_decode(static_cast<uint64_t>(*b), longitude2, latitude2);
+        return format_distance(geo_distance(longitude1, latitude1, longitude2, latitude2) / unit);
+    }
+
+    // GEOSEARCH key FROMMEMBER member | FROMLONLAT longitude latitude
+    //           BYRADIUS radius unit | BYBOX width height unit
+    //           [ASC|DESC] [COUNT count [ANY]] [WITHCOORD] [WITHDIST] [WITHHASH]
+    double longitude = 0, latitude = 0, width = 0, height = 0, unit = 1;
+    bool has_center = false, by_radius = false, by_box = false, any = false;
+    bool with_coord = false, with_dist = false, with_hash = false;
+    int order = 0; // 1 ascending, -1 descending
+    size_t count = 0;
+    for (size_t i = 2; i < tokens.size(); ++i) {
+        const std::string option = upper(tokens[i]);
+        const size_t left = tokens.size() - i - 1;
+        if (option == "FROMMEMBER" && left >= 1) {
+            const double* score = find_score(tokens[++i]);
+            if (!score) return command_error("Could not decode requested zset member");
+            geohash_decode(static_cast<uint64_t>(*score), longitude, latitude);
+            has_center = true;
+        } else if (option == "FROMLONLAT" && left >= 2) {
+            if (!parse_coordinates(tokens[i + 1], tokens[i + 2], longitude, latitude)) {
+                return command_error("Invalid longitude,latitude pair " + tokens[i + 1] + "," + tokens[i + 2]);
+            }
+            i += 2;
+            has_center = true;
+        } else if (option == "BYRADIUS" && left >= 2) {
+            if (!parse_double(tokens[i + 1], width) || width < 0) {
+                return command_error("Radius should be a non-negative number");
+            }
+            if (!parse_unit(tokens[i + 2], unit)) return command_error("Unit should be M, KM, FT or MI");
+            width = height = width * 2 * unit;
+            i += 2;
+            by_radius = true;
+        } else if (option == "BYBOX" && left >= 3) {
+            if (!parse_double(tokens[i + 1], width) || !parse_double(tokens[i + 2], height) || width < 0 || height < 0) {
+                return command_error("Width and height should be non-negative numbers");
+            }
+            if (!parse_unit(tokens[i + 3], unit)) return command_error("Unit should be M, KM, FT or MI");
+            width *= unit;
+            height *= unit;
+            i += 3;
+            by_box = true;
+        } else if (option == "ASC" || option == "DESC") {
+            order = option == "ASC" ? 1 : -1;
+        } else if (option == "COUNT" && left >= 1) {
+            long long n;
+            try {
+                n = std::stoll(tokens[++i]);
+            } catch (...) {
+                n = 0;
+            }
+            if (n <= 0) return command_error("COUNT must be > 0");
+            count = static_cast<size_t>(n);
+            if (i + 1 < tokens.size() && upper(tokens[i + 1]) == "ANY") {
+                any = true;
+                ++i;
+            }
+        } else if (option == "WITHCOORD") {
+            with_coord = true;
+        } else if (option == "WITHDIST") {
+            with_dist = true;
+        } else if (option == "WITHHASH") {
+            with_hash = true;
+        } else {
+            return command_error("Unknown option or incorrect argument number " + tokens[i]);
+        }
+    }
+    if (!has_center || by_radius == by_box) {
+        return command_error("Exactly one of FROMMEMBER or FROMLONLAT, and one of BYRADIUS or BYBOX, are needed");
+    }
+    if (!zset) return "(empty array)";
+    if (count > 0 && !any && order == 0) order = 1; // the nearest count points
+
+    struct Match {
+        const std::string* member;
+        double distance;
+        uint64_t hash;
+        double longitude, latitude;
+    };
+    std::vector<Match> matches;
+    // only the cells around the center are scanned, then each point is checked exactly
+    for (const auto& [min, max] : geohash_ranges(longitude, latitude, width, height)) {
+        for (const auto& name : zset->skipList.rangeByScore(static_cast<double>(min), false, static_cast<double>(max), true)) {
+            const auto member = zset->map.find(name);
+            Match m {&member->first, 0, static_cast<uint64_t>(member->second), 0, 0};
+            geohash_decode(m.hash, m.longitude, m.latitude);
+            m.distance = geo_distance(longitude, latitude, m.longitude, m.latitude);
+            if (by_radius && m.distance > width / 2) continue;
+            if (by_box && (geo_distance(longitude, latitude, longitude, m.latitude) > height / 2 ||
+                           geo_distance(longitude, m.latitude, m.longitude, m.latitude) > width / 2)) {
+                continue;
+            }
+            matches.push_back(m);
+            if (any && matches.size() == count) break;
+        }
+        if (any && matches.size() == count) break;
+    }
+    if (order != 0) {
+        std::sort(matches.begin(), matches.end(), [order](const Match& a, const Match& b) {
+            return order > 0 ? a.distance < b.distance : a.distance > b.distance;
+        });
+    }
+    if (count > 0 && matches.size() > count) matches.resize(count);
+
+    std::string result;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        const Match& m = matches[i];
+        if (i > 0) result += "\n";
+        result += std::to_string(i + 1) + ") " + *m.member;
+        if (with_dist) result += " " + format_distance(m.distance / unit);
+        if (with_hash) result += " " + std::to_string(m.hash);
+        if (with_coord) result += " " + std::to_string(m.longitude) + " " + std::to_string(m.latitude);
+    }
+    return result.empty() ? "(empty array)" : result;
 }
 
-void RedisServer::run() {
-    while (true) {
-        epoll_event events[1024];
-        const int nfds = epoll_wait(epoll_fd, events, 1024, -1);
-        for (int i = 0; i < nfds; ++i) {
-            if (events[i].data.fd == listen_fd) {
-                accept_connection();
+// destination numkeys key [key ...] [WEIGHTS weight ...] [AGGREGATE SUM|MIN|MAX], only the keys for
+// ZDIFFSTORE; a missing key is an empty sorted set and an empty result deletes the destination
+std::string RedisServer::zset_store_command(const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    size_t numkeys;
+    try {
+        size_t pos;
+        const long n = std::stol(tokens[2], &pos);
+        if (pos != tokens[2].size() || n <= 0) return command_error("At least 1 input key is needed");
+        numkeys = static_cast<size_t>(n);
+    } catch (...) {
+        return command_error("Numkeys should be an integer");
+    }
+    if (numkeys > tokens.size() - 3) return command_error("Incorrect argument number");
+
+    std::vector<double> weights(numkeys, 1);
+    auto aggregate = ZAggregate::SUM;
+    for (size_t i = 3 + numkeys; i < tokens.size(); ++i) {
+        std::string option = tokens[i];
+        for (char& c : option) c = static_cast<char>(toupper(c));
+        if (command_type == "ZDIFFSTORE") return command_error("Unknown option " + tokens[i]);
+        if (option == "WEIGHTS" && i + numkeys < tokens.size()) {
+            for (size_t k = 0; k < numkeys; ++k) {
+                const std::string& w = tokens[++i];
+                try {
+                    size_t pos;
+                    weights[k] = std::stod(w, &pos);
+                    if (pos != w.size()) return command_error("Weight should be a float number");
+                } catch (...) {
+                    return command_error("Weight should be a float number");
+                }
+            }
+        } else if (option == "AGGREGATE" && i + 1 < tokens.size()) {
+            std::string value = tokens[++i];
+            for (char& c : value) c = static_cast<char>(toupper(c));
+            if (value == "SUM") aggregate = ZAggregate::SUM;
+            else if (value == "MIN") aggregate = ZAggregate::MIN;
+            else if (value == "MAX") aggregate = ZAggregate::MAX;
+            else return command_error("Unknown option " + tokens[i]);
+        } else {
+            return command_error("Unknown option " + tokens[i]);
+        }
+    }
+
+    std::vector<const ZSet*> sets;
+    for (size_t k = 0; k < numkeys; ++k) {
+        const auto it = kv_store.find(tokens[3 + k]);
+        if (it == kv_store.end()) {
+            sets.push_back(nullptr);
+            continue;
+        }
+        const ZSet* zset = it->second.zset();
+        if (!zset) return command_error("Redis object type error");
+        sets.push_back(zset);
+    }
+    const auto op = command_type == "ZUNIONSTORE" ? ZStoreOp::UNION
+                    : command_type == "ZINTERSTORE" ? ZStoreOp::INTER : ZStoreOp::DIFF;
+    auto ro = RedisObject(RedisObject::Type::ZSET);
+    auto res = ro.z_store(op, sets, weights, aggregate);
+    // the inputs may include the destination, which is only replaced now
+    kv_store.erase(tokens[1]);
+    if (res != "0") kv_store.emplace(tokens[1], std::move(ro));
+    return res;
+}
+
+std::string RedisServer::stream_command(std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    const auto upper = [](std::string s) {
+        for (char& c : s) c = static_cast<char>(toupper(c));
+        return s;
+    };
+    const auto parse_count = [](const std::string& s, size_t& out) {
+        try {
+            size_t pos;
+            const long long n = std::stoll(s, &pos);
+            if (pos != s.size() || n < 0) return false;
+            out = static_cast<size_t>(n);
+            return true;
+        } catch (...) {
+            return false;
+        }
+    };
+    // range bounds: - and +, ms or ms-seq, prefixed with ( when exclusive
+    const auto parse_bound = [](std::string s, const bool is_end, StreamID& id) {
+        if (s == "-" || s == "+") {
+            id = s == "-" ? StreamID {} : StreamID::max();
+            return true;
+        }
+        const bool exclusive = !s.empty() && s[0] == '(';
+        if (exclusive) s.erase(0, 1);
+        if (!StreamID::parse(s, is_end ? UINT64_MAX : 0, id)) return false;
+        if (!exclusive) return true;
+        if (is_end) {
+            if (id == StreamID {}) return false;
+            id = id.seq > 0 ? StreamID {id.ms, id.seq - 1} : StreamID {id.ms - 1, UINT64_MAX};
+        } else {
+            if (id == StreamID::max()) return false;
+            id = id.seq < UINT64_MAX ? StreamID {id.ms, id.seq + 1} : StreamID {id.ms + 1, 0};
+        }
+        return true;
+    };
+    const auto format_entry = [](const StreamEntry& entry) {
+        std::string line = entry.id.str();
+        for (const auto& field : entry.fields) line += " " + field;
+        return line;
+    };
+    const auto format_entries = [&](const std::vector<StreamEntry>& entries) {
+        std::string result;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i > 0) result += "\n";
+            result += std::to_string(i + 1) + ") " + format_entry(entries[i]);
+        }
+        return result.empty() ? "(empty array)" : result;
+    };
+
+    if (command_type == "XREADGROUP") {
+        // XREADGROUP GROUP group consumer [COUNT count] [NOACK] STREAMS key [key ...] id [id ...]
+        if (upper(tokens[1]) != "GROUP") {
+            return command_error("Syntax error, XREADGROUP GROUP group consumer ... STREAMS key ... id ...");
+        }
+        const std::string& group_name = tokens[2];
+        const std::string& consumer = tokens[3];
+        size_t count = 0, i = 4;
+        bool noack = false;
+        for (; i < tokens.size(); ++i) {
+            const std::string option = upper(tokens[i]);
+            if (option == "COUNT" && i + 1 < tokens.size()) {
+                if (!parse_count(tokens[++i], count)) return command_error("Count should be a non-negative integer");
+            } else if (option == "NOACK") {
+                noack = true;
+            } else if (option == "STREAMS") {
+                break;
+            } else {
+                return command_error("Unknown option " + tokens[i]);
+            }
+        }
+        const size_t first_key = i + 1, streams = (tokens.size() - first_key) / 2;
+        if (i == tokens.size() || streams == 0 || (tokens.size() - first_key) % 2 != 0) {
+            return command_error("Unbalanced XREADGROUP list of streams: for each stream key an ID must be specified");
+        }
+        // every stream, group and ID is checked before any group changes
+        std::vector<std::pair<Stream*, StreamConsumerGroup*>> targets;
+        for (size_t k = 0; k < streams; ++k) {
+            const std::string& key = tokens[first_key + k];
+            const std::string& id_text = tokens[first_key + streams + k];
+            const auto it = kv_store.find(key);
+            Stream* stream = it == kv_store.end() ? nullptr : it->second.stream();
+            if (it != kv_store.end() && !stream) return command_error("Redis object type error");
+            const std::string no_group = "NOGROUP No such key '" + key + "' or consumer group '" + group_name + "'";
+            if (!stream) return no_group;
+            const auto group = stream->groups.find(group_name);
+            if (group == stream->groups.end()) return no_group;
+            if (StreamID after; id_text != ">" && !StreamID::parse(id_text, 0, after)) {
+                return command_error("Invalid stream ID " + id_text);
+            }
+            targets.emplace_back(stream, &group->second);
+        }
+        const uint64_t now = unix_ms();
+        std::string result;
+        size_t n = 0;
+        for (size_t k = 0; k < streams; ++k) {
+            const std::string& key = tokens[first_key + k];
+            const std::string& id_text = tokens[first_key + streams + k];
+            Stream* stream = targets[k].first;
+            StreamConsumerGroup& group = *targets[k].second;
+            group.consumers[consumer] = now;
+            std::vector<StreamEntry> entries;
+            if (id_text == ">") {
+                // entries never delivered to the group
+                const StreamID& last = group.last_delivered;
+                if (last == StreamID::max()) continue;
+                const StreamID start = last.seq < UINT64_MAX ? StreamID {last.ms, last.seq + 1} : StreamID {last.ms + 1, 0};
+                entries = stream->range(start, StreamID::max(), count, false);
+                for (const auto& entry : entries) {
+                    group.last_delivered = entry.id;
+                    if (noack) continue;
+                    auto& pending = group.pending[entry.id];
+                    pending = {consumer, now, pending.deliveries + 1};
+                }
             } else {
-                handle_client(events[i].data.fd);
+                // the history of the consumer: its pending entries after the ID
+                StreamID after;
+                StreamID::parse(id_text, 0, after);
+                for (auto p = group.pending.upper_bound(after); p != group.pending.end(); ++p) {
+                    if (count > 0 && entries.size() >= count) break;
+                    if (p->second.consumer != consumer) continue;
+                    auto found = stream->range(p->first, p->first, 1, false);
+                    // an entry trimmed away since it was delivered is reported without fields
+                    entries.push_back(found.empty() ? StreamEntry {p->first, {}} : std::move(found[0]));
+                    p->second.delivery_ms = now;
+                    ++p->second.deliveries;
+                }
+            }
+            for (const auto& entry : entries) {
+                if (n > 0) result += "\n";
+                result += std::to_string(++n) + ") " + key + " " + format_entry(entry);
+            }
+        }
+        return n == 0 ? "(nil)" : result;
+    }
+
+    if (command_type == "XGROUP") {
+        // XGROUP CREATE key group id|$ [MKSTREAM], XGROUP DESTROY key group
+        const std::string sub = upper(tokens[1]);
+        auto it = kv_store.find(tokens[2]);
+        if (it != kv_store.end() && !it->second.stream()) return command_error("Redis object type error");
+        if (sub == "CREATE" && (tokens.size() == 5 || (tokens.size() == 6 && upper(tokens[5]) == "MKSTREAM"))) {
+            if (it == kv_store.end()) {
+                if (tokens.size() == 5) return command_error("The XGROUP subcommand requires the key to exist");
+                it = kv_store.emplace(tokens[2], RedisObject(RedisObject::Type::STREAM)).first;
+            }
+            Stream* stream = it->second.stream();
+            StreamConsumerGroup group;
+            if (tokens[4] == "$") {
+                group.last_delivered = stream->last_id();
+            } else if (!StreamID::parse(tokens[4], 0, group.last_delivered)) {
+                return command_error("Invalid stream ID " + tokens[4]);
+            }
+            if (!stream->groups.emplace(tokens[3], std::move(group)).second) {
+                return command_error("BUSYGROUP Consumer Group name already exists");
+            }
+            return "OK";
+        }
+        if (sub == "DESTROY" && tokens.size() == 4) {
+            if (it == kv_store.end()) return command_error("The XGROUP subcommand requires the key to exist");
+            return it->second.stream()->groups.erase(tokens[3]) ? "1" : "0";
+        }
+        return command_error("Unknown XGROUP subcommand or incorrect argument number");
+    }
+
+    auto it = kv_store.find(tokens[1]);
+    Stream* stream = it == kv_store.end() ? nullptr : it->second.stream();
+    if (it != kv_store.end() && !stream) return command_error("Redis object type error");
+
+    // MAXLEN [~|=] threshold at tokens[i], advances i past it
+    const auto parse_maxlen = [&](size_t& i, size_t& maxlen, bool& approximate) {
+        if (i + 1 >= tokens.size() || upper(tokens[i]) != "MAXLEN") return false;
+        ++i;
+        approximate = tokens[i] == "~";
+        if ((approximate || tokens[i] == "=") && ++i >= tokens.size()) return false;
+        return parse_count(tokens[i++], maxlen);
+    };
+
+    if (command_type == "XADD") {
+        // XADD key [NOMKSTREAM] [MAXLEN [~|=] threshold] *|id field value [field value ...]
+        size_t i = 2, maxlen = 0;
+        bool nomkstream = false, trim = false, approximate = false;
+        if (upper(tokens[i]) == "NOMKSTREAM") {
+            nomkstream = true;
+            ++i;
+        }
+        if (upper(tokens[i]) == "MAXLEN") {
+            if (!parse_maxlen(i, maxlen, approximate)) {
+                return command_error("MAXLEN should be followed by a non-negative integer");
+            }
+            trim = true;
+        }
+        if (i + 3 > tokens.size() || (tokens.size() - i - 1) % 2 != 0) {
+            return command_error("Incorrect argument number");
+        }
+        if (!stream && nomkstream) return "(nil)";
+
+        const StreamID last = stream ? stream->last_id() : StreamID {};
+        StreamID id;
+        const std::string& id_text = tokens[i];
+        if (id_text == "*" || (id_text.size() > 2 && id_text.compare(id_text.size() - 2, 2, "-*") == 0)) {
+            // the sequence is generated, and the time too for *
+            if (id_text == "*") {
+                id.ms = std::max(unix_ms(), last.ms);
+            } else if (!StreamID::parse(id_text.substr(0, id_text.size() - 2), 0, id)) {
+                return command_error("Invalid stream ID " + id_text);
+            }
+            if (id.ms == last.ms) {
+                if (last.seq == UINT64_MAX) return command_error("The stream has exhausted the last possible ID");
+                id.seq = last.seq + 1;
             }
+        } else if (!StreamID::parse(id_text, 0, id)) {
+            return command_error("Invalid stream ID " + id_text);
         }
+        if (id == StreamID {}) return command_error("The ID specified in XADD must be greater than 0-0");
+        if (id <= last) {
+            return command_error("The ID specified in XADD is equal or smaller than the target stream top item");
+        }
+
+        if (!stream) {
+            it = kv_store.emplace(tokens[1], RedisObject(RedisObject::Type::STREAM)).first;
+            stream = it->second.stream();
+        }
+        stream->append(id, std::vector<std::string>(tokens.begin() + static_cast<long>(i) + 1, tokens.end()));
+        if (trim) stream->trim(maxlen, approximate);
+        // replicas get the ID that was generated here
+        tokens[i] = id.str();
+        return tokens[i];
+    }
+    if (command_type == "XLEN") {
+        if (tokens.size() != 2) return command_error("Incorrect argument number");
+        return stream ? std::to_string(stream->length()) : "0";
+    }
+    if (command_type == "XRANGE" || command_type == "XREVRANGE") {
+        // XRANGE key start end [COUNT count], XREVRANGE key end start [COUNT count]
+        const bool reverse = command_type == "XREVRANGE";
+        size_t count = 0;
+        if (tokens.size() == 6 && upper(tokens[4]) == "COUNT") {
+            if (!parse_count(tokens[5], count)) return command_error("Count should be a non-negative integer");
+            if (count == 0) return "(empty array)";
+        } else if (tokens.size() != 4) {
+            return command_error("Incorrect argument number");
+        }
+        StreamID start, end;
+        if (!parse_bound(tokens[reverse ? 3 : 2], false, start) || !parse_bound(tokens[reverse ? 2 : 3], true, end)) {
+            return command_error("Invalid stream ID");
+        }
+        if (!stream) return "(empty array)";
+        return format_entries(stream->range(start, end, count, reverse));
+    }
+    if (command_type == "XTRIM") {
+        // XTRIM key MAXLEN [~|=] threshold
+        size_t i = 2, maxlen;
+        bool approximate;
+        if (!parse_maxlen(i, maxlen, approximate) || i != tokens.size()) {
+            return command_error("XTRIM key MAXLEN [~|=] threshold");
+        }
+        return stream ? std::to_string(stream->trim(maxlen, approximate)) : "0";
+    }
+
+    // XACK key group id [id ...], XPENDING key group [start end count [consumer]]
+    const std::string no_group = "NOGROUP No such key '" + tokens[1] + "' or consumer group '" + tokens[2] + "'";
+    if (!stream) return no_group;
+    const auto group = stream->groups.find(tokens[2]);
+    if (group == stream->groups.end()) return no_group;
+    auto& pending = group->second.pending;
+    if (command_type == "XACK") {
+        size_t acked = 0;
+        for (size_t i = 3; i < tokens.size(); ++i) {
+            StreamID id;
+            if (!StreamID::parse(tokens[i], 0, id)) return command_error("Invalid stream ID " + tokens[i]);
+            acked += pending.erase(id);
+        }
+        return std::to_string(acked);
+    }
+    if (tokens.size() == 3) {
+        // summary: count, smallest and greatest ID, entries per consumer
+        if (pending.empty()) return "1) 0\n2) (nil)\n3) (nil)\n4) (empty array)";
+        std::map<std::string, size_t> per_consumer;
+        for (const auto& [id, entry] : pending) ++per_consumer[entry.consumer];
+        std::string result = "1) " + std::to_string(pending.size()) + "\n2) " + pending.begin()->first.str() +
+                             "\n3) " + pending.rbegin()->first.str();
+        size_t n = 3;
+        for (const auto& [consumer, entries] : per_consumer) {
+            result += "\n" + std::to_string(++n) + ") " + consumer + " " + std::to_string(entries);
+        }
+        return result;
+    }
+    if (tokens.size() != 6 && tokens.size() != 7) return command_error("Incorrect argument number");
+    StreamID start, end;
+    size_t count;
+    if (!parse_bound(tokens[3], false, start) || !parse_bound(tokens[4], true, end)) {
+        return command_error("Invalid stream ID");
+    }
+    if (!parse_count(tokens[5], count)) return command_error("Count should be a non-negative integer");
+    // id consumer idle-ms deliveries
+    const uint64_t now = unix_ms();
+    std::string result;
+    size_t n = 0;
+    for (auto p = pending.lower_bound(start); p != pending.end() && p->first <= end && n < count; ++p) {
+        if (tokens.size() == 7 && p->second.consumer != tokens[6]) continue;
+        if (n > 0) result += "\n";
+        result += std::to_string(++n) + ") " + p->first.str() + " " + p->second.consumer + " " +
+                  std::to_string(now > p->second.delivery_ms ? now - p->second.delivery_ms : 0) + " " +
+                  std::to_string(p->second.deliveries);
     }
+    return n == 0 ? "(empty array)" : result;
 }
 
-void RedisServer::accept_connection() const {
-    sockaddr_in client_addr {};
-    socklen_t client_len = sizeof(client_addr);
-    const int client_fd = accept(listen_fd, reinterpret_cast<sockaddr *>(&client_addr), &client_len);
-    fcntl(client_fd, F_SETFL, O_NONBLOCK);
+std::string RedisServer::blocking_command(const int client_fd, const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    auto& client = clients[client_fd];
 
-    epoll_event ev { EPOLLIN, { .fd = client_fd } };
-    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &ev);
+    // BLPOP key [key ...] timeout, BRPOP key [key ...] timeout, BLMOVE src dst LEFT|RIGHT LEFT|RIGHT timeout
+    bool pop_left = command_type == "BLPOP";
+    bool push_left = true;
+    std::string dst;
+    std::vector<std::string> keys(tokens.begin() + 1, tokens.end() - 1);
+    if (command_type == "BLMOVE") {
+        std::string from = tokens[3], to = tokens[4];
+        for (char& c : from) c = static_cast<char>(toupper(c));
+        for (char& c : to) c = static_cast<char>(toupper(c));
+        if ((from != "LEFT" && from != "RIGHT") || (to != "LEFT" && to != "RIGHT")) {
+            return command_error("Direction should be LEFT or RIGHT");
+        }
+        pop_left = from == "LEFT";
+        push_left = to == "LEFT";
+        dst = tokens[2];
+        keys = {tokens[1]};
+    }
+
+    double timeout;
+    try {
+        timeout = std::stod(tokens.back());
+    } catch (...) {
+        return command_error("Timeout should be a number");
+    }
+    if (!std::isfinite(timeout)) return command_error("Timeout should be a number");
+    if (timeout < 0) return command_error("Timeout should not be negative");
+    timeout = std::min(timeout, MAX_BLOCK_TIMEOUT);
+
+    for (const auto& key : keys) {
+        if (const auto it = kv_store.find(key); it != kv_store.end() && it->second.type() != RedisObject::Type::LIST) {
+            return command_error("Redis object type error");
+        }
+        if (list_ready(key)) return list_move(key, pop_left, dst, push_left);
+    }
+    if (client.deny_blocking) return "(nil)";
+
+    client.blocked = true;
+    client.block_id = ++next_block_id;
+    client.blocking_keys = keys;
+    client.block_pop_left = pop_left;
+    client.block_target = dst;
+    client.block_push_left = push_left;
+    for (const auto& key : keys) {
+        blocking_keys[key].push_back(client_fd);
+    }
+    if (timeout > 0) {
+        block_timers.add(client_fd, client.block_id, now_ms() + static_cast<uint64_t>(timeout * 1000));
+    }
+    return "";
 }
 
-void RedisServer::handle_client(const int client_fd) {
-    char buf[1024];
-    const int n = read(client_fd, buf, sizeof(buf));
-    if (n <= 0) {
-        close(client_fd);
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_fd, nullptr);
-        client_buffers.erase(client_fd);
-        return;
+void RedisServer::signal_key_as_ready(const std::string& key) {
+    if (blocking_keys.find(key) != blocking_keys.end()) {
+        ready_keys.push_back(key);
     }
+}
 
-    client_buffers[client_fd] += std::string(buf, n);
-    size_t pos;
-    while ((pos = client_buffers[client_fd].find('\n')) != std::string::npos) {
-        std::string command = client_buffers[client_fd].substr(0, pos);
-        client_buffers[client_fd].erase(0, pos + 1);
-        parse_and_execute(client_fd, command);
+// hand the data pushed by the last command to blocked clients, in the order they blocked
+void RedisServer::serve_ready_keys() {
+    while (!ready_keys.empty()) {
+        const auto keys = std::move(ready_keys);
+        ready_keys.clear();
+        for (const auto& key : keys) {
+            while (list_ready(key)) {
+                const auto it = blocking_keys.find(key);
+                if (it == blocking_keys.end()) break;
+                const int fd = it->second.front();
+                const auto& client = clients[fd];
+                const std::string target = client.block_target;
+                const int before = key_type(target);
+                const auto res = list_move(key, client.block_pop_left, target, client.block_push_left);
+                recount_key(key, static_cast<int>(RedisObject::Type::LIST)); // deleted once emptied
+                if (!target.empty()) recount_key(target, before);
+                unblock_client(fd);
+                send_response(fd, res);
+                unblocked_clients.push_back(fd);
+            }
+        }
     }
 }
 
-void RedisServer::send_response(const int client_fd, const std::string& response) {
-    const std::string resp = response + "\n";
-    send(client_fd, resp.c_str(), resp.size(), 0);
+void RedisServer::unblock_client(const int client_fd) {
+    auto& client = clients[client_fd];
+    if (!client.blocked) return;
+    for (const auto& key : client.blocking_keys) {
+        if (const auto it = blocking_keys.find(key); it != blocking_keys.end()) {
+            auto& fds = it->second;
+            fds.erase(std::remove(fds.begin(), fds.end(), client_fd), fds.end());
+            if (fds.empty()) blocking_keys.erase(it);
+        }
+    }
+    client.blocked = false;
+    client.blocking_keys.clear();
+    client.block_target.clear();
 }
 
-void RedisServer::parse_and_execute(const int client_fd, const std::string& command) {
-    auto tokens = std::vector<std::string>();
-    std::istringstream iss(command);
-    std::string token;
-    while (iss >> token) tokens.push_back(token);
+void RedisServer::expire_blocked_clients() {
+    for (const auto& timer : block_timers.advance(now_ms())) {
+        const auto it = clients.find(timer.fd);
+        if (it == clients.end() || !it->second.blocked || it->second.block_id != timer.id) continue;
+        unblock_client(timer.fd);
+        send_response(timer.fd, "(nil)");
+        unblocked_clients.push_back(timer.fd);
+    }
+}
 
-    if (tokens.empty()) return;
-    for (char& i : tokens[0]) {
-        i = toupper(i);
+namespace {
+
+std::string subscription_reply(const std::string& kind, const std::string& name, const size_t count) {
+    return "1) " + kind + "\n2) " + name + "\n3) " + std::to_string(count);
+}
+
+} // namespace
+
+std::string RedisServer::pubsub_command(const int client_fd, const std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    auto& client = clients[client_fd];
+    if (command_type == "PUBLISH") {
+        return std::to_string(publish(tokens[1], tokens[2]));
+    }
+
+    std::string result;
+    const auto append = [&result, &client](const std::string& kind, const std::string& name) {
+        if (!result.empty()) result += "\n";
+        result += subscription_reply(kind, name, client.channels.size() + client.patterns.size());
+    };
+    if (command_type == "SUBSCRIBE") {
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            if (client.channels.insert(tokens[i]).second) {
+                pubsub_channels[tokens[i]].insert(client_fd);
+            }
+            append("subscribe", tokens[i]);
+        }
+    } else if (command_type == "PSUBSCRIBE") {
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            if (client.patterns.insert(tokens[i]).second) {
+                auto& subscribers = pubsub_patterns[tokens[i]];
+                if (subscribers.empty()) pattern_trie.insert(tokens[i]);
+                subscribers.insert(client_fd);
+            }
+            append("psubscribe", tokens[i]);
+        }
+    } else {
+        const bool patterns = command_type == "PUNSUBSCRIBE";
+        auto& subscribed = patterns ? client.patterns : client.channels;
+        // without arguments, unsubscribe from everything
+        auto names = tokens.size() > 1 ? std::vector<std::string>(tokens.begin() + 1, tokens.end())
+                                       : std::vector<std::string>(subscribed.begin(), subscribed.end());
+        const std::string kind = patterns ? "punsubscribe" : "unsubscribe";
+        for (const auto& name : names) {
+            if (subscribed.erase(name)) {
+                if (patterns) {
+                    pubsub_unsubscribe_pattern(client_fd, name);
+                } else {
+                    pubsub_unsubscribe_channel(client_fd, name);
+                }
+            }
+            append(kind, name);
+        }
+        if (names.empty()) append(kind, "(nil)");
+    }
+    return result;
+}
+
+size_t RedisServer::publish(const std::string& channel, const std::string& message) {
+    size_t receivers = 0;
+    if (const auto it = pubsub_channels.find(channel); it != pubsub_channels.end()) {
+        // built once, every subscriber queues the same buffer
+        const auto reply = std::make_shared<const std::string>(
+            "1) message\n2) " + channel + "\n3) " + message + "\n");
+        for (const int fd : it->second) {
+            add_reply(fd, reply);
+            ++receivers;
+        }
+    }
+    if (!pattern_trie.empty()) {
+        for (const auto* pattern : pattern_trie.match(channel)) {
+            const auto reply = std::make_shared<const std::string>(
+                "1) pmessage\n2) " + *pattern + "\n3) " + channel + "\n4) " + message + "\n");
+            for (const int fd : pubsub_patterns[*pattern]) {
+                add_reply(fd, reply);
+                ++receivers;
+            }
+        }
+    }
+    return receivers;
+}
+
+void RedisServer::pubsub_unsubscribe_channel(const int client_fd, const std::string& channel) {
+    if (const auto it = pubsub_channels.find(channel); it != pubsub_channels.end()) {
+        it->second.erase(client_fd);
+        if (it->second.empty()) pubsub_channels.erase(it);
+    }
+}
+
+void RedisServer::pubsub_unsubscribe_pattern(const int client_fd, const std::string& pattern) {
+    if (const auto it = pubsub_patterns.find(pattern); it != pubsub_patterns.end()) {
+        it->second.erase(client_fd);
+        if (it->second.empty()) {
+            pubsub_patterns.erase(it);
+            pattern_trie.erase(pattern);
+        }
+    }
+}
+
+void RedisServer::pubsub_unsubscribe_all(const int client_fd) {
+    auto& client = clients[client_fd];
+    for (const auto& channel : client.channels) {
+        pubsub_unsubscribe_channel(client_fd, channel);
+    }
+    for (const auto& pattern : client.patterns) {
+        pubsub_unsubscribe_pattern(client_fd, pattern);
+    }
+    client.channels.clear();
+    client.patterns.clear();
+}
+
+std::string RedisServer::config_command(const std::vector<std::string>& tokens) {
+    std::string sub = tokens.size() > 1 ? tokens[1] : "";
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub == "GET" && tokens.size() == 3) {
+        // CONFIG GET name|*, replies with name/value pairs
+        const auto names = tokens[2] == "*" ? config.names() : std::vector<std::string>{tokens[2]};
+        std::string result;
+        int count = 0;
+        for (const auto& name : names) {
+            std::string value;
+            if (!config.get(name, value)) continue;
+            if (count > 0) result += "\n";
+            result += std::to_string(count + 1) + ") " + name + "\n" + std::to_string(count + 2) + ") " + value;
+            count += 2;
+        }
+        return count == 0 ? "(empty array)" : result;
+    }
+    if (sub == "SET" && tokens.size() == 4) {
+        const auto err = config.set(tokens[2], tokens[3]);
+        return err.empty() ? "OK" : command_error(err);
+    }
+    if (sub == "RESETSTAT" && tokens.size() == 2) {
+        reset_stats();
+        return "OK";
+    }
+    return command_error("Unknown CONFIG subcommand or incorrect argument number");
+}
+
+std::string RedisServer::execute_command(const int client_fd, std::vector<std::string>& tokens) {
+    const std::string& command_type = tokens[0];
+    if (command_type == "EVAL" || command_type == "EVALSHA" || command_type == "SCRIPT") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        return script_command(client_fd, tokens);
+    }
+    if (command_type == "PSYNC") {
+        return psync_command(client_fd, tokens);
+    }
+    if (command_type == "REPLICAOF") {
+        return replicaof_command(tokens);
+    }
+    if (command_type == "ROLE") {
+        return role_command();
+    }
+    if (command_type == "CONFIG") {
+        return config_command(tokens);
+    }
+    if (command_type == "CLUSTER") {
+        return cluster_command(tokens);
+    }
+    if (command_type == "INFO") {
+        return info_command(tokens);
+    }
+    if (command_type == "LATENCY") {
+        return latency_command(tokens);
+    }
+    if (command_type == "SLOWLOG") {
+        return slowlog_command(tokens);
+    }
+    if (command_type == "HOTKEYS") {
+        return hotkeys_command(tokens);
+    }
+    if (command_type == "ASKING") {
+        if (!config.cluster_enabled) return command_error("This instance has cluster support disabled");
+        clients[client_fd].asking = true;
+        return "OK";
+    }
+    if (command_type == "RESTORE" || command_type == "RESTORE-ASKING") {
+        return restore_command(tokens);
+    }
+    if (command_type == "CLIENT") {
+        std::string sub = tokens.size() > 1 ? tokens[1] : "";
+        for (char& c : sub) c = static_cast<char>(toupper(c));
+        if (sub == "TRACKING" && tokens.size() >= 3) return tracking_command(client_fd, tokens);
+        return client_command(client_fd, tokens);
+    }
+    if (command_type == "PUBLISH" || command_type == "SUBSCRIBE" || command_type == "UNSUBSCRIBE" ||
+        command_type == "PSUBSCRIBE" || command_type == "PUNSUBSCRIBE") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        return pubsub_command(client_fd, tokens);
+    }
+    if (command_type == "BLPOP" || command_type == "BRPOP" || command_type == "BLMOVE") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        return blocking_command(client_fd, tokens);
+    }
+    if (command_type == "SETBIT" || command_type == "GETBIT" || command_type == "BITCOUNT" ||
+        command_type == "BITPOS" || command_type == "BITOP" || command_type == "BITFIELD") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        return bitmap_command(tokens);
+    }
+    if (command_type == "GEOADD" || command_type == "GEOPOS" || command_type == "GEODIST" ||
+        command_type == "GEOSEARCH") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        return geo_command(tokens);
+    }
+    if (command_type == "KEYS" || command_type == "SCAN" || command_type == "DELPREFIX" || command_type == "MEMORY" ||
+        command_type == "TYPE" || command_type == "OBJECT") {
+        if (const auto* spec = lookup_command(command_type); !spec->arity_ok(tokens.size())) {
+            return command_error("Incorrect argument number");
+        }
+        if (command_type == "KEYS") return keys_command(tokens);
+        if (command_type == "SCAN") return scan_command(tokens);
+        if (command_type == "DELPREFIX") return del_prefix_command(tokens);
+        if (command_type == "TYPE") return type_command(tokens);
+        if (command_type == "OBJECT") return object_command(tokens);
+        return memory_command(tokens);
+    }
+    // large set operations go to the worker pool, the client gets the reply when the job completes
+    if (workers && tokens.size() == 3 &&
+        (command_type == "SINTER" || command_type == "SUNION" || command_type == "SDIFF" ||
+         command_type == "ZINTER" || command_type == "ZUNION") && start_job(client_fd, tokens)) {
+        return "";
     }
-    const std::string command_type = tokens[0];
     if (command_type.length() < 2) {
-        send_response(client_fd, "Unknown command " + command_type);
+        return command_error("Unknown command " + command_type);
     }
     if (command_type[0] == 'L') {
         // List
@@ -96,24 +2254,27 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     auto ro = RedisObject(RedisObject::Type::LIST);
                     auto res = ro.l_push(tokens[2]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    signal_key_as_ready(tokens[1]);
+                    return res;
                 } else {
                     auto res = it->second.l_push(tokens[2]);
-                    send_response(client_fd, res);
+                    signal_key_as_ready(tokens[1]);
+                    return res;
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "LPOP") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
                     auto res = it->second.l_pop();
-                    send_response(client_fd, res);
+                    if (it->second.type() == RedisObject::Type::LIST && it->second.l_len() == "0") kv_store.erase(it);
+                    return res;
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "LRANGE") {
             if (tokens.size() == 4) {
@@ -122,31 +2283,31 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                         int idx1 = std::stoi(tokens[2]);
                         int idx2 = std::stoi(tokens[3]);
                         auto res = it->second.l_range(idx1, idx2);
-                        send_response(client_fd, res);
+                        return res;
                     } catch (const std::invalid_argument &e) {
-                        send_response(client_fd, "Index should be an integer");
+                        return command_error("Index should be an integer");
                     } catch (const std::out_of_range &e) {
-                        send_response(client_fd, "Index should be an integer");
+                        return command_error("Index should be an integer");
                     }
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "LLEN") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
                     auto res = it->second.l_len();
-                    send_response(client_fd, res);
+                    return res;
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else {
-            send_response(client_fd, "Unknown command " + command_type);
+            return command_error("Unknown command " + command_type);
         }
     } else if (command_type[0] == 'R') {
         // List
@@ -156,121 +2317,120 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     auto ro = RedisObject(RedisObject::Type::LIST);
                     auto res = ro.r_push(tokens[2]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    signal_key_as_ready(tokens[1]);
+                    return res;
                 } else {
                     auto res = it->second.r_push(tokens[2]);
-                    send_response(client_fd, res);
+                    signal_key_as_ready(tokens[1]);
+                    return res;
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "RPOP") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
                     auto res = it->second.r_pop();
-                    send_response(client_fd, res);
+                    if (it->second.type() == RedisObject::Type::LIST && it->second.l_len() == "0") kv_store.erase(it);
+                    return res;
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else {
-            send_response(client_fd, "Unknown command " + command_type);
+            return command_error("Unknown command " + command_type);
         }
     } else if (command_type[0] == 'H') {
         // Hash
         auto command_type_len = command_type + std::to_string(tokens.size());
         std::unordered_set<std::string> commands({"HSET4", "HGET3", "HGETALL2", "HKEYS2",
-            "HVALS2", "HSETNX4", "HINCRBY4", "HINCRBYFLOAT4"});
+            "HVALS2", "HLEN2", "HSETNX4", "HINCRBY4", "HINCRBYFLOAT4"});
         if (const auto it = commands.find(command_type_len); it == commands.end()) {
-            send_response(client_fd, "Unknown command or incorrect argument number");
-            return;
+            return command_error("Unknown command or incorrect argument number");
         }
         const auto it = kv_store.find(tokens[1]);
         if (it == kv_store.end() && !(command_type == "HSET" || command_type == "HSETNX")) {
-            send_response(client_fd, "(nil)");
-            return;
+            return "(nil)";
         }
         if (tokens.size() == 2) {
             if (command_type == "HGETALL") {
                 auto res = it->second.h_get_all();
-                send_response(client_fd, res);
+                return res;
+            } else if (command_type == "HLEN") {
+                return it->second.h_len();
             } else if (command_type == "HKEYS") {
                 auto res = it->second.h_keys();
-                send_response(client_fd, res);
+                return res;
             } else {
                 auto res = it->second.h_vals();
-                send_response(client_fd, res);
+                return res;
             }
         } else if (tokens.size() == 3) {
             auto res = it->second.h_get(tokens[2]);
-            send_response(client_fd, res);
+            return res;
         } else {
             if (command_type == "HSET") {
                 if (it == kv_store.end()) {
                     auto ro = RedisObject(RedisObject::Type::HASH);
                     auto res = ro.h_set_n_x(tokens[2], tokens[3]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    return res;
                 } else {
                     auto res = it->second.h_set_n_x(tokens[2], tokens[3]);
-                    send_response(client_fd, res);
+                    return res;
                 }
             } else if (command_type == "HSETNX") {
                 if (it == kv_store.end()) {
                     auto ro = RedisObject(RedisObject::Type::HASH);
                     auto res = ro.h_set_n_x(tokens[2], tokens[3]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    return res;
                 } else {
                     auto res = it->second.h_set_n_x(tokens[2], tokens[3]);
-                    send_response(client_fd, res);
+                    return res;
                 }
             } else if (command_type == "HINCRBY") {
                 int increment;
                 try {
                     increment = std::stoi(tokens[3]);
                 } catch (...) {
-                    send_response(client_fd, "Increment should be an integer");
-                    return;
+                    return command_error("Increment should be an integer");
                 }
                 auto res = it->second.h_incr_by(tokens[2], increment);
-                send_response(client_fd, res);
+                return res;
             } else {
                 double increment;
                 try {
                     increment = std::stod(tokens[3]);
                 } catch (...) {
-                    send_response(client_fd, "Increment should be a float number");
-                    return;
+                    return command_error("Increment should be a float number");
                 }
                 auto res = it->second.h_incr_by_float(tokens[2], increment);
-                send_response(client_fd, res);
+                return res;
             }
         }
-    } else if (command_type[0] == 'S' && command_type[1] != 'E') {
+    } else if (command_type[0] == 'S' && command_type[1] != 'E' && command_type != "STRLEN") {
         // Set
         auto command_type_len = command_type + std::to_string(tokens.size());
         std::unordered_set<std::string> commands({"SADD3", "SREM3", "SCARD2", "SISMEMBER3",
             "SMEMBERS2", "SINTER3", "SUNION3", "SDIFF3"});
         if (const auto it = commands.find(command_type_len); it == commands.end()) {
-            send_response(client_fd, "Unknown command or incorrect argument number");
-            return;
+            return command_error("Unknown command or incorrect argument number");
         }
         const auto it = kv_store.find(tokens[1]);
         if (it == kv_store.end() && (command_type == "SREM" || command_type == "SCARD" ||
             command_type == "SISMEMBER" || command_type == "SMEMBERS")) {
-            send_response(client_fd, "(nil)");
-            return;
+            return "(nil)";
         }
         if (tokens.size() == 2) {
             if (command_type == "SCARD") {
                 auto res = it->second.s_card();
-                send_response(client_fd, res);
+                return res;
             } else {
                 auto res = it->second.s_members();
-                send_response(client_fd, res);
+                return res;
             }
         } else {
             if (command_type == "SADD") {
@@ -278,17 +2438,18 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     auto ro = RedisObject(RedisObject::Type::SET);
                     auto res = ro.s_add(tokens[2]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    return res;
                 } else {
                     auto res = it->second.s_add(tokens[2]);
-                    send_response(client_fd, res);
+                    return res;
                 }
             } else if (command_type == "SREM") {
                 auto res = it->second.s_rem(tokens[2]);
-                send_response(client_fd, res);
+                if (it->second.type() == RedisObject::Type::SET && it->second.s_card() == "0") kv_store.erase(it);
+                return res;
             } else if (command_type == "SISMEMBER") {
                 auto res = it->second.s_is_member(tokens[2]);
-                send_response(client_fd, res);
+                return res;
             } else if (command_type == "SINTER") {
                 std::string res;
                 if (it == kv_store.end()) {
@@ -310,7 +2471,7 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                         res = it->second.s_inter(it2->second);
                     }
                 }
-                send_response(client_fd, res);
+                return res;
             } else if (command_type == "SUNION") {
                 std::string res;
                 if (it == kv_store.end()) {
@@ -329,7 +2490,7 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                         res = it->second.s_union(it2->second);
                     }
                 }
-                send_response(client_fd, res);
+                return res;
             } else {
                 std::string res;
                 if (it == kv_store.end()) {
@@ -348,21 +2509,222 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                         res = it->second.s_diff(it2->second);
                     }
                 }
-                send_response(client_fd, res);
+                return res;
+            }
+        }
+    } else if (command_type[0] == 'P' && command_type[1] == 'F') {
+        // HyperLogLog
+        if (const auto* spec = lookup_command(command_type); !spec || !spec->arity_ok(tokens.size())) {
+            return command_error("Unknown command or incorrect argument number");
+        }
+        const auto it = kv_store.find(tokens[1]);
+        if (command_type == "PFADD") {
+            const std::vector<std::string> elements(tokens.begin() + 2, tokens.end());
+            if (it == kv_store.end()) {
+                auto ro = RedisObject(RedisObject::Type::HYPERLOGLOG);
+                ro.pf_add(elements);
+                kv_store.emplace(tokens[1], std::move(ro));
+                return "1";
+            }
+            return it->second.pf_add(elements);
+        }
+        if (command_type == "PFCOUNT" && tokens.size() == 2) {
+            return it == kv_store.end() ? "0" : it->second.pf_count();
+        }
+        // PFCOUNT of several keys, PFMERGE: the union of the registers, a missing key is an empty counter
+        HyperLogLog::Registers registers(HyperLogLog::REGISTERS, 0);
+        for (size_t i = 1; i < tokens.size(); ++i) {
+            const auto it2 = kv_store.find(tokens[i]);
+            if (it2 == kv_store.end()) continue;
+            const HyperLogLog* hll = it2->second.hyperloglog();
+            if (!hll) return command_error("Redis object type error");
+            hll->merge_into(registers);
+        }
+        if (command_type == "PFCOUNT") {
+            return std::to_string(HyperLogLog::estimate(registers));
+        }
+        if (command_type == "PFMERGE") {
+            if (it == kv_store.end()) {
+                auto ro = RedisObject(RedisObject::Type::HYPERLOGLOG);
+                ro.pf_assign(registers);
+                kv_store.emplace(tokens[1], std::move(ro));
+            } else {
+                it->second.pf_assign(registers);
             }
+            return "OK";
+        }
+        return command_error("Unknown command " + command_type);
+    } else if (command_type[0] == 'X') {
+        // Stream
+        if (const auto* spec = lookup_command(command_type); !spec || !spec->arity_ok(tokens.size())) {
+            return command_error("Unknown command or incorrect argument number");
         }
+        return stream_command(tokens);
     } else if (command_type[0] == 'Z') {
         // ZSet
+        if (command_type == "ZUNIONSTORE" || command_type == "ZINTERSTORE" || command_type == "ZDIFFSTORE") {
+            if (!lookup_command(command_type)->arity_ok(tokens.size())) {
+                return command_error("Incorrect argument number");
+            }
+            return zset_store_command(tokens);
+        }
+        auto command_type_len = command_type + std::to_string(tokens.size());
+        std::unordered_set<std::string> commands({"ZADD4", "ZREM3", "ZSCORE3", "ZRANK3", "ZCARD2",
+            "ZCOUNT4", "ZINCRBY4", "ZRANGE4", "ZRANGE5", "ZRANGEBYSCORE4", "ZRANGEBYSCORE5", "ZINTER3", "ZUNION3",
+            "ZRANGEBYLEX4", "ZRANGEBYLEX7", "ZREVRANGEBYLEX4", "ZREVRANGEBYLEX7", "ZLEXCOUNT4", "ZREMRANGEBYLEX4"});
+        if (const auto it = commands.find(command_type_len); it == commands.end()) {
+            return command_error("Unknown command or incorrect argument number");
+        }
+        // score bounds: a number, -inf/+inf, prefixed with ( when exclusive
+        const auto parse_bound = [](std::string s, double& value, bool& exclusive) {
+            exclusive = !s.empty() && s[0] == '(';
+            if (exclusive) s.erase(0, 1);
+            try {
+                size_t pos;
+                value = std::stod(s, &pos);
+                return pos == s.size();
+            } catch (...) {
+                return false;
+            }
+        };
+        // lex bounds: - or +, or a member prefixed with [ when inclusive and ( when exclusive
+        const auto parse_lex_bound = [](const std::string& s, LexBound& bound) {
+            if (s == "-" || s == "+") {
+                bound.kind = s == "-" ? LexBound::MIN : LexBound::MAX;
+                return true;
+            }
+            if (s.empty() || (s[0] != '[' && s[0] != '(')) return false;
+            bound.exclusive = s[0] == '(';
+            bound.member = s.substr(1);
+            return true;
+        };
+        bool with_scores = false;
+        if (tokens.size() == 5) {
+            std::string option = tokens[4];
+            for (char& c : option) c = static_cast<char>(toupper(c));
+            if (option != "WITHSCORES") return command_error("Unknown option " + tokens[4]);
+            with_scores = true;
+        }
+        const auto it = kv_store.find(tokens[1]);
+        if (it == kv_store.end() && command_type != "ZADD" && command_type != "ZINTER" && command_type != "ZUNION") {
+            if (command_type == "ZLEXCOUNT" || command_type == "ZREMRANGEBYLEX") return "0";
+            return command_type == "ZRANGE" || command_type == "ZRANGEBYSCORE" || command_type == "ZRANGEBYLEX" ||
+                   command_type == "ZREVRANGEBYLEX" ? "(empty array)" : "(nil)";
+        }
+        if (command_type == "ZADD") {
+            double score;
+            try {
+                score = std::stod(tokens[2]);
+            } catch (...) {
+                return command_error("Score should be a float number");
+            }
+            if (it == kv_store.end()) {
+                auto ro = RedisObject(RedisObject::Type::ZSET);
+                auto res = ro.z_add(score, tokens[3]);
+                kv_store.emplace(tokens[1], std::move(ro));
+                return res;
+            }
+            return it->second.z_add(score, tokens[3]);
+        } else if (command_type == "ZREM") {
+            auto res = it->second.z_rem(tokens[2]);
+            if (it->second.type() == RedisObject::Type::ZSET && it->second.z_card() == "0") kv_store.erase(it);
+            return res;
+        } else if (command_type == "ZSCORE") {
+            return it->second.z_score(tokens[2]);
+        } else if (command_type == "ZRANK") {
+            return it->second.z_rank(tokens[2], false);
+        } else if (command_type == "ZCARD") {
+            return it->second.z_card();
+        } else if (command_type == "ZCOUNT") {
+            double min, max;
+            bool min_exclusive, max_exclusive;
+            if (!parse_bound(tokens[2], min, min_exclusive) || !parse_bound(tokens[3], max, max_exclusive)) {
+                return command_error("Min and max should be float numbers");
+            }
+            return it->second.z_count(min, min_exclusive, max, max_exclusive);
+        } else if (command_type == "ZINCRBY") {
+            double increment;
+            try {
+                increment = std::stod(tokens[2]);
+            } catch (...) {
+                return command_error("Increment should be a float number");
+            }
+            return it->second.z_incr_by(increment, tokens[3]);
+        } else if (command_type == "ZRANGE") {
+            int start, stop;
+            try {
+                start = std::stoi(tokens[2]);
+                stop = std::stoi(tokens[3]);
+            } catch (...) {
+                return command_error("Index should be an integer");
+            }
+            if (it->second.type() != RedisObject::Type::ZSET) return command_error("Redis object type error");
+            // negative indexes count from the end
+            const int size = std::stoi(it->second.z_card());
+            if (start < 0) start = std::max(0, start + size);
+            if (stop < 0) stop += size;
+            return it->second.z_range(start, stop, with_scores);
+        } else if (command_type == "ZRANGEBYSCORE") {
+            double min, max;
+            bool min_exclusive, max_exclusive;
+            if (!parse_bound(tokens[2], min, min_exclusive) || !parse_bound(tokens[3], max, max_exclusive)) {
+                return command_error("Min and max should be float numbers");
+            }
+            return it->second.z_range_by_score(min, min_exclusive, max, max_exclusive, with_scores);
+        } else if (command_type == "ZRANGEBYLEX" || command_type == "ZREVRANGEBYLEX" ||
+                   command_type == "ZLEXCOUNT" || command_type == "ZREMRANGEBYLEX") {
+            // ZREVRANGEBYLEX takes max before min
+            const bool reverse = command_type == "ZREVRANGEBYLEX";
+            LexBound min, max;
+            if (!parse_lex_bound(tokens[reverse ? 3 : 2], min) || !parse_lex_bound(tokens[reverse ? 2 : 3], max)) {
+                return command_error("Min and max should be - or + or start with [ or (");
+            }
+            if (command_type == "ZLEXCOUNT") return it->second.z_lex_count(min, max);
+            if (command_type == "ZREMRANGEBYLEX") {
+                auto res = it->second.z_rem_range_by_lex(min, max);
+                if (it->second.type() == RedisObject::Type::ZSET && it->second.z_card() == "0") kv_store.erase(it);
+                return res;
+            }
+            int offset = 0, count = -1;
+            if (tokens.size() == 7) {
+                std::string option = tokens[4];
+                for (char& c : option) c = static_cast<char>(toupper(c));
+                if (option != "LIMIT") return command_error("Unknown option " + tokens[4]);
+                try {
+                    offset = std::stoi(tokens[5]);
+                    count = std::stoi(tokens[6]);
+                } catch (...) {
+                    return command_error("Offset and count should be integers");
+                }
+            }
+            return it->second.z_range_by_lex(min, max, offset, count, reverse);
+        } else {
+            // ZINTER / ZUNION, a missing key is an empty sorted set
+            const auto empty = RedisObject(RedisObject::Type::ZSET);
+            const auto it2 = kv_store.find(tokens[2]);
+            const RedisObject& ro1 = it == kv_store.end() ? empty : it->second;
+            const RedisObject& ro2 = it2 == kv_store.end() ? empty : it2->second;
+            return command_type == "ZINTER" ? ro1.z_inter(ro2) : ro1.z_union(ro2);
+        }
     } else {
         // String
         if (command_type == "GET") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end())
-                    send_response(client_fd, it->second.get());
+                    return it->second.get();
+                else
+                    return "(nil)";
+            } else {
+                return command_error("Incorrect argument number");
+            }
+        } else if (command_type == "STRLEN") {
+            if (tokens.size() == 2) {
+                if (const auto it = kv_store.find(tokens[1]); it != kv_store.end())
+                    return it->second.str_len();
                 else
-                    send_response(client_fd, "(nil)");
+                    return "0";
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "SET") {
             if (tokens.size() == 3) {
@@ -370,13 +2732,13 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     auto ro = RedisObject(RedisObject::Type::STRING);
                     auto res = ro.set(tokens[2]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    return res;
                 } else {
                     auto res = it->second.set(tokens[2]);
-                    send_response(client_fd, res);
+                    return res;
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "SETNX") {
             if (tokens.size() == 3) {
@@ -384,23 +2746,23 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     auto ro = RedisObject(RedisObject::Type::STRING);
                     auto res = ro.set(tokens[2]);
                     kv_store.emplace(tokens[1], std::move(ro));
-                    send_response(client_fd, res);
+                    return res;
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "INCR") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
                     auto res = it->second.incr();
-                    send_response(client_fd, res);
+                    return res;
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "INCRBY") {
             if (tokens.size() == 3) {
@@ -408,15 +2770,15 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     try {
                         int increment = std::stoi(tokens[2]);
                         auto res = it->second.incr_by(increment);
-                        send_response(client_fd, res);
+                        return res;
                     } catch (...) {
-                        send_response(client_fd, "Increment should be an integer");
+                        return command_error("Increment should be an integer");
                     }
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "INCRBYFLOAT") {
             if (tokens.size() == 3) {
@@ -424,39 +2786,40 @@ void RedisServer::parse_and_execute(const int client_fd, const std::string& comm
                     try {
                         double increment = std::stod(tokens[2]);
                         auto res = it->second.incr_by_float(increment);
-                        send_response(client_fd, res);
+                        return res;
                     } catch (...) {
-                        send_response(client_fd, "Increment should be a float number");
+                        return command_error("Increment should be a float number");
                     }
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "EXISTS") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
-                    send_response(client_fd, "true");
+                    return "true";
                 } else {
-                    send_response(client_fd, "false");
+                    return "false";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else if (command_type == "DEL") {
             if (tokens.size() == 2) {
                 if (const auto it = kv_store.find(tokens[1]); it != kv_store.end()) {
                     kv_store.erase(tokens[1]);
-                    send_response(client_fd, "OK");
+                    notify_keyspace_event(NOTIFY_GENERIC, "del", tokens[1]);
+                    return "OK";
                 } else {
-                    send_response(client_fd, "(nil)");
+                    return "(nil)";
                 }
             } else {
-                send_response(client_fd, "Incorrect argument number");
+                return command_error("Incorrect argument number");
             }
         } else {
-            send_response(client_fd, "Unknown command " + command_type);
+            return command_error("Unknown command " + command_type);
         }
     }
 }
@@ -0,0 +1,51 @@
+#include "snapshot.h"
+
+#include <cstdint>
+
+namespace {
+
+constexpr char MAGIC[] = "SRDB";
+constexpr char VERSION = 2;
+constexpr unsigned char ENTRY = 0x00;
+constexpr unsigned char END = 0xFF;
+
+} // namespace
+
+std::string dump_snapshot(const std::unordered_map<std::string, RedisObject>& kv_store) {
+    std::string out = MAGIC;
+    out += VERSION;
+    for (const auto& [key, ro] : kv_store) {
+        out += static_cast<char>(ENTRY);
+        const auto len = static_cast<uint32_t>(key.size());
+        for (int i = 0; i < 4; ++i) out += static_cast<char>((len >> (i * 8)) & 0xFF);
+        out += key;
+        ro.serialize(out);
+    }
+    out += static_cast<char>(END);
+    return out;
+}
+
+bool load_snapshot(const std::string& data, std::unordered_map<std::string, RedisObject>& kv_store) {
+    kv_store.clear();
+    if (data.size() < 6 || data.compare(0, 4, MAGIC) != 0 || data[4] != VERSION) return false;
+    size_t pos = 5;
+    bool truncated = false;
+    while (pos < data.size() && static_cast<unsigned char>(data[pos]) == ENTRY) {
+        ++pos;
+        uint32_t len = 0;
+        truncated = true;
+        if (pos + 4 > data.size()) break;
+        for (int i = 0; i < 4; ++i) len |= static_cast<uint32_t>(static_cast<unsigned char>(data[pos + i])) << (i * 8);
+        pos += 4;
+        if (pos + len > data.size()) break;
+        std::string key = data.substr(pos, len);
+        pos += len;
+        auto ro = RedisObject::deserialize(data, pos);
+        if (!ro) break;
+        kv_store.emplace(std::move(key), std::move(*ro));
+        truncated = false;
+    }
+    if (!truncated && pos + 1 == data.size() && static_cast<unsigned char>(data[pos]) == END) return true;
+    kv_store.clear();
+    return false;
+}
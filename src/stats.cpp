@@ -0,0 +1,416 @@
+#include "stats.h"
+#include "server.h"
+#include "cycle_clock.h"
+
+#include <cstdio>
+#include <ctime>
+#include <malloc.h>
+#include <unistd.h>
+
+// INFO, LATENCY and SLOWLOG. Every command is timed with CycleClock around its execution in
+// call(), the ticks are summed for INFO commandstats and the nanoseconds go into a small
+// log-linear histogram per command, so the measurement costs two rdtsc and a few increments.
+//
+// Top level commands slower than slowlog-log-slower-than go to the slow log. The latency
+// monitor keeps, per named event, the samples over latency-monitor-threshold:
+//   command       a command, including the scripts and transactions it runs
+//   event-loop    one iteration of the event loop, without the wait for events
+//   expire-cycle  expiring the timeouts of blocked clients
+//   snapshot      serialising the dataset for a full resync
+//
+// HOTKEYS and INFO hotkeys rank the keys by the reads and writes received for them, see hotkeys.h.
+
+namespace {
+
+constexpr size_t INFO_HOTKEYS = 5; // hottest keys listed by INFO
+
+std::string lower(std::string s) {
+    for (char& c : s) c = static_cast<char>(tolower(c));
+    return s;
+}
+
+std::string format_double(const double d) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.3f", d);
+    return buf;
+}
+
+uint64_t used_memory() {
+    const struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+uint64_t rss_memory() {
+    FILE* f = std::fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long long size = 0, resident = 0;
+    const int n = std::fscanf(f, "%llu %llu", &size, &resident);
+    std::fclose(f);
+    return n == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+}
+
+} // namespace
+
+void LatencyEvent::add(const uint64_t time, const uint64_t ms) {
+    max_ms = std::max(max_ms, ms);
+    if (!history.empty() && latest().time == time) {
+        // one sample per second, the worst one
+        auto& sample = history[(next + history.size() - 1) % history.size()];
+        sample.ms = std::max(sample.ms, ms);
+        return;
+    }
+    if (history.size() < HISTORY) {
+        history.push_back({time, ms});
+        next = history.size() % HISTORY;
+    } else {
+        history[next] = {time, ms};
+        next = (next + 1) % HISTORY;
+    }
+}
+
+const LatencyEvent::Sample& LatencyEvent::latest() const {
+    return history[(next + history.size() - 1) % history.size()];
+}
+
+std::vector<LatencyEvent::Sample> LatencyEvent::samples() const {
+    std::vector<Sample> result;
+    for (size_t i = 0; i < history.size(); ++i) {
+        result.push_back(history[(next + i) % history.size()]);
+    }
+    return result;
+}
+
+void RedisServer::record_command(const int client_fd, const CommandSpec& spec, const std::vector<std::string>& tokens,
+                                 const uint64_t ticks, const bool failed) {
+    auto& cs = command_stats[&spec];
+    ++cs.calls;
+    cs.ticks += ticks;
+    cs.latency.record(CycleClock::to_ns(ticks));
+    if (failed) {
+        ++cs.failed_calls;
+        ++stats.error_replies;
+    }
+    ++stats.commands_processed;
+    if (call_depth == 0 && !exec_running) {
+        // commands run by scripts and transactions are accounted to them
+        const uint64_t usec = CycleClock::to_ns(ticks) / 1000;
+        slowlog_push(client_fd, tokens, usec);
+        latency_add_sample("command", usec / 1000);
+    }
+}
+
+// spec is null for unknown commands
+void RedisServer::reject_command(const CommandSpec* spec) {
+    if (spec) ++command_stats[spec].rejected_calls;
+    ++stats.rejected_calls;
+    ++stats.error_replies;
+}
+
+void RedisServer::slowlog_push(const int client_fd, const std::vector<std::string>& tokens, const uint64_t usec) {
+    if (config.slowlog_log_slower_than < 0 || usec < static_cast<uint64_t>(config.slowlog_log_slower_than)) return;
+    SlowlogEntry entry {slowlog_next_id++, static_cast<uint64_t>(std::time(nullptr)), usec, {}, clients[client_fd].addr};
+    // a huge MSET or a long value must not turn the slow log into a copy of the dataset
+    for (size_t i = 0; i < tokens.size() && i < SLOWLOG_MAX_ARGS; ++i) {
+        if (i == SLOWLOG_MAX_ARGS - 1 && tokens.size() > SLOWLOG_MAX_ARGS) {
+            entry.args.push_back("... (" + std::to_string(tokens.size() - i) + " more arguments)");
+        } else if (tokens[i].size() > SLOWLOG_MAX_ARG_LEN) {
+            entry.args.push_back(tokens[i].substr(0, SLOWLOG_MAX_ARG_LEN) + "... (" +
+                                 std::to_string(tokens[i].size() - SLOWLOG_MAX_ARG_LEN) + " more bytes)");
+        } else {
+            entry.args.push_back(tokens[i]);
+        }
+    }
+    slowlog.push_front(std::move(entry));
+    while (slowlog.size() > config.slowlog_max_len) slowlog.pop_back();
+}
+
+std::string RedisServer::slowlog_command(const std::vector<std::string>& tokens) {
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub == "LEN" && tokens.size() == 2) return std::to_string(slowlog.size());
+    if (sub == "RESET" && tokens.size() == 2) {
+        slowlog.clear();
+        return "OK";
+    }
+    if (sub == "GET" && tokens.size() <= 3) {
+        // SLOWLOG GET [count], newest first, -1 for all
+        long long count = 10;
+        if (tokens.size() == 3) {
+            try {
+                count = std::stoll(tokens[2]);
+            } catch (...) {
+                return command_error("Count should be an integer");
+            }
+        }
+        std::string result;
+        int n = 0;
+        for (const auto& entry : slowlog) {
+            if (count >= 0 && n == count) break;
+            std::string command;
+            for (size_t i = 0; i < entry.args.size(); ++i) {
+                command += i == 0 ? entry.args[i] : " " + quote_token(entry.args[i]);
+            }
+            if (n > 0) result += "\n";
+            result += std::to_string(++n) + ") id=" + std::to_string(entry.id) + " time=" + std::to_string(entry.time) +
+                      " usec=" + std::to_string(entry.usec) + " client=" + entry.client_addr + " command=" + command;
+        }
+        return n == 0 ? "(empty array)" : result;
+    }
+    return command_error("Unknown SLOWLOG subcommand or incorrect argument number");
+}
+
+void RedisServer::latency_add_sample(const std::string& event, const uint64_t ms) {
+    if (config.latency_monitor_threshold == 0 || ms < config.latency_monitor_threshold) return;
+    latency_events[event].add(static_cast<uint64_t>(std::time(nullptr)), ms);
+}
+
+void RedisServer::stats_cron() {
+    stats.peak_memory = std::max(stats.peak_memory, used_memory());
+    const uint64_t now = now_ms();
+    if (stats.last_ops_sample_ms != 0 && now > stats.last_ops_sample_ms) {
+        stats.ops_samples[stats.ops_sample_idx] =
+            (stats.commands_processed - stats.last_ops_commands) * 1000 / (now - stats.last_ops_sample_ms);
+        stats.ops_sample_idx = (stats.ops_sample_idx + 1) % ServerStats::OPS_SAMPLES;
+    }
+    stats.last_ops_sample_ms = now;
+    stats.last_ops_commands = stats.commands_processed;
+    if (config.hotkeys_decay_time > 0 && now - stats.last_hotkeys_decay_ms >= config.hotkeys_decay_time * 1000) {
+        if (stats.last_hotkeys_decay_ms != 0) hot_keys.decay();
+        stats.last_hotkeys_decay_ms = now;
+    }
+}
+
+uint64_t RedisServer::instantaneous_ops_per_sec() const {
+    uint64_t sum = 0;
+    for (const uint64_t ops : stats.ops_samples) {
+        sum += ops;
+    }
+    return sum / ServerStats::OPS_SAMPLES;
+}
+
+std::string RedisServer::info_command(const std::vector<std::string>& tokens) {
+    // no argument or "default": everything but the per command sections
+    std::vector<std::string> sections;
+    for (size_t i = 1; i < tokens.size(); ++i) {
+        sections.push_back(lower(tokens[i]));
+    }
+    const auto wanted = [&](const std::string& name, const bool by_default) {
+        if (sections.empty()) return by_default;
+        for (const auto& s : sections) {
+            if (s == name || s == "all" || s == "everything" || (s == "default" && by_default)) return true;
+        }
+        return false;
+    };
+
+    std::string result;
+    const auto section = [&](const std::string& title) {
+        if (!result.empty()) result += "\n\n";
+        result += "# " + title;
+    };
+    const auto field = [&](const std::string& name, const std::string& value) {
+        result += "\n" + name + ":" + value;
+    };
+
+    if (wanted("server", true)) {
+        section("Server");
+        field("process_id", std::to_string(getpid()));
+        field("tcp_port", std::to_string(port));
+        field("uptime_in_seconds", std::to_string((now_ms() - stats.start_ms) / 1000));
+        field("cluster_enabled", config.cluster_enabled ? "1" : "0");
+    }
+    if (wanted("clients", true)) {
+        size_t connected = 0, blocked = 0, pubsub = 0, tracking = 0;
+        for (const auto& [fd, client] : clients) {
+            if (client.is_master || client.http || fd == migration.fd) continue;
+            ++connected;
+            if (client.blocked) ++blocked;
+            if (!client.channels.empty() || !client.patterns.empty()) ++pubsub;
+            if (client.tracking) ++tracking;
+        }
+        section("Clients");
+        field("connected_clients", std::to_string(connected));
+        field("blocked_clients", std::to_string(blocked));
+        field("pubsub_clients", std::to_string(pubsub));
+        field("tracking_clients", std::to_string(tracking));
+        field("maxclients", std::to_string(config.maxclients));
+    }
+    if (wanted("memory", true)) {
+        const uint64_t used = used_memory();
+        stats.peak_memory = std::max(stats.peak_memory, used);
+        section("Memory");
+        field("used_memory", std::to_string(used));
+        field("used_memory_rss", std::to_string(rss_memory()));
+        field("used_memory_peak", std::to_string(stats.peak_memory));
+        field("repl_backlog_bytes", std::to_string(repl_backlog.size()));
+        field("tracking_table_keys", std::to_string(tracking_table.size()));
+    }
+    if (wanted("persistence", true)) {
+        section("Persistence");
+        field("loading", repl_state == ReplState::TRANSFER ? "1" : "0");
+        field("snapshots_served", std::to_string(stats.snapshots));
+        field("last_snapshot_bytes", std::to_string(stats.last_snapshot_bytes));
+        field("last_snapshot_usec", std::to_string(stats.last_snapshot_usec));
+    }
+    if (wanted("stats", true)) {
+        section("Stats");
+        field("total_connections_received", std::to_string(stats.connections_received));
+        field("rejected_connections", std::to_string(stats.rejected_connections));
+        field("total_commands_processed", std::to_string(stats.commands_processed));
+        field("instantaneous_ops_per_sec", std::to_string(instantaneous_ops_per_sec()));
+        field("total_net_input_bytes", std::to_string(stats.net_input_bytes));
+        field("total_net_output_bytes", std::to_string(stats.net_output_bytes));
+        field("rejected_calls", std::to_string(stats.rejected_calls));
+        field("total_error_replies", std::to_string(stats.error_replies));
+        field("pubsub_channels", std::to_string(pubsub_channels.size()));
+        field("pubsub_patterns", std::to_string(pubsub_patterns.size()));
+    }
+    if (wanted("hotkeys", true)) {
+        section("Hotkeys");
+        field("hotkeys_accesses", std::to_string(hot_keys.accesses()));
+        const auto top = hot_keys.top(INFO_HOTKEYS);
+        for (size_t i = 0; i < top.size(); ++i) {
+            // quoted, a key may contain commas, newlines or anything else
+            field("hotkey_" + std::to_string(i), "key=" + quote_token(top[i].key) + ",reads=" +
+                                                 std::to_string(top[i].reads) + ",writes=" +
+                                                 std::to_string(top[i].writes));
+        }
+    }
+    if (wanted("keyspace", true)) {
+        section("Keyspace");
+        if (!kv_store.empty()) field("db0", "keys=" + std::to_string(kv_store.size()) + ",expires=0");
+    }
+    if (wanted("commandstats", false)) {
+        section("Commandstats");
+        for (const auto& [spec, cs] : command_stats) {
+            const double usec = static_cast<double>(CycleClock::to_ns(cs.ticks)) / 1000.0;
+            field("cmdstat_" + lower(spec->name),
+                  "calls=" + std::to_string(cs.calls) + ",usec=" + std::to_string(static_cast<uint64_t>(usec)) +
+                  ",usec_per_call=" + format_double(cs.calls ? usec / static_cast<double>(cs.calls) : 0) +
+                  ",rejected_calls=" + std::to_string(cs.rejected_calls) +
+                  ",failed_calls=" + std::to_string(cs.failed_calls));
+        }
+    }
+    if (wanted("latencystats", false)) {
+        section("Latencystats");
+        for (const auto& [spec, cs] : command_stats) {
+            if (cs.calls == 0) continue;
+            const auto usec = [&](const double p) {
+                return format_double(static_cast<double>(cs.latency.percentile(p)) / 1000.0);
+            };
+            field("latency_percentiles_usec_" + lower(spec->name),
+                  "p50=" + usec(50) + ",p99=" + usec(99) + ",p99.9=" + usec(99.9));
+        }
+    }
+    return result;
+}
+
+// HOTKEYS [count]: the most accessed keys, hottest first, each with its estimated reads and writes
+// since the counts were last halved
+std::string RedisServer::hotkeys_command(const std::vector<std::string>& tokens) const {
+    if (tokens.size() > 2) return command_error("Incorrect argument number");
+    size_t count = 10;
+    if (tokens.size() == 2) {
+        try {
+            size_t pos;
+            const long long n = std::stoll(tokens[1], &pos);
+            if (pos != tokens[1].size() || n <= 0) return command_error("Count should be a positive integer");
+            count = static_cast<size_t>(n);
+        } catch (...) {
+            return command_error("Count should be a positive integer");
+        }
+    }
+    std::string result;
+    const auto top = hot_keys.top(count);
+    for (size_t i = 0; i < top.size(); ++i) {
+        if (i > 0) result += "\n";
+        result += std::to_string(i + 1) + ") " + quote_token(top[i].key) + " " + std::to_string(top[i].reads) + " " +
+                  std::to_string(top[i].writes);
+    }
+    return result.empty() ? "(empty array)" : result;
+}
+
+std::string RedisServer::latency_command(const std::vector<std::string>& tokens) {
+    std::string sub = tokens[1];
+    for (char& c : sub) c = static_cast<char>(toupper(c));
+    if (sub == "HISTOGRAM") {
+        // LATENCY HISTOGRAM [command ...]: per command, the calls done within each power of two
+        // of microseconds, cumulative
+        std::vector<std::pair<std::string, const CommandStats*>> selected;
+        if (tokens.size() == 2) {
+            for (const auto& [spec, cs] : command_stats) {
+                if (cs.calls > 0) selected.emplace_back(lower(spec->name), &cs);
+            }
+        } else {
+            for (size_t i = 2; i < tokens.size(); ++i) {
+                std::string name = tokens[i];
+                for (char& c : name) c = static_cast<char>(toupper(c));
+                const auto* spec = lookup_command(name);
+                if (!spec) continue;
+                if (const auto it = command_stats.find(spec); it != command_stats.end() && it->second.calls > 0) {
+                    selected.emplace_back(lower(spec->name), &it->second);
+                }
+            }
+        }
+        std::string result;
+        int count = 0;
+        for (const auto& [name, cs] : selected) {
+            std::string buckets;
+            uint64_t bound = 1, cumulative = 0;
+            cs->latency.for_each_bucket([&](const uint64_t upper_ns, const uint64_t n) {
+                const uint64_t upper_us = (upper_ns + 999) / 1000;
+                if (upper_us > bound && cumulative > 0) {
+                    buckets += (buckets.empty() ? "" : ",") + std::to_string(bound) + ":" + std::to_string(cumulative);
+                }
+                while (bound < upper_us) bound <<= 1;
+                cumulative += n;
+            });
+            buckets += (buckets.empty() ? "" : ",") + std::to_string(bound) + ":" + std::to_string(cumulative);
+            if (count > 0) result += "\n";
+            result += std::to_string(++count) + ") " + name + " calls=" + std::to_string(cs->calls) +
+                      " histogram_usec=" + buckets;
+        }
+        return count == 0 ? "(empty array)" : result;
+    }
+    if (sub == "LATEST" && tokens.size() == 2) {
+        // per event: name, time of the latest sample, its latency and the all time maximum
+        std::string result;
+        int count = 0;
+        for (const auto& [name, event] : latency_events) {
+            if (count > 0) result += "\n";
+            result += std::to_string(++count) + ") " + name + " " + std::to_string(event.latest().time) + " " +
+                      std::to_string(event.latest().ms) + " " + std::to_string(event.max_ms);
+        }
+        return count == 0 ? "(empty array)" : result;
+    }
+    if (sub == "HISTORY" && tokens.size() == 3) {
+        const auto it = latency_events.find(tokens[2]);
+        if (it == latency_events.end()) return "(empty array)";
+        std::string result;
+        int count = 0;
+        for (const auto& sample : it->second.samples()) {
+            if (count > 0) result += "\n";
+            result += std::to_string(++count) + ") " + std::to_string(sample.time) + " " + std::to_string(sample.ms);
+        }
+        return result;
+    }
+    if (sub == "RESET") {
+        // LATENCY RESET [event ...], replies with the number of events reset
+        size_t reset = 0;
+        if (tokens.size() == 2) {
+            reset = latency_events.size();
+            latency_events.clear();
+        }
+        for (size_t i = 2; i < tokens.size(); ++i) {
+            reset += latency_events.erase(tokens[i]);
+        }
+        return std::to_string(reset);
+    }
+    return command_error("Unknown LATENCY subcommand or incorrect argument number");
+}
+
+void RedisServer::reset_stats() {
+    command_stats.clear();
+    const uint64_t start_ms = stats.start_ms;
+    stats = ServerStats {};
+    stats.start_ms = start_ms;
+}
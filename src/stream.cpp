@@ -0,0 +1,301 @@
+#include "stream.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t SAME_FIELDS = 1; // entry flag: the fields are those of the first entry of the block
+
+void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out += static_cast<char>(v | 0x80);
+        v >>= 7;
+    }
+    out += static_cast<char>(v);
+}
+
+void put_bytes(std::string& out, const std::string& s) {
+    put_varint(out, s.size());
+    out += s;
+}
+
+bool get_varint(const std::string& in, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= in.size()) return false;
+        const auto byte = static_cast<unsigned char>(in[pos++]);
+        v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool get_bytes(const std::string& in, size_t& pos, std::string& s) {
+    uint64_t len;
+    if (!get_varint(in, pos, len) || len > in.size() - pos) return false;
+    s.assign(in, pos, len);
+    pos += len;
+    return true;
+}
+
+bool get_id(const std::string& in, size_t& pos, StreamID& id) {
+    return get_varint(in, pos, id.ms) && get_varint(in, pos, id.seq);
+}
+
+void put_id(std::string& out, const StreamID& id) {
+    put_varint(out, id.ms);
+    put_varint(out, id.seq);
+}
+
+bool same_fields(const std::vector<std::string>& fields, const std::vector<std::string>& master) {
+    if (fields.size() != master.size()) return false;
+    for (size_t i = 0; i < fields.size(); i += 2) {
+        if (fields[i] != master[i]) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+bool StreamID::parse(const std::string& s, const uint64_t missing_seq, StreamID& out) {
+    const size_t dash = s.find('-');
+    const auto parse_u64 = [](const std::string& digits, uint64_t& v) {
+        if (digits.empty() || digits.size() > 20) return false;
+        v = 0;
+        for (const char c : digits) {
+            if (c < '0' || c > '9') return false;
+            const uint64_t next = v * 10 + static_cast<uint64_t>(c - '0');
+            if (next / 10 != v) return false;
+            v = next;
+        }
+        return true;
+    };
+    if (dash == std::string::npos) {
+        out.seq = missing_seq;
+        return parse_u64(s, out.ms);
+    }
+    return parse_u64(s.substr(0, dash), out.ms) && parse_u64(s.substr(dash + 1), out.seq);
+}
+
+// entry: flags, ms delta and seq (a delta when the ms is the same) from the previous entry, the
+// number of fields, then the fields unless SAME_FIELDS, then the values
+void Stream::pack(Block& block, const StreamID& id, const std::vector<std::string>& fields) {
+    if (block.count == 0) {
+        block.first = block.last = id;
+        block.master_fields = fields;
+    }
+    const bool same = block.count > 0 && same_fields(fields, block.master_fields);
+    put_varint(block.data, same ? SAME_FIELDS : 0);
+    put_varint(block.data, id.ms - block.last.ms);
+    put_varint(block.data, id.ms == block.last.ms ? id.seq - block.last.seq : id.seq);
+    put_varint(block.data, fields.size() / 2);
+    for (size_t i = 0; i < fields.size(); i += 2) {
+        if (!same) put_bytes(block.data, fields[i]);
+        put_bytes(block.data, fields[i + 1]);
+    }
+    block.last = id;
+    ++block.count;
+}
+
+void Stream::append(const StreamID& id, const std::vector<std::string>& fields) {
+    if (blocks.empty() || blocks.back().count >= BLOCK_MAX_ENTRIES || blocks.back().data.size() >= BLOCK_MAX_BYTES) {
+        blocks.emplace_back();
+    }
+    pack(blocks.back(), id, fields);
+    ++length_;
+    last_id_ = id;
+}
+
+bool Stream::decode(const Block& block, std::vector<StreamEntry>& out) {
+    size_t pos = 0;
+    StreamID id = block.first;
+    for (size_t n = 0; n < block.count; ++n) {
+        uint64_t flags, ms_delta, seq, pairs;
+        if (!get_varint(block.data, pos, flags) || !get_varint(block.data, pos, ms_delta) ||
+            !get_varint(block.data, pos, seq) || !get_varint(block.data, pos, pairs) ||
+            pairs > block.data.size() - pos || ((flags & SAME_FIELDS) && pairs * 2 != block.master_fields.size())) {
+            return false;
+        }
+        id = {id.ms + ms_delta, ms_delta == 0 ? id.seq + seq : seq};
+        StreamEntry entry {id, std::vector<std::string>(pairs * 2)};
+        for (size_t i = 0; i < pairs * 2; i += 2) {
+            if (flags & SAME_FIELDS) {
+                entry.fields[i] = block.master_fields[i];
+            } else if (!get_bytes(block.data, pos, entry.fields[i])) {
+                return false;
+            }
+            if (!get_bytes(block.data, pos, entry.fields[i + 1])) return false;
+        }
+        out.push_back(std::move(entry));
+    }
+    return true;
+}
+
+std::vector<StreamEntry> Stream::range(const StreamID& start, const StreamID& end, const size_t count,
+                                       const bool reverse) const {
+    std::vector<StreamEntry> result, entries;
+    if (end < start) return result;
+    const auto full = [&] { return count > 0 && result.size() >= count; };
+    if (!reverse) {
+        // the first block that may hold start
+        auto it = std::lower_bound(blocks.begin(), blocks.end(), start,
+                                   [](const Block& b, const StreamID& id) { return b.last < id; });
+        for (; it != blocks.end() && it->first <= end && !full(); ++it) {
+            entries.clear();
+            decode(*it, entries);
+            for (auto& entry : entries) {
+                if (end < entry.id || full()) break;
+                if (start <= entry.id) result.push_back(std::move(entry));
+            }
+        }
+        return result;
+    }
+    // the blocks after the last one that may hold end
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), end,
+                               [](const StreamID& id, const Block& b) { return id < b.first; });
+    for (; it != blocks.begin() && !full();) {
+        --it;
+        if (it->last < start) break;
+        entries.clear();
+        decode(*it, entries);
+        for (auto entry = entries.rbegin(); entry != entries.rend() && !full(); ++entry) {
+            if (entry->id < start) break;
+            if (entry->id <= end) result.push_back(std::move(*entry));
+        }
+    }
+    return result;
+}
+
+size_t Stream::trim(const size_t maxlen, const bool approximate) {
+    const size_t before = length_;
+    while (!blocks.empty() && length_ - blocks.front().count >= maxlen) {
+        length_ -= blocks.front().count;
+        blocks.pop_front();
+    }
+    if (!approximate && length_ > maxlen) {
+        // the entries to keep of the first block are packed again
+        std::vector<StreamEntry> entries;
+        decode(blocks.front(), entries);
+        Block block;
+        for (size_t i = length_ - maxlen; i < entries.size(); ++i) {
+            pack(block, entries[i].id, entries[i].fields);
+        }
+        length_ = maxlen;
+        blocks.front() = std::move(block);
+    }
+    return before - length_;
+}
+
+size_t Stream::memory_usage() const {
+    size_t bytes = blocks.size() * sizeof(Block);
+    for (const auto& block : blocks) {
+        bytes += block.data.capacity() + block.master_fields.capacity() * sizeof(std::string);
+        for (const auto& field : block.master_fields) bytes += field.capacity();
+    }
+    for (const auto& [name, group] : groups) {
+        // map nodes: three pointers and a color besides the value
+        bytes += 4 * sizeof(void*) + sizeof(std::pair<const std::string, StreamConsumerGroup>) + name.capacity();
+        bytes += group.pending.size() * (4 * sizeof(void*) + sizeof(std::pair<const StreamID, StreamPendingEntry>));
+        bytes += group.consumers.size() * (4 * sizeof(void*) + sizeof(std::pair<const std::string, uint64_t>));
+    }
+    return bytes;
+}
+
+// last id, blocks (first id, last id, count, data), groups (name, last delivered id, consumers
+// (name, seen ms), pending entries (id, consumer, delivery ms, deliveries)), counts and numbers
+// as varints
+void Stream::serialize(std::string& out) const {
+    put_id(out, last_id_);
+    put_varint(out, blocks.size());
+    for (const auto& block : blocks) {
+        put_id(out, block.first);
+        put_id(out, block.last);
+        put_varint(out, block.count);
+        put_bytes(out, block.data);
+    }
+    put_varint(out, groups.size());
+    for (const auto& [name, group] : groups) {
+        put_bytes(out, name);
+        put_id(out, group.last_delivered);
+        put_varint(out, group.consumers.size());
+        for (const auto& [consumer, seen_ms] : group.consumers) {
+            put_bytes(out, consumer);
+            put_varint(out, seen_ms);
+        }
+        put_varint(out, group.pending.size());
+        for (const auto& [id, pending] : group.pending) {
+            put_id(out, id);
+            put_bytes(out, pending.consumer);
+            put_varint(out, pending.delivery_ms);
+            put_varint(out, pending.deliveries);
+        }
+    }
+}
+
+bool Stream::deserialize(const std::string& in, Stream& out) {
+    size_t pos = 0;
+    uint64_t n;
+    if (!get_id(in, pos, out.last_id_) || !get_varint(in, pos, n)) return false;
+    for (uint64_t i = 0; i < n; ++i) {
+        Block block;
+        uint64_t count;
+        if (!get_id(in, pos, block.first) || !get_id(in, pos, block.last) || !get_varint(in, pos, count) ||
+            !get_bytes(in, pos, block.data) || count == 0 || count > BLOCK_MAX_ENTRIES) {
+            return false;
+        }
+        block.count = count;
+        // the first entry carries the fields of the block
+        size_t p = 0;
+        uint64_t flags, ms_delta, seq, pairs;
+        if (!get_varint(block.data, p, flags) || !get_varint(block.data, p, ms_delta) ||
+            !get_varint(block.data, p, seq) || !get_varint(block.data, p, pairs) || flags != 0 ||
+            pairs > block.data.size()) {
+            return false;
+        }
+        for (uint64_t f = 0; f < pairs; ++f) {
+            std::string field, value;
+            if (!get_bytes(block.data, p, field) || !get_bytes(block.data, p, value)) return false;
+            block.master_fields.push_back(std::move(field));
+            block.master_fields.emplace_back();
+        }
+        std::vector<StreamEntry> entries;
+        if (!decode(block, entries) || !(entries.front().id == block.first) || !(entries.back().id == block.last)) {
+            return false;
+        }
+        // IDs strictly increase, within a block and from one block to the next
+        if (!out.blocks.empty() && block.first <= out.blocks.back().last) return false;
+        for (size_t e = 1; e < entries.size(); ++e) {
+            if (entries[e].id <= entries[e - 1].id) return false;
+        }
+        out.length_ += block.count;
+        out.blocks.push_back(std::move(block));
+    }
+    if (!out.blocks.empty() && out.last_id_ < out.blocks.back().last) return false;
+    if (!get_varint(in, pos, n)) return false;
+    for (uint64_t i = 0; i < n; ++i) {
+        std::string name;
+        StreamConsumerGroup group;
+        uint64_t m;
+        if (!get_bytes(in, pos, name) || !get_id(in, pos, group.last_delivered) || !get_varint(in, pos, m)) {
+            return false;
+        }
+        for (uint64_t c = 0; c < m; ++c) {
+            std::string consumer;
+            uint64_t seen_ms;
+            if (!get_bytes(in, pos, consumer) || !get_varint(in, pos, seen_ms)) return false;
+            group.consumers[consumer] = seen_ms;
+        }
+        if (!get_varint(in, pos, m)) return false;
+        for (uint64_t e = 0; e < m; ++e) {
+            StreamID id;
+            StreamPendingEntry pending;
+            if (!get_id(in, pos, id) || !get_bytes(in, pos, pending.consumer) ||
+                !get_varint(in, pos, pending.delivery_ms) || !get_varint(in, pos, pending.deliveries)) {
+                return false;
+            }
+            group.pending.emplace(id, std::move(pending));
+        }
+        out.groups.emplace(std::move(name), std::move(group));
+    }
+    return pos == in.size();
+}
@@ -0,0 +1,121 @@
+#include "server.h"
+
+#include <algorithm>
+
+// Client side caching: a tracking client is told when a key it has read, or a key under one of
+// its BCAST prefixes, is modified. The default mode remembers readers per 64-bit key hash rather
+// than per key name; a hash collision only costs a spurious invalidation. Readers are remembered by
+// fd and client id, a closed client's fd can be reused by a client that never read the key.
+
+namespace {
+
+uint64_t key_id(const std::string& key) {
+    return std::hash<std::string>{}(key);
+}
+
+std::string invalidate_message(const std::string& key) {
+    return "1) invalidate\n2) " + key;
+}
+
+} // namespace
+
+std::string RedisServer::tracking_command(const int client_fd, const std::vector<std::string>& tokens) {
+    // CLIENT TRACKING ON|OFF [BCAST] [PREFIX prefix ...]
+    auto& client = clients[client_fd];
+    std::string mode = tokens[2];
+    for (char& c : mode) c = static_cast<char>(toupper(c));
+    if (mode != "ON" && mode != "OFF") return command_error("Tracking mode should be ON or OFF");
+
+    bool bcast = false;
+    std::vector<std::string> prefixes;
+    for (size_t i = 3; i < tokens.size(); ++i) {
+        std::string option = tokens[i];
+        for (char& c : option) c = static_cast<char>(toupper(c));
+        if (option == "BCAST") {
+            bcast = true;
+        } else if (option == "PREFIX" && i + 1 < tokens.size()) {
+            prefixes.push_back(tokens[++i]);
+        } else {
+            return command_error("Unknown tracking option " + tokens[i]);
+        }
+    }
+    if (!prefixes.empty() && !bcast) return command_error("PREFIX requires BCAST");
+
+    disable_tracking(client_fd);
+    if (mode == "OFF") return "OK";
+
+    client.tracking = true;
+    client.tracking_bcast = bcast;
+    if (bcast) {
+        if (prefixes.empty()) prefixes.emplace_back(); // every key
+        for (const auto& prefix : prefixes) {
+            tracking_prefixes[prefix].insert(client_fd);
+        }
+        client.tracking_prefixes = std::move(prefixes);
+    }
+    return "OK";
+}
+
+void RedisServer::disable_tracking(const int client_fd) {
+    auto& client = clients[client_fd];
+    for (const auto& prefix : client.tracking_prefixes) {
+        if (const auto it = tracking_prefixes.find(prefix); it != tracking_prefixes.end()) {
+            it->second.erase(client_fd);
+            if (it->second.empty()) tracking_prefixes.erase(it);
+        }
+    }
+    // entries of the default mode are left in tracking_table, invalidate_key skips clients that
+    // stopped tracking or were closed
+    client.tracking = false;
+    client.tracking_bcast = false;
+    client.tracking_prefixes.clear();
+}
+
+void RedisServer::track_key(const int client_fd, const std::string& key) {
+    auto& readers = tracking_table[key_id(key)];
+    const std::pair reader(client_fd, clients[client_fd].id);
+    if (std::find(readers.begin(), readers.end(), reader) == readers.end()) readers.push_back(reader);
+
+    // over the limit, drop entries and ask their clients to flush everything they cached
+    while (tracking_table.size() > config.tracking_table_max_keys) {
+        const auto it = tracking_table.begin();
+        for (const auto& [fd, id] : it->second) {
+            if (const auto cit = clients.find(fd); cit != clients.end() && cit->second.id == id &&
+                cit->second.tracking) {
+                send_response(fd, invalidate_message("(nil)"));
+            }
+        }
+        tracking_table.erase(it);
+    }
+}
+
+void RedisServer::invalidate_key(const std::string& key) {
+    if (!tracking_table.empty()) {
+        if (const auto it = tracking_table.find(key_id(key)); it != tracking_table.end()) {
+            // one shot: a client has to read the key again to be told about the next change
+            const auto readers = std::move(it->second);
+            tracking_table.erase(it);
+            for (const auto& [fd, id] : readers) {
+                if (const auto cit = clients.find(fd); cit != clients.end() && cit->second.id == id &&
+                    cit->second.tracking && !cit->second.tracking_bcast) {
+                    send_response(fd, invalidate_message(key));
+                }
+            }
+        }
+    }
+    if (tracking_prefixes.empty()) return;
+    // a client with overlapping prefixes is told once
+    std::unordered_set<int> notified;
+    for (const auto& [prefix, fds] : tracking_prefixes) {
+        if (key.compare(0, prefix.size(), prefix) != 0) continue;
+        for (const int fd : fds) {
+            if (notified.insert(fd).second) send_response(fd, invalidate_message(key));
+        }
+    }
+}
+
+void RedisServer::notify_keyspace_event(const unsigned type, const std::string& event, const std::string& key) {
+    if (!(config.notify_flags & type)) return;
+    if (config.notify_flags & NOTIFY_KEYSPACE) publish("__keyspace@0__:" + key, event);
+    if (config.notify_flags & NOTIFY_KEYEVENT) publish("__keyevent@0__:" + event, key);
+}
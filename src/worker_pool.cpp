@@ -0,0 +1,106 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+WorkerPool::WorkerPool(const size_t threads) {
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    for (size_t i = 0; i < threads; ++i) {
+        this->threads.emplace_back([this] { worker_loop(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (auto& thread : threads) thread.join();
+    if (efd >= 0) close(efd);
+}
+
+void WorkerPool::worker_loop() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        work_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) return; // stopping
+        auto task = std::move(tasks.front());
+        tasks.pop_front();
+        ++running;
+        lock.unlock();
+        task();
+        lock.lock();
+        if (--running == 0 && tasks.empty()) idle_cv.notify_all();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    work_cv.notify_one();
+}
+
+void WorkerPool::parallel_for(const size_t n, const std::function<void(size_t, size_t)>& fn) {
+    if (n == 0) return;
+    // a few chunks per thread, so that uneven chunks still spread over the threads
+    struct Progress {
+        size_t chunk = 0;
+        size_t chunks = 0;
+        std::atomic<size_t> next {0};
+        std::atomic<size_t> done {0};
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    auto progress = std::make_shared<Progress>();
+    progress->chunk = (n + size() * 4 - 1) / (size() * 4);
+    progress->chunks = (n + progress->chunk - 1) / progress->chunk;
+    // fn is only called for a chunk taken before the last one is done, while the caller still waits
+    const auto run = [progress, n, f = &fn] {
+        for (size_t i; (i = progress->next.fetch_add(1)) < progress->chunks;) {
+            (*f)(i * progress->chunk, std::min(n, (i + 1) * progress->chunk));
+            if (progress->done.fetch_add(1) + 1 == progress->chunks) {
+                std::lock_guard lock(progress->mutex);
+                progress->cv.notify_all();
+            }
+        }
+    };
+    for (size_t i = 1; i < size() && i < progress->chunks; ++i) submit(run);
+    run();
+    std::unique_lock lock(progress->mutex);
+    progress->cv.wait(lock, [&] { return progress->done == progress->chunks; });
+}
+
+void WorkerPool::complete(std::function<void()> done) {
+    {
+        std::lock_guard lock(completions_mutex);
+        completions.push_back(std::move(done));
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t n = write(efd, &one, sizeof(one));
+}
+
+size_t WorkerPool::run_completions() {
+    uint64_t count;
+    [[maybe_unused]] const ssize_t n = read(efd, &count, sizeof(count));
+    std::vector<std::function<void()>> done;
+    {
+        std::lock_guard lock(completions_mutex);
+        done.swap(completions);
+    }
+    for (auto& fn : done) fn();
+    return done.size();
+}
+
+void WorkerPool::drain() {
+    {
+        std::unique_lock lock(mutex);
+        idle_cv.wait(lock, [this] { return running == 0 && tasks.empty(); });
+    }
+    run_completions();
+}
@@ -0,0 +1,174 @@
+#include "server.h"
+
+#include <utility>
+
+// SINTER, SUNION, SDIFF, ZINTER and ZUNION over large inputs run on the worker pool. The main
+// thread resolves the input objects, locks their keys and marks the client blocked; until the job
+// completes a write to a locked key waits (the writing client is parked with its command back in
+// its buffer, or the main thread drains the pool for the primary link, transactions and scripts),
+// so the job reads a consistent view without copying it. Keys of other commands are unaffected:
+// the objects of kv_store do not move when it grows.
+
+namespace {
+
+using Members = std::unordered_set<std::string>;
+using Scores = std::unordered_map<std::string, double>;
+
+// Collects emit(bucket, out) over every bucket of table, the buckets being split across the pool;
+// the outputs come back in bucket order
+template <typename T, typename Table, typename Emit>
+std::vector<T> scan_buckets(WorkerPool& pool, const Table& table, const Emit& emit) {
+    const size_t buckets = table.bucket_count();
+    const size_t parts_count = std::min(buckets, pool.size() * 16);
+    std::vector<std::vector<T>> parts(parts_count);
+    pool.parallel_for(parts_count, [&](const size_t first, const size_t last) {
+        for (size_t p = first; p < last; ++p) {
+            for (size_t b = buckets * p / parts_count; b < buckets * (p + 1) / parts_count; ++b) {
+                emit(b, parts[p]);
+            }
+        }
+    });
+    std::vector<T> result;
+    for (auto& part : parts) result.insert(result.end(), part.begin(), part.end());
+    return result;
+}
+
+// hash probe of the members of table against other, keeping those found (or those not found)
+std::vector<const std::string*> probe(WorkerPool& pool, const Members& table, const Members& other, const bool keep_found) {
+    return scan_buckets<const std::string*>(pool, table, [&](const size_t b, std::vector<const std::string*>& out) {
+        for (auto it = table.begin(b); it != table.end(b); ++it) {
+            if ((other.count(*it) > 0) == keep_found) out.push_back(&*it);
+        }
+    });
+}
+
+void append_item(std::string& result, size_t& count, const std::string& item) {
+    if (count > 0) result += "\n";
+    result += std::to_string(++count) + ") " + item;
+}
+
+std::string set_job(WorkerPool& pool, const std::string& command, const Members& a, const Members& b) {
+    std::vector<const std::string*> members;
+    if (command == "SINTER") {
+        members = a.size() <= b.size() ? probe(pool, a, b, true) : probe(pool, b, a, true);
+    } else if (command == "SDIFF") {
+        members = probe(pool, a, b, false);
+    } else {
+        // SUNION: the members of a missing from b, then b
+        members = probe(pool, a, b, false);
+        const auto rest = scan_buckets<const std::string*>(pool, b, [&](const size_t i, std::vector<const std::string*>& out) {
+            for (auto it = b.begin(i); it != b.end(i); ++it) out.push_back(&*it);
+        });
+        members.insert(members.end(), rest.begin(), rest.end());
+    }
+    std::string result;
+    size_t count = 0;
+    for (const auto* member : members) append_item(result, count, *member);
+    return count == 0 ? "(empty array)" : result;
+}
+
+std::string zset_job(WorkerPool& pool, const std::string& command, const Scores& a, const Scores& b) {
+    using Item = std::pair<const std::string*, double>;
+    // members of table with their score, plus the score in other when found there; only the
+    // common ones unless keep_missing
+    const auto sum = [&](const Scores& table, const Scores& other, const bool keep_missing) {
+        return scan_buckets<Item>(pool, table, [&](const size_t i, std::vector<Item>& out) {
+            for (auto it = table.begin(i); it != table.end(i); ++it) {
+                if (const auto found = other.find(it->first); found != other.end()) {
+                    out.emplace_back(&it->first, it->second + found->second);
+                } else if (keep_missing) {
+                    out.emplace_back(&it->first, it->second);
+                }
+            }
+        });
+    };
+    std::vector<Item> items;
+    if (command == "ZINTER") {
+        items = a.size() <= b.size() ? sum(a, b, false) : sum(b, a, false);
+    } else {
+        // ZUNION: a with the scores of b added, then the members of b missing from a
+        items = sum(a, b, true);
+        const auto rest = scan_buckets<Item>(pool, b, [&](const size_t i, std::vector<Item>& out) {
+            for (auto it = b.begin(i); it != b.end(i); ++it) {
+                if (!a.count(it->first)) out.emplace_back(&it->first, it->second);
+            }
+        });
+        items.insert(items.end(), rest.begin(), rest.end());
+    }
+    std::string result;
+    size_t count = 0;
+    for (const auto& [member, score] : items) append_item(result, count, *member + " " + double2string(score));
+    return count == 0 ? "(empty array)" : result;
+}
+
+} // namespace
+
+bool RedisServer::start_job(const int client_fd, const std::vector<std::string>& tokens) {
+    auto& client = clients[client_fd];
+    // transactions, scripts and the primary link need the reply now
+    if (call_depth != 1 || client.deny_blocking || client.is_master) return false;
+    const bool zset = tokens[0][0] == 'Z';
+    const RedisObject* inputs[2] = {nullptr, nullptr};
+    size_t elements = 0;
+    for (int i = 0; i < 2; ++i) {
+        const auto it = kv_store.find(tokens[1 + i]);
+        if (it == kv_store.end()) continue;
+        // type errors are replied inline
+        if (zset ? !it->second.zset() : !it->second.members()) return false;
+        inputs[i] = &it->second;
+        elements += zset ? it->second.zset()->map.size() : it->second.members()->size();
+    }
+    if (elements < config.worker_min_elements) return false;
+
+    std::vector<std::string> keys = {tokens[1], tokens[2]};
+    for (const auto& key : keys) ++job_keys[key];
+    client.blocked = true;
+    workers->submit([this, client_fd, id = client.id, command = tokens[0], keys = std::move(keys), inputs, zset] {
+        std::string reply;
+        if (zset) {
+            static const Scores empty;
+            reply = zset_job(*workers, command, inputs[0] ? inputs[0]->zset()->map : empty,
+                             inputs[1] ? inputs[1]->zset()->map : empty);
+        } else {
+            static const Members empty;
+            reply = set_job(*workers, command, inputs[0] ? *inputs[0]->members() : empty,
+                            inputs[1] ? *inputs[1]->members() : empty);
+        }
+        workers->complete([this, client_fd, id, keys, reply = std::move(reply)] {
+            finish_job(client_fd, id, keys, reply);
+        });
+    });
+    return true;
+}
+
+void RedisServer::finish_job(const int client_fd, const uint64_t client_id, const std::vector<std::string>& keys,
+                             const std::string& reply) {
+    for (const auto& key : keys) {
+        if (const auto it = job_keys.find(key); it != job_keys.end() && --it->second == 0) job_keys.erase(it);
+    }
+    // the client may have disconnected, its fd even been reused, while the job ran
+    if (const auto it = clients.find(client_fd); it != clients.end() && it->second.id == client_id && it->second.blocked) {
+        it->second.blocked = false;
+        send_response(client_fd, reply);
+        unblocked_clients.push_back(client_fd);
+    }
+    // parked writers run their command again, or park again if a key is still locked
+    for (const auto& [fd, id] : std::exchange(job_waiters, {})) {
+        if (const auto it = clients.find(fd); it != clients.end() && it->second.id == id && it->second.blocked) {
+            it->second.blocked = false;
+            unblocked_clients.push_back(fd);
+        }
+    }
+}
+
+bool RedisServer::touches_job_keys(const CommandSpec& spec, const std::vector<std::string>& tokens) const {
+    if (job_keys.empty() || !(spec.flags & CommandSpec::WRITE)) return false;
+    for (const auto& key : command_keys(spec, tokens)) {
+        if (job_keys.count(key)) return true;
+    }
+    return false;
+}
+
+void RedisServer::wait_for_jobs() {
+    if (workers) workers->drain();
+}